@@ -27,14 +27,40 @@ THE SOFTWARE.
 // This is normally in the mikmod.h file of the MikMod project
 MIKMODAPI extern struct MDRIVER drv_wii; /* Wii driver. */
 
+// These are normally in the mikmod_internals.h file of the MikMod project
+extern UBYTE md_sngchn; /* Number of song voices. */
+extern UBYTE md_sfxchn; /* Number of sound effects voices. */
+extern void Sample_Free_internal(SAMPLE *);
+extern MREADER *_mm_new_mem_reader(const void *buffer, long len);
+extern void _mm_delete_mem_reader(MREADER *reader);
+
 typedef struct _GRRMOD_DATA {
     char *ModType;    /**< A string representing the MOD type. */
     char *SongTitle;  /**< A string representing the song title. */
 } GRRMOD_DATA;
 
+#define CACHE_SLOTS (8)  /**< Most modules kept loaded. */
+#define STATE_CHUNK (16) /**< Voices read at a time by GetVoices and GetMeters. */
+
+typedef struct _GRRMOD_CACHED {
+    const void *mem;  /**< Memory the module was loaded from. */
+    u64 size;         /**< Size of that memory. */
+    u32 hash;         /**< Hash of that memory. */
+    MODULE *module;   /**< Loaded module, NULL if the slot is free. */
+    MREADER *reader;  /**< Reader of the memory, streamed samples are read from it. */
+    u32 bytes;        /**< Sample memory taken by loading the module. */
+    u32 used;         /**< Value of CacheClock when the module was last set. */
+    u8 voices;        /**< Number of song voices the module plays on. */
+} GRRMOD_CACHED;
+
 static GRRMOD_DATA MusicData = {};
 static MODULE *module = NULL;   /**< Module structure. */
 
+static GRRMOD_CACHED Cache[CACHE_SLOTS] = {}; /**< Loaded modules, including the current one. */
+static GRRMOD_CACHED *Current = NULL;         /**< Cache slot of the current module. */
+static u32 CacheSize = 0;                     /**< Sample memory the modules not set may keep. */
+static u32 CacheClock = 0;
+
 static u8 *pBuffer; /**< Pointer to the sound buffer. */
 static u8 **ppBuffer = &pBuffer; /**< Pointer to the sound buffer pointer. */
 
@@ -48,9 +74,28 @@ void GRRMOD_MOD_Register(GRRMOD_FuntionsList *RegFunc) {
     RegFunc->SetMOD = GRRMOD_MOD_SetMOD;
     RegFunc->Unload = GRRMOD_MOD_Unload;
     RegFunc->SetFrequency = GRRMOD_MOD_SetFrequency;
+    RegFunc->SetOversampling = GRRMOD_MOD_SetOversampling;
+    RegFunc->SetMaxVoices = GRRMOD_MOD_SetMaxVoices;
+    RegFunc->SetCompression = GRRMOD_MOD_SetCompression;
+    RegFunc->SetStreaming = GRRMOD_MOD_SetStreaming;
+    RegFunc->SetCacheSize = GRRMOD_MOD_SetCacheSize;
+    RegFunc->GetVoiceCount = GRRMOD_MOD_GetVoiceCount;
+    RegFunc->GetSampleMemory = GRRMOD_MOD_GetSampleMemory;
+    RegFunc->GetStreamStats = GRRMOD_MOD_GetStreamStats;
+    RegFunc->SetDecodeAhead = GRRMOD_MOD_SetDecodeAhead;
+    RegFunc->GetDecodeStats = GRRMOD_MOD_GetDecodeStats;
+    RegFunc->SeekTime = GRRMOD_MOD_SeekTime;
+    RegFunc->SetReverb = GRRMOD_MOD_SetReverb;
     RegFunc->GetVoiceFrequency = GRRMOD_MOD_GetVoiceFrequency;
     RegFunc->GetVoiceVolume = GRRMOD_MOD_GetVoiceVolume;
     RegFunc->GetRealVoiceVolume = GRRMOD_MOD_GetRealVoiceVolume;
+    RegFunc->GetVoices = GRRMOD_MOD_GetVoices;
+    RegFunc->GetMeters = GRRMOD_MOD_GetMeters;
+    RegFunc->SFX_Load = GRRMOD_MOD_SFX_Load;
+    RegFunc->SFX_Free = GRRMOD_MOD_SFX_Free;
+    RegFunc->SFX_Play = GRRMOD_MOD_SFX_Play;
+    RegFunc->SFX_Stop = GRRMOD_MOD_SFX_Stop;
+    RegFunc->SFX_SetVolume = GRRMOD_MOD_SFX_SetVolume;
     RegFunc->Start = GRRMOD_MOD_Start;
     RegFunc->Stop = GRRMOD_MOD_Stop;
     RegFunc->Pause = GRRMOD_MOD_Pause;
@@ -75,7 +120,8 @@ s8 GRRMOD_MOD_Init(bool stereo) {
     md_mode = DMODE_16BITS |
               DMODE_HQMIXER |
               DMODE_SOFT_MUSIC |
-              DMODE_SOFT_SNDFX;
+              DMODE_SOFT_SNDFX |
+              DMODE_SIMDMIXER;
 
     if(stereo == true) {
         md_mode |= DMODE_STEREO; //this causes some modules (s3m mostly) to play back incorrectly on Wii
@@ -86,42 +132,208 @@ s8 GRRMOD_MOD_Init(bool stereo) {
     if(MikMod_Init(CommandLine) != 0) {
         return -1;
     }
+    // Effects get voices of their own, mixed in the same pass as the music
+    MikMod_SetNumVoices(-1, SFXVOICES);
     return 0;
 }
 
+/**
+ * Hash the memory of a module, FNV-1a.
+ * @param mem Memory of the module.
+ * @param size Size of the memory.
+ * @return The hash of the memory.
+ */
+static u32 HashMemory(const void *mem, u64 size) {
+    const u8 *data = (const u8 *)mem;
+    u32 hash = 2166136261U;
+    u64 i;
+
+    for(i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * Free a cached module and its slot.
+ * @param slot The cache slot to free.
+ */
+static void FreeCached(GRRMOD_CACHED *slot) {
+    if(slot->module != NULL) {
+        Player_Free(slot->module);
+    }
+    if(slot->reader != NULL) {
+        _mm_delete_mem_reader(slot->reader);
+    }
+    memset(slot, 0, sizeof(GRRMOD_CACHED));
+}
+
+/**
+ * Get the least recently set module, other than the current one.
+ * @return The cache slot of the module, NULL if there is none.
+ */
+static GRRMOD_CACHED *OldestCached(void) {
+    GRRMOD_CACHED *oldest = NULL;
+    u32 i;
+
+    for(i = 0; i < CACHE_SLOTS; i++) {
+        if(Cache[i].module != NULL && &Cache[i] != Current &&
+           (oldest == NULL || Cache[i].used < oldest->used)) {
+            oldest = &Cache[i];
+        }
+    }
+    return oldest;
+}
+
+/**
+ * Free the least recently set modules until the others fit in the cache size.
+ */
+static void TrimCache(void) {
+    GRRMOD_CACHED *oldest;
+    u32 i, total;
+
+    for(;;) {
+        for(i = 0, total = 0; i < CACHE_SLOTS; i++) {
+            if(Cache[i].module != NULL && &Cache[i] != Current) {
+                total += Cache[i].bytes;
+            }
+        }
+        if(total <= CacheSize || (oldest = OldestCached()) == NULL) {
+            return;
+        }
+        FreeCached(oldest);
+    }
+}
+
+/**
+ * Load a module into a free cache slot. When the mixer runs out of sample
+ * handles, the least recently set modules are freed until it fits.
+ * @param slot The cache slot to load to.
+ * @param mem Memory of the module.
+ * @param size Size of the memory.
+ * @return True if the module was loaded.
+ */
+static bool LoadCached(GRRMOD_CACHED *slot, const void *mem, u64 size) {
+    MSAMPLESTATS before, after;
+    GRRMOD_CACHED *oldest;
+
+    for(;;) {
+        VC_GetSampleStats(&before);
+        slot->reader = _mm_new_mem_reader(mem, size);
+        if(slot->reader == NULL) {
+            return false;
+        }
+        slot->module = Player_LoadGeneric(slot->reader, 128, 0);
+        if(slot->module != NULL) {
+            break;
+        }
+        _mm_delete_mem_reader(slot->reader);
+        slot->reader = NULL;
+        if(MikMod_errno != MMERR_OUT_OF_HANDLES || (oldest = OldestCached()) == NULL) {
+            return false;
+        }
+        FreeCached(oldest);
+    }
+    VC_GetSampleStats(&after);
+
+    slot->mem = mem;
+    slot->size = size;
+    slot->bytes = after.bytes - before.bytes;
+    slot->voices = md_sngchn;
+    slot->module->wrap = true; // The module will restart when it's finished
+    return true;
+}
+
 /**
  * Call this before exiting your application.
  * Ensure this function is only ever called once.
  */
 void GRRMOD_MOD_End(void) {
+    u32 i;
+
+    GRRMOD_MOD_Unload();
+    for(i = 0; i < CACHE_SLOTS; i++) {
+        FreeCached(&Cache[i]);
+    }
     MikMod_Exit();
 }
 
 /**
  * Load a MOD file from memory.
+ * Modules kept in the cache are set again without being loaded.
  * @param mem Memory to set.
  * @param size Size of the memory to set.
  */
 void GRRMOD_MOD_SetMOD(const void *mem, u64 size) {
+    GRRMOD_CACHED *slot = NULL;
+    bool hashed = false;
+    u32 hash = 0, i;
+
     if(module != NULL) {
         GRRMOD_MOD_Unload();
     }
-    FILE *File = fmemopen((void *)mem, size, "rb");
-    module = Player_LoadFP(File, 128, 0);
-    if(module != NULL) {
-        module->wrap = true; // The module will restart when it's finished
-        MusicData.SongTitle = strdup(module->songname);
-        MusicData.ModType = strdup(module->modtype);
+
+    // The memory is only hashed to check that a module kept from it is still the same
+    for(i = 0; i < CACHE_SLOTS; i++) {
+        if(Cache[i].module != NULL && Cache[i].mem == mem && Cache[i].size == size) {
+            if(hashed == false) {
+                hash = HashMemory(mem, size);
+                hashed = true;
+            }
+            if(Cache[i].hash == hash) {
+                slot = &Cache[i];
+            }
+            else {
+                FreeCached(&Cache[i]); // The memory was written over
+            }
+        }
+    }
+
+    if(slot != NULL) {
+        if(md_sngchn != slot->voices) {
+            MikMod_SetNumVoices(slot->voices, -1);
+        }
+    }
+    else {
+        for(i = 0; i < CACHE_SLOTS && Cache[i].module != NULL; i++);
+        if(i == CACHE_SLOTS) {
+            FreeCached(OldestCached());
+            for(i = 0; Cache[i].module != NULL; i++);
+        }
+        slot = &Cache[i];
+        if(LoadCached(slot, mem, size) == false) {
+            FreeCached(slot);
+            return;
+        }
+        if(hashed == false && CacheSize > 0) { // Without a cache, the module is freed when unloaded
+            hash = HashMemory(mem, size);
+        }
+        slot->hash = hash;
     }
+
+    slot->used = ++CacheClock;
+    Current = slot;
+    module = slot->module;
+    TrimCache();
+    MusicData.SongTitle = strdup(module->songname);
+    MusicData.ModType = strdup(module->modtype);
 }
 
 /**
- * Unload a MOD file.
+ * Unload a MOD file. It stays loaded in the cache while it fits.
  */
 void GRRMOD_MOD_Unload(void) {
     if(module != NULL) {
-        Player_Free(module);
+        if(Player_GetModule() == module) {
+            Player_SetPosition(0);
+            Player_Stop();
+        }
         module = NULL;
+        if(CacheSize == 0) {
+            FreeCached(Current);
+        }
+        Current = NULL;
+        TrimCache();
     }
     if(MusicData.ModType != NULL) {
         free(MusicData.ModType);
@@ -183,12 +395,135 @@ void GRRMOD_MOD_SetFrequency(u32 freq) {
     md_mixfreq = freq;
 }
 
+/**
+ * Set the oversampling factor of the mixer.
+ * The new factor takes effect at the next tick of the module.
+ * @param factor Oversampling factor: 1, 2 or 4.
+ */
+void GRRMOD_MOD_SetOversampling(u8 factor) {
+    md_oversampling = (factor >= 4) ? 2 : (factor >= 2) ? 1 : 0;
+}
+
+/**
+ * Set the maximum number of voices really mixed.
+ * The quietest voices above this number are only followed, not mixed.
+ * @param count Maximum number of voices, 0 for no limit.
+ */
+void GRRMOD_MOD_SetMaxVoices(u8 count) {
+    md_mixvoices = count;
+}
+
+/**
+ * Set the shortest sample kept ADPCM compressed by the modules loaded next.
+ * @param length Shortest sample compressed, in frames, 0 to compress none.
+ */
+void GRRMOD_MOD_SetCompression(u32 length) {
+    md_compress = length;
+}
+
+/**
+ * Set the sample memory kept by the modules which were set before.
+ * @param bytes Size of the cache in bytes, 0 to free the modules once they are unloaded.
+ */
+void GRRMOD_MOD_SetCacheSize(u32 bytes) {
+    CacheSize = bytes;
+    TrimCache();
+}
+
+/**
+ * Set the shortest sample streamed by the modules loaded next.
+ * @param length Shortest part played before the loop, in frames, 0 to stream none.
+ */
+void GRRMOD_MOD_SetStreaming(u32 length) {
+    md_stream = length;
+}
+
+/**
+ * Get the number of voices mixed and followed during the last tick.
+ * @param real Receives the number of voices really mixed.
+ * @param virt Receives the number of voices only followed.
+ */
+void GRRMOD_MOD_GetVoiceCount(u8 *real, u8 *virt) {
+    *real = md_realvoices;
+    *virt = md_virtualvoices;
+}
+
+/**
+ * Get the memory taken by the samples of the loaded modules and sound effects.
+ * @param used Receives the number of bytes allocated for samples.
+ * @param saved Receives the number of bytes saved by sharing identical samples.
+ */
+void GRRMOD_MOD_GetSampleMemory(u32 *used, u32 *saved) {
+    MSAMPLESTATS stats;
+
+    VC_GetSampleStats(&stats);
+    *used = stats.bytes;
+    *saved = stats.saved;
+}
+
+/**
+ * Get the activity of the streamed samples since the start.
+ * @param reads Receives the number of windows read.
+ * @param misses Receives the number of times a window was needed before it was read.
+ */
+void GRRMOD_MOD_GetStreamStats(u32 *reads, u32 *misses) {
+    MSAMPLESTATS stats;
+
+    VC_GetSampleStats(&stats);
+    *reads = stats.reads;
+    *misses = stats.misses;
+}
+
+/**
+ * Set how far ahead of playback a thread decodes. Not used for modules.
+ * @param ms Time decoded ahead in milliseconds.
+ */
+void GRRMOD_MOD_SetDecodeAhead(u16 ms) {
+}
+
+/**
+ * Get the state of the decoder thread. There is none for modules.
+ * @param fill Receives the time decoded ahead of playback in milliseconds.
+ * @param underruns Receives the number of buffers played before enough samples were decoded.
+ */
+void GRRMOD_MOD_GetDecodeStats(u32 *fill, u32 *underruns) {
+    *fill = 0;
+    *underruns = 0;
+}
+
+/**
+ * Move playback to a time of the song. Not used for modules.
+ * @param ms Time to play from in milliseconds.
+ * @return Always -1.
+ */
+s8 GRRMOD_MOD_SeekTime(u32 ms) {
+    return -1;
+}
+
+/**
+ * Set the reverb of the software mixer.
+ * @param time Reverb time in milliseconds, 0 to disable.
+ * @param damping High frequency damping, 0 (bright) to 255 (dull).
+ * @param wet Reverb level, 0 to 128.
+ */
+void GRRMOD_MOD_SetReverb(u16 time, u8 damping, u8 wet) {
+    md_reverb = 0;
+    md_reverbtime = time;
+    md_reverbdamp = damping;
+    md_reverbwet = (wet > 128) ? 128 : wet;
+}
+
 /**
  * This function returns the frequency of the sample currently playing on the specified voice.
  * @param voice The number of the voice to get frequency.
  * @return The current frequency of the sample playing on the specified voice, or zero if no sample is currently playing on the voice.
  */
 u32 GRRMOD_MOD_GetVoiceFrequency(u8 voice) {
+    VOICESTATE vs;
+
+    if(Player_GetVoiceStates(&vs, voice, 1) == 1) {
+        return vs.frequency;
+    }
     return Voice_GetFrequency(voice);
 }
 
@@ -198,24 +533,147 @@ u32 GRRMOD_MOD_GetVoiceFrequency(u8 voice) {
  * @return The current volume of the sample playing on the specified voice, or zero if no sample is currently playing on the voice.
  */
 u32 GRRMOD_MOD_GetVoiceVolume(u8 voice) {
+    VOICESTATE vs;
+
+    if(Player_GetVoiceStates(&vs, voice, 1) == 1) {
+        return vs.volume;
+    }
     return Voice_GetVolume(voice);
 }
 
 /**
  * This function returns the actual playing volume of the specified voice.
+ * The software mixer measures it while mixing, otherwise the sample is scanned.
  * @param voice The number of the voice to analyze (starting from zero).
- * @return The real volume of the voice when the function was called, in the range 0-65535.
+ * @return The peak level of the voice during the last buffer, in the range 0-65535.
  */
 u32 GRRMOD_MOD_GetRealVoiceVolume(u8 voice) {
+    MMETER m;
+
+    if(VC_GetMeters(&m, voice, 1, NULL) == 1) {
+        return ((m.peakl > m.peakr) ? m.peakl : m.peakr) << 1;
+    }
     return Voice_RealVolume(voice);
 }
 
+/**
+ * Get the state of the first voices as of the last buffer mixed, without locking the player.
+ * The voices are read STATE_CHUNK at a time, so a long read may span two buffers.
+ * @param out Receives the state of the voices.
+ * @param n Number of voices to read.
+ * @return The number of voices copied to out.
+ */
+u8 GRRMOD_MOD_GetVoices(GRRMOD_VoiceInfo *out, u8 n) {
+    VOICESTATE vs[STATE_CHUNK];
+    u32 count = 0, got, i;
+
+    while(count < n) {
+        got = Player_GetVoiceStates(vs, count, (n - count < STATE_CHUNK) ? n - count : STATE_CHUNK);
+        for(i = 0; i < got; i++, count++) {
+            out[count].sample = vs[i].sample;
+            out[count].instrument = vs[i].instrument;
+            out[count].note = vs[i].note;
+            out[count].volume = vs[i].volume;
+            out[count].panning = vs[i].panning;
+            out[count].frequency = vs[i].frequency;
+            out[count].position = vs[i].position;
+        }
+        if(got < STATE_CHUNK) {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * Load a sound effect from a WAV file in memory.
+ * @param mem Memory holding the WAV file.
+ * @param size Size of the WAV file.
+ * @return The sound effect, or NULL if it could not be loaded.
+ */
+GRRMOD_SFX *GRRMOD_MOD_SFX_Load(const void *mem, u32 size) {
+    return (GRRMOD_SFX *)Sample_LoadMem(mem, size);
+}
+
+/**
+ * Free a sound effect, stopping the voices still playing it.
+ * @param sfx The sound effect to free.
+ */
+void GRRMOD_MOD_SFX_Free(GRRMOD_SFX *sfx) {
+    Sample_Free_internal((SAMPLE *)sfx);
+}
+
+/**
+ * Play a sound effect on one of the effect voices.
+ * The effect is only heard while a module is started, Player_Start enables the output.
+ * @param sfx The sound effect to play.
+ * @param priority Priority of the effect, 0 (lowest) to 255.
+ * @return The effect voice used, or -1 if the effect could not be played.
+ */
+s8 GRRMOD_MOD_SFX_Play(GRRMOD_SFX *sfx, u8 priority) {
+    SBYTE voice = Sample_PlayPriority((SAMPLE *)sfx, 0, 0, priority);
+    return (voice < 0) ? -1 : voice - md_sngchn;
+}
+
+/**
+ * Stop a sound effect.
+ * The voice may have been taken by a newer effect since, which is then stopped.
+ * @param voice The effect voice returned by GRRMOD_MOD_SFX_Play.
+ */
+void GRRMOD_MOD_SFX_Stop(s8 voice) {
+    if(voice >= 0 && voice < md_sfxchn) {
+        Voice_Stop(voice + md_sngchn);
+    }
+}
+
+/**
+ * Set the volume of all sound effects.
+ * @param volume The sound effect volume, 0 to 128.
+ */
+void GRRMOD_MOD_SFX_SetVolume(u8 volume) {
+    md_sndfxvolume = (volume > 128) ? 128 : volume;
+}
+
+/**
+ * Get the levels measured by the software mixer during the last buffer.
+ * The voices are read STATE_CHUNK at a time, so a long read may span two buffers.
+ * @param voices Receives the levels of the first count voices. Can be NULL.
+ * @param count Number of voices to read.
+ * @param output Receives the levels of the mixed output. Can be NULL.
+ * @return The number of voices copied to voices.
+ */
+u8 GRRMOD_MOD_GetMeters(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output) {
+    MMETER m[STATE_CHUNK], o;
+    u32 n = 0, got, i;
+
+    while(voices != NULL && n < count) {
+        got = VC_GetMeters(m, n, (count - n < STATE_CHUNK) ? count - n : STATE_CHUNK, NULL);
+        for(i = 0; i < got; i++, n++) {
+            voices[n].peak_l = m[i].peakl;
+            voices[n].peak_r = m[i].peakr;
+            voices[n].rms_l = m[i].rmsl;
+            voices[n].rms_r = m[i].rmsr;
+        }
+        if(got < STATE_CHUNK) {
+            break;
+        }
+    }
+    if(output != NULL) {
+        VC_GetMeters(NULL, 0, 0, &o);
+        output->peak_l = o.peakl;
+        output->peak_r = o.peakr;
+        output->rms_l = o.rmsl;
+        output->rms_r = o.rmsr;
+    }
+    return n;
+}
+
 /**
  * Set a buffer to update. This routine should be called on a regular basis to update the sound.
  * @param buffer The buffer to update.
  */
 void GRRMOD_MOD_Update(u8 *buffer) {
-    if(module != NULL) {
+    if(module != NULL || MikMod_Active()) {
         pBuffer = buffer; // Point to the new sound buffer
         MikMod_Update();
     }
@@ -24,9 +24,11 @@ THE SOFTWARE.
 #include "mpg123.h"
 #include <string.h>
 
-#define MP3_READ_SIZE 1024
+#define DECODE_STACKSIZE (16384) /**< Stack size of the decoder thread. */
+#define DECODE_PRIORITY  (72)    /**< Priority of the decoder thread, below the mixing thread. */
+#define DECODE_CHUNK     (4608)  /**< Bytes decoded at a time, the output of a stereo MPEG-1 frame. */
+#define INDEX_SLICE      (32)    /**< Frames indexed by the decoder thread each time it decodes. */
 
-static u64     Offset;     /**< Current file position. */
 static char    *BufferPtr; /**< Pointer to the music data. */
 static u64     Size;       /**< Size of the music data. */
 static bool    IsStereo;   /**< Set to true is the music is stereo. */
@@ -37,11 +39,29 @@ typedef struct _GRRMOD_DATA {
 } GRRMOD_DATA;
 
 static mpg123_handle *mh;
+static mpg123_handle *scan;         /**< Second handle reading the frames without decoding them, to build the seek index. */
+static bool Indexed;                /**< Set when the scan reached the end of the data. */
+static s32 SeekTarget = -1;         /**< Sample to seek to, -1 if none, updated atomically. */
 static GRRMOD_DATA MusicData = {};
 
 static long frequency;
 static int channels;
 static off_t samples;
+static u32 FrameSamples;            /**< Samples decoded from a frame. */
+
+// Decode-ahead ring, filled by the decoder thread and emptied by GRRMOD_MP3_Update
+static u16 AheadTime = 250;         /**< Time decoded ahead of playback in milliseconds, 0 to decode in GRRMOD_MP3_Update. */
+static u8 *Ring = NULL;             /**< Decoded samples, NULL when the decoder thread is not running. */
+static u32 RingSize;                /**< Size of the ring in bytes. */
+static u32 RingRead;                /**< Next byte played, moved by GRRMOD_MP3_Update, reset by a seek. */
+static u32 RingWrite;               /**< Next byte decoded, only used by the decoder thread. */
+static u32 RingFill;                /**< Bytes decoded and not played yet, updated atomically. */
+static u32 Underruns;               /**< Buffers played before enough samples were decoded. */
+static volatile bool Decoding = false;
+static mutex_t RingMutex;
+static cond_t RingCond;
+static lwp_t hdecoder;
+static u8 decoder_stack[DECODE_STACKSIZE] ATTRIBUTE_ALIGN(8);
 
 /**
  * Register MP3 function list.
@@ -53,9 +73,28 @@ void GRRMOD_MP3_Register(GRRMOD_FuntionsList *RegFunc) {
     RegFunc->SetMOD = GRRMOD_MP3_SetMOD;
     RegFunc->Unload = GRRMOD_MP3_Unload;
     RegFunc->SetFrequency = GRRMOD_MP3_SetFrequency;
+    RegFunc->SetOversampling = GRRMOD_MP3_SetOversampling;
+    RegFunc->SetMaxVoices = GRRMOD_MP3_SetMaxVoices;
+    RegFunc->SetCompression = GRRMOD_MP3_SetCompression;
+    RegFunc->SetStreaming = GRRMOD_MP3_SetStreaming;
+    RegFunc->SetCacheSize = GRRMOD_MP3_SetCacheSize;
+    RegFunc->GetVoiceCount = GRRMOD_MP3_GetVoiceCount;
+    RegFunc->GetSampleMemory = GRRMOD_MP3_GetSampleMemory;
+    RegFunc->GetStreamStats = GRRMOD_MP3_GetStreamStats;
+    RegFunc->SetDecodeAhead = GRRMOD_MP3_SetDecodeAhead;
+    RegFunc->GetDecodeStats = GRRMOD_MP3_GetDecodeStats;
+    RegFunc->SeekTime = GRRMOD_MP3_SeekTime;
+    RegFunc->SetReverb = GRRMOD_MP3_SetReverb;
     RegFunc->GetVoiceFrequency = GRRMOD_MP3_GetVoiceFrequency;
     RegFunc->GetVoiceVolume = GRRMOD_MP3_GetVoiceVolume;
     RegFunc->GetRealVoiceVolume = GRRMOD_MP3_GetRealVoiceVolume;
+    RegFunc->GetVoices = GRRMOD_MP3_GetVoices;
+    RegFunc->GetMeters = GRRMOD_MP3_GetMeters;
+    RegFunc->SFX_Load = GRRMOD_MP3_SFX_Load;
+    RegFunc->SFX_Free = GRRMOD_MP3_SFX_Free;
+    RegFunc->SFX_Play = GRRMOD_MP3_SFX_Play;
+    RegFunc->SFX_Stop = GRRMOD_MP3_SFX_Stop;
+    RegFunc->SFX_SetVolume = GRRMOD_MP3_SFX_SetVolume;
     RegFunc->Start = GRRMOD_MP3_Start;
     RegFunc->Stop = GRRMOD_MP3_Stop;
     RegFunc->Pause = GRRMOD_MP3_Pause;
@@ -88,22 +127,204 @@ void GRRMOD_MP3_End(void) {
     mpg123_exit();
 }
 
+/**
+ * Read a 28-bit syncsafe integer, as used by ID3v2 sizes.
+ * @param p Pointer to the four bytes to read.
+ * @return The integer read.
+ */
+static u32 ReadSyncsafe(const u8 *p) {
+    return ((p[0] & 0x7F) << 21) | ((p[1] & 0x7F) << 14) | ((p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+/**
+ * Convert an ID3 text to UTF-8.
+ * @param enc Encoding of the text: 0 for ISO-8859-1, 1 for UTF-16 with BOM, 2 for UTF-16BE, 3 for UTF-8.
+ * @param text The text to convert.
+ * @param len Length of the text in bytes.
+ * @return A newly allocated UTF-8 string, NULL if empty.
+ */
+static char *ID3Text(u8 enc, const u8 *text, u32 len) {
+    char *out = malloc(len * 2 + 1), *p = out; // Worst case is ISO-8859-1, two bytes for one above 0x7F
+    bool little = false;
+    u32 i;
+
+    if(out == NULL) {
+        return NULL;
+    }
+    if(enc == 1 || enc == 2) {
+        if(enc == 1 && len >= 2) {
+            little = text[0] == 0xFF && text[1] == 0xFE;
+            if(little || (text[0] == 0xFE && text[1] == 0xFF)) {
+                text += 2;
+                len -= 2;
+            }
+        }
+        for(i = 0; i + 1 < len; i += 2) {
+            u16 c = little ? text[i] | (text[i+1] << 8) : (text[i] << 8) | text[i+1];
+            if(c == 0) {
+                break;
+            }
+            if(c >= 0xD800 && c < 0xE000) { // Surrogates are outside of the BMP, not worth decoding
+                c = '?';
+            }
+            if(c < 0x80) {
+                *p++ = c;
+            }
+            else if(c < 0x800) {
+                *p++ = 0xC0 | (c >> 6);
+                *p++ = 0x80 | (c & 0x3F);
+            }
+            else {
+                *p++ = 0xE0 | (c >> 12);
+                *p++ = 0x80 | ((c >> 6) & 0x3F);
+                *p++ = 0x80 | (c & 0x3F);
+            }
+        }
+    }
+    else {
+        for(i = 0; i < len && text[i] != 0; i++) {
+            if(enc == 0 && text[i] >= 0x80) {
+                *p++ = 0xC0 | (text[i] >> 6);
+                *p++ = 0x80 | (text[i] & 0x3F);
+            }
+            else {
+                *p++ = text[i];
+            }
+        }
+    }
+    while(p > out && p[-1] == ' ') { // ID3v1 pads with spaces
+        p--;
+    }
+    *p = 0;
+    if(p == out) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * Skip the ID3v2 tag at the start of the data, reading the title on the way.
+ * @param data The MP3 data.
+ * @param size Size of the data.
+ * @param title Receives a newly allocated title, left untouched if there is none.
+ * @return The size of the tag, 0 if there is none.
+ */
+static u64 ReadID3v2(const u8 *data, u64 size, char **title) {
+    u32 version, length, pos, end, namelen, headlen;
+
+    if(size < 10 || memcmp(data, "ID3", 3) != 0 || data[3] < 2 || data[3] > 4) {
+        return 0;
+    }
+    version = data[3];
+    length = 10 + ReadSyncsafe(data + 6) + ((data[5] & 0x10) ? 10 : 0); // Footer
+    if(length > size) {
+        return 0;
+    }
+    if(data[5] & 0x80 && version < 4) { // Unsynchronised frames would need decoding, the title is optional
+        return length;
+    }
+    namelen = version == 2 ? 3 : 4;
+    headlen = version == 2 ? 6 : 10;
+    pos = 10;
+    end = 10 + ReadSyncsafe(data + 6);
+    if(data[5] & 0x40 && version > 2) { // Extended header
+        u64 extlen;
+        if(end - pos < 4) {
+            return length;
+        }
+        extlen = version == 4 ? ReadSyncsafe(data + 10) : 4 + (u64)(((u32)data[10] << 24) | (data[11] << 16) | (data[12] << 8) | data[13]);
+        if(extlen >= end - pos) {
+            return length;
+        }
+        pos += extlen;
+    }
+    while(pos + headlen <= end && data[pos] != 0) {
+        const u8 *frame = data + pos;
+        u32 framelen;
+
+        if(version == 2) {
+            framelen = (frame[3] << 16) | (frame[4] << 8) | frame[5];
+        }
+        else if(version == 3) {
+            framelen = (frame[4] << 24) | (frame[5] << 16) | (frame[6] << 8) | frame[7];
+        }
+        else {
+            framelen = ReadSyncsafe(frame + 4);
+        }
+        if(framelen > end - pos - headlen) {
+            break;
+        }
+        if(framelen > 1 && memcmp(frame, version == 2 ? "TT2" : "TIT2", namelen) == 0 &&
+           (version == 2 || (frame[9] & (version == 3 ? 0xC0 : 0x0F)) == 0)) { // No compression, encryption or unsynchronisation
+            *title = ID3Text(frame[headlen], frame + headlen + 1, framelen - 1);
+            break;
+        }
+        pos += headlen + framelen;
+    }
+    return length;
+}
+
+/**
+ * Read the title of the ID3v1 tag at the end of the data.
+ * @param data The MP3 data.
+ * @param size Size of the data.
+ * @return A newly allocated title, NULL if there is none.
+ */
+static char *ReadID3v1(const u8 *data, u64 size) {
+    if(size < 128 || memcmp(data + size - 128, "TAG", 3) != 0) {
+        return NULL;
+    }
+    return ID3Text(0, data + size - 125, 30);
+}
+
+/**
+ * Read the number of frames of the VBRI header, written by the Fraunhofer encoder.
+ * It sits 32 bytes after the header of the first frame, libmpg123 only reads the Xing/Info one.
+ * @param data The MP3 data, starting at the first frame.
+ * @param size Size of the data.
+ * @return The number of frames, 0 if there is no VBRI header.
+ */
+static u32 ReadVBRI(const u8 *data, u64 size) {
+    u64 i;
+
+    for(i = 0; i + 36 + 18 <= size && i < 4096; i++) {
+        if(data[i] == 0xFF && (data[i+1] & 0xE0) == 0xE0) {
+            const u8 *vbri = data + i + 36;
+            if(memcmp(vbri, "VBRI", 4) != 0) {
+                return 0;
+            }
+            return (vbri[14] << 24) | (vbri[15] << 16) | (vbri[16] << 8) | vbri[17];
+        }
+    }
+    return 0;
+}
+
 /**
  * Load a MP3 file from memory.
+ * Only the tags and the first frames are read, the length comes from the
+ * Xing/Info or VBRI header, or is estimated from the bitrate for CBR files.
  * @param mem Memory to set.
  * @param size Size of the memory to set.
  */
 void GRRMOD_MP3_SetMOD(const void *mem, u64 size) {
     int result;
     int encoding; // Unneeded value encoding
-    size_t fakegot;
     size_t num_rates;
+    u64 start, audio;
+    u32 vbri;
 
     // Set global value
-    Offset = 0;
     BufferPtr = (char *)mem;
     Size = size;
 
+    // Read the tags straight from the buffer, the ID3v2 one is never seen by the decoder
+    start = ReadID3v2((const u8 *)BufferPtr, Size, &MusicData.SongTitle);
+    audio = Size - start;
+    if(MusicData.SongTitle == NULL) {
+        MusicData.SongTitle = ReadID3v1((const u8 *)BufferPtr, Size);
+    }
+
     // Get bitrates
     mpg123_rates(NULL, &num_rates);
 
@@ -113,8 +334,8 @@ void GRRMOD_MP3_SetMOD(const void *mem, u64 size) {
         return;
     }
 
-    // Streaming mode
-    if(mpg123_open_feed(mh) != MPG123_OK) {
+    // Decode straight from memory, the reader is seekable
+    if(mpg123_open_mem(mh, BufferPtr + start, audio) != MPG123_OK) {
         return;
     }
 
@@ -129,48 +350,47 @@ void GRRMOD_MP3_SetMOD(const void *mem, u64 size) {
         mpg123_format(mh, frequency, channelcount, MPG123_ENC_SIGNED_16);
     }
 
-    result = mpg123_decode(mh, (u8 *)BufferPtr, Size, NULL, 0, &fakegot);
-    if(result != MPG123_NEW_FORMAT) {
+    // Grab frequency to play back as well as number of channels, this parses the first frame
+    if(mpg123_getformat(mh, &frequency, &channels, &encoding) != MPG123_OK) {
         // Failed to get data
-        mpg123_close(mh);
+        mpg123_delete(mh);
         mh = NULL;
 
         // Exit out of here, no recovery
         return;
     }
 
-    // Grab frequency to play back as well as number of channels
-    result = mpg123_getformat(mh, &frequency, &channels, &encoding);
-
-    // Set file length
-    mpg123_set_filesize(mh, size);
-
     // Grab length
-    samples = mpg123_length(mh);
-
-    // Set title
-    mpg123_id3v1 *v1;
-    mpg123_id3v2 *v2;
-    mpg123_scan(mh);
-    if(mpg123_seek(mh, 0, SEEK_SET) >= 0 && mpg123_meta_check(mh) & MPG123_ID3 && mpg123_id3(mh, &v1, &v2) == MPG123_OK) {
-        if(v2 != NULL && v2->title != NULL && v2->title->fill > 0) {
-            MusicData.SongTitle = strdup(v2->title->p);
-        }
-        else if(v1 != NULL) {
-            MusicData.SongTitle = strdup(v1->title);
-        }
+    struct mpg123_frameinfo fi;
+    bool info = mpg123_info(mh, &fi) == MPG123_OK;
+    u32 spf = fi.layer == 1 ? 384 : (fi.layer == 3 && fi.version != MPG123_1_0) ? 576 : 1152;
+    FrameSamples = info == true ? (u64)spf * frequency / fi.rate : 1152;
+    vbri = ReadVBRI((const u8 *)BufferPtr + start, audio);
+    if(vbri > 0 && info == true) {
+        samples = (off_t)((u64)vbri * spf * frequency / fi.rate);
+    }
+    else {
+        samples = mpg123_length(mh);
     }
 
     // Set music type
     char Temp[1024];
-    struct mpg123_frameinfo fi;
-    if(mpg123_info(mh, &fi) == MPG123_OK) {
+    if(info == true) {
         sprintf(Temp, "MP%d: %li Hz, %i channels, encoding value %i", fi.layer, frequency, channels, encoding);
     }
     else {
         sprintf(Temp, "MPEG: %li Hz, %i channels, encoding value %i", frequency, channels, encoding);
     }
     MusicData.ModType = strdup(Temp);
+
+    // The seek index is built as the song plays, or when a seek needs it
+    scan = mpg123_new(NULL, &result);
+    if(scan != NULL && mpg123_open_mem(scan, BufferPtr + start, audio) != MPG123_OK) {
+        mpg123_delete(scan);
+        scan = NULL;
+    }
+    Indexed = scan == NULL;
+    SeekTarget = -1;
 }
 
 /**
@@ -181,6 +401,10 @@ void GRRMOD_MP3_Unload(void) {
         mpg123_delete(mh);
         mh = NULL;
     }
+    if(scan != NULL) {
+        mpg123_delete(scan);
+        scan = NULL;
+    }
     if(MusicData.ModType != NULL) {
         free(MusicData.ModType);
         MusicData.ModType = NULL;
@@ -191,20 +415,207 @@ void GRRMOD_MP3_Unload(void) {
     }
 }
 
+/**
+ * Decode samples, starting the song over when it ends.
+ * @param out Receives the samples.
+ * @param size Number of bytes to decode.
+ * @return The number of bytes decoded, less than size only on a decoding error.
+ */
+static u32 Decode(u8 *out, u32 size) {
+    u32 have_read = 0;
+    bool rewound = false;
+
+    while(have_read < size) {
+        size_t have_now = 0;
+        int result = mpg123_read(mh, out + have_read, size - have_read, &have_now);
+
+        have_read += have_now;
+        if(have_now > 0) {
+            rewound = false;
+        }
+        if(result == MPG123_DONE && rewound == false) {
+            // End of file, carry on from the start
+            mpg123_seek(mh, 0, SEEK_SET);
+            rewound = true;
+        }
+        else if(result != MPG123_OK && result != MPG123_NEW_FORMAT) {
+            break;
+        }
+    }
+    return have_read;
+}
+
+/**
+ * Read frames of the scan handle without decoding them, which adds them to its index.
+ * @param count Maximum number of frames to read.
+ */
+static void IndexFrames(u32 count) {
+    while(scan != NULL && Indexed == false && count-- > 0) {
+        int result = mpg123_framebyframe_next(scan);
+        if(result != MPG123_OK && result != MPG123_NEW_FORMAT) {
+            Indexed = true;
+        }
+    }
+}
+
+/**
+ * Move the decoder to a sample.
+ * The frames up to the target are indexed first, so mpg123 jumps straight to
+ * the nearest one and only decodes the few frames needed to get in sync.
+ * @param target Sample to play next.
+ */
+static void Seek(s32 target) {
+    off_t frame = target / FrameSamples + 1;
+    off_t *offsets, step;
+    size_t fill;
+
+    while(Indexed == false && mpg123_tellframe(scan) <= frame) {
+        IndexFrames(INDEX_SLICE);
+    }
+    if(scan != NULL && mpg123_index(scan, &offsets, &step, &fill) == MPG123_OK && fill > 0) {
+        mpg123_set_index(mh, offsets, step, fill);
+    }
+    mpg123_seek(mh, target, SEEK_SET);
+}
+
+/**
+ * Do the seek asked by GRRMOD_MP3_SeekTime, if any.
+ */
+static void ApplySeek(void) {
+    s32 target = __atomic_exchange_n(&SeekTarget, -1, __ATOMIC_ACQ_REL);
+    if(target >= 0) {
+        Seek(target);
+    }
+}
+
+/**
+ * Keep the ring filled ahead of playback. This routine is called inside a thread.
+ * @param arg Not used.
+ * @return Always returns NULL.
+ */
+static void *decoder(void *arg) {
+    while(true) {
+        u32 space, got;
+        s32 target;
+        bool running;
+
+        LWP_MutexLock(RingMutex);
+        while(Decoding == true && __atomic_load_n(&SeekTarget, __ATOMIC_ACQUIRE) < 0 &&
+              RingSize - __atomic_load_n(&RingFill, __ATOMIC_ACQUIRE) < DECODE_CHUNK) {
+            LWP_CondWait(RingCond, RingMutex);
+        }
+        running = Decoding;
+        target = __atomic_exchange_n(&SeekTarget, -1, __ATOMIC_ACQ_REL);
+        if(target >= 0) {
+            // What was decoded before the seek is never played
+            RingRead = RingWrite = 0;
+            __atomic_store_n(&RingFill, 0, __ATOMIC_RELEASE);
+        }
+        LWP_MutexUnlock(RingMutex);
+        if(running == false) {
+            break;
+        }
+        if(target >= 0) {
+            Seek(target);
+        }
+
+        // Decode a chunk at a time and hand it over right away, so that
+        // playback does not wait for the whole ring after a start or a seek
+        space = RingSize - __atomic_load_n(&RingFill, __ATOMIC_ACQUIRE);
+        if(space > RingSize - RingWrite) {
+            space = RingSize - RingWrite;
+        }
+        if(space > DECODE_CHUNK) {
+            space = DECODE_CHUNK;
+        }
+        got = Decode(Ring + RingWrite, space);
+        RingWrite += got;
+        if(RingWrite == RingSize) {
+            RingWrite = 0;
+        }
+        __atomic_add_fetch(&RingFill, got, __ATOMIC_RELEASE);
+
+        if(got < space) {
+            // Broken stream, wait to be stopped or moved elsewhere
+            LWP_MutexLock(RingMutex);
+            while(Decoding == true && __atomic_load_n(&SeekTarget, __ATOMIC_ACQUIRE) < 0) {
+                LWP_CondWait(RingCond, RingMutex);
+            }
+            LWP_MutexUnlock(RingMutex);
+            continue;
+        }
+
+        // Index a little more of the song once playback has a buffer ready, so that seeking stays cheap
+        if(__atomic_load_n(&RingFill, __ATOMIC_ACQUIRE) >= SNDBUFFERSIZE) {
+            IndexFrames(INDEX_SLICE);
+        }
+    }
+    return NULL;
+}
+
 /**
  * This function starts the specified module playback.
+ * Unless disabled with GRRMOD_MP3_SetDecodeAhead, a thread then decodes ahead of playback.
  */
 void GRRMOD_MP3_Start(void) {
-    if(mh == NULL) {
+    if(mh == NULL || Ring != NULL || AheadTime == 0) {
+        return;
+    }
+
+    // Whole sample frames, and enough for a buffer and a frame being decoded
+    RingSize = (u32)AheadTime * frequency / 1000 * channels * 2;
+    RingSize &= ~3;
+    if(RingSize < SNDBUFFERSIZE + DECODE_CHUNK) {
+        RingSize = SNDBUFFERSIZE + DECODE_CHUNK;
+    }
+    Ring = malloc(RingSize);
+    if(Ring == NULL) {
+        return;
+    }
+
+    RingRead = RingWrite = RingFill = 0;
+    Underruns = 0;
+    ApplySeek();
+
+    LWP_MutexInit(&RingMutex, false);
+    LWP_CondInit(&RingCond);
+    Decoding = true;
+    LWP_MutexLock(RingMutex);
+    if(LWP_CreateThread(&hdecoder, decoder, NULL, decoder_stack, DECODE_STACKSIZE, DECODE_PRIORITY) == -1) {
+        // Decode in GRRMOD_MP3_Update instead
+        Decoding = false;
+        LWP_MutexUnlock(RingMutex);
+        LWP_CondDestroy(RingCond);
+        LWP_MutexDestroy(RingMutex);
+        free(Ring);
+        Ring = NULL;
         return;
     }
+
+    // The first buffer is decoded now so that playback starts right away, the thread waits for it
+    RingFill = RingWrite = Decode(Ring, (SNDBUFFERSIZE / 4) * channels * 2);
+    LWP_MutexUnlock(RingMutex);
 }
 
 /**
  * This function stops the currently playing module.
  */
 void GRRMOD_MP3_Stop(void) {
-    Offset = 0;
+    if(Ring != NULL) {
+        LWP_MutexLock(RingMutex);
+        Decoding = false;
+        LWP_CondSignal(RingCond);
+        LWP_MutexUnlock(RingMutex);
+        LWP_JoinThread(hdecoder, NULL);
+        LWP_CondDestroy(RingCond);
+        LWP_MutexDestroy(RingMutex);
+        free(Ring);
+        Ring = NULL;
+    }
+    SeekTarget = -1;
+    if(mh != NULL) {
+        mpg123_seek(mh, 0, SEEK_SET);
+    }
 }
 
 /**
@@ -238,6 +649,121 @@ void GRRMOD_MP3_SetFrequency(u32 freq) {
     frequency = freq;
 }
 
+/**
+ * Set the oversampling factor. Not used for MP3.
+ * @param factor Oversampling factor: 1, 2 or 4.
+ */
+void GRRMOD_MP3_SetOversampling(u8 factor) {
+}
+
+/**
+ * Set the maximum number of voices really mixed. Not used for MP3.
+ * @param count Maximum number of voices, 0 for no limit.
+ */
+void GRRMOD_MP3_SetMaxVoices(u8 count) {
+}
+
+/**
+ * Set the shortest sample kept compressed. Not used for MP3.
+ * @param length Shortest sample compressed, in frames, 0 to compress none.
+ */
+void GRRMOD_MP3_SetCompression(u32 length) {
+}
+
+/**
+ * Set the memory kept by the modules set before. Not used for MP3.
+ * @param bytes Size of the cache in bytes, 0 to free the modules once they are unloaded.
+ */
+void GRRMOD_MP3_SetCacheSize(u32 bytes) {
+}
+
+/**
+ * Set the shortest sample streamed. Not used for MP3.
+ * @param length Shortest part played before the loop, in frames, 0 to stream none.
+ */
+void GRRMOD_MP3_SetStreaming(u32 length) {
+}
+
+/**
+ * Get the number of voices mixed and followed. There are none for MP3.
+ * @param real Receives the number of voices really mixed.
+ * @param virt Receives the number of voices only followed.
+ */
+void GRRMOD_MP3_GetVoiceCount(u8 *real, u8 *virt) {
+    *real = 0;
+    *virt = 0;
+}
+
+/**
+ * Get the memory taken by samples. There are none for MP3.
+ * @param used Receives the number of bytes allocated for samples.
+ * @param saved Receives the number of bytes saved by sharing identical samples.
+ */
+void GRRMOD_MP3_GetSampleMemory(u32 *used, u32 *saved) {
+    *used = 0;
+    *saved = 0;
+}
+
+/**
+ * Get the activity of the streamed samples. There are none for MP3.
+ * @param reads Receives the number of windows read.
+ * @param misses Receives the number of times a window was needed before it was read.
+ */
+void GRRMOD_MP3_GetStreamStats(u32 *reads, u32 *misses) {
+    *reads = 0;
+    *misses = 0;
+}
+
+/**
+ * Set how far ahead of playback a thread decodes, from the next GRRMOD_MP3_Start.
+ * @param ms Time decoded ahead in milliseconds, 0 to decode when the buffers are updated.
+ */
+void GRRMOD_MP3_SetDecodeAhead(u16 ms) {
+    AheadTime = ms;
+}
+
+/**
+ * Get the state of the decoder thread.
+ * @param fill Receives the time decoded ahead of playback in milliseconds.
+ * @param underruns Receives the number of buffers played before enough samples were decoded.
+ */
+void GRRMOD_MP3_GetDecodeStats(u32 *fill, u32 *underruns) {
+    *fill = Ring != NULL ? (u64)__atomic_load_n(&RingFill, __ATOMIC_ACQUIRE) * 1000 / (frequency * channels * 2) : 0;
+    *underruns = Underruns;
+}
+
+/**
+ * Move playback to a time of the song.
+ * The seek is done by the decoder, before the next samples it hands over.
+ * @param ms Time to play from in milliseconds.
+ * @return A number representating a code:
+ *         -     0 : The seek was scheduled.
+ *         -    -1 : No song is loaded or the time is past its end.
+ */
+s8 GRRMOD_MP3_SeekTime(u32 ms) {
+    u64 target = (u64)ms * frequency / 1000;
+
+    if(mh == NULL || (samples > 0 && target >= (u64)samples) || target > 0x7FFFFFFF) {
+        return -1;
+    }
+    __atomic_store_n(&SeekTarget, (s32)target, __ATOMIC_RELEASE);
+    if(Ring != NULL) {
+        LWP_MutexLock(RingMutex);
+        LWP_CondSignal(RingCond);
+        LWP_MutexUnlock(RingMutex);
+    }
+    return 0;
+}
+
+/**
+ * Set the reverb of the software mixer. Not used for MP3.
+ * @param time Reverb time in milliseconds, 0 to disable.
+ * @param damping High frequency damping, 0 (bright) to 255 (dull).
+ * @param wet Reverb level, 0 to 128.
+ */
+void GRRMOD_MP3_SetReverb(u16 time, u8 damping, u8 wet) {
+}
+
 /**
  * This function returns the frequency of the sample currently playing on the specified voice.
  * @param voice The number of the voice to get frequency.
@@ -266,71 +792,110 @@ u32 GRRMOD_MP3_GetRealVoiceVolume(u8 voice) {
 }
 
 /**
- * Set a buffer to update. This routine should be called on a regular basis to update the sound.
- * @param outbuf The buffer to update.
+ * Get the state of the voices. Not used for MP3.
+ * @param out Receives the state of the voices.
+ * @param n Number of voices to read.
+ * @return Always zero.
  */
-void GRRMOD_MP3_Update(u8 *outbuf) {
-    if(mh == NULL || outbuf == NULL) {
-        return;
-    }
-    // Clear data to ensure no garbage bytes
-    memset(outbuf, 0, SNDBUFFERSIZE);//memset(outbuf, 0, renderSamples * 4);
+u8 GRRMOD_MP3_GetVoices(GRRMOD_VoiceInfo *out, u8 n) {
+    return 0;
+}
 
-    // Start with assumption that we have enough data
-    int result = MPG123_OK;
+/**
+ * Load a sound effect. Not used for MP3.
+ * @param mem Memory holding the WAV file.
+ * @param size Size of the WAV file.
+ * @return Always NULL.
+ */
+GRRMOD_SFX *GRRMOD_MP3_SFX_Load(const void *mem, u32 size) {
+    return NULL;
+}
 
-    // Remember end of file
-    bool is_over = false;
+/**
+ * Free a sound effect. Not used for MP3.
+ * @param sfx The sound effect to free.
+ */
+void GRRMOD_MP3_SFX_Free(GRRMOD_SFX *sfx) {
+}
 
-    // Bookkeeping
-    int need = (SNDBUFFERSIZE / 4) * channels * 2;//int need = renderSamples * channels * 2;
-    int have_read = 0;
+/**
+ * Play a sound effect. Not used for MP3.
+ * @param sfx The sound effect to play.
+ * @param priority Priority of the effect.
+ * @return Always -1.
+ */
+s8 GRRMOD_MP3_SFX_Play(GRRMOD_SFX *sfx, u8 priority) {
+    return -1;
+}
 
-    // Loop, grabbing enough data to get samples
-    do {
-        // Bookkeeping
-        int dataIn = 0;
-        size_t have_now = 0;
+/**
+ * Stop a sound effect. Not used for MP3.
+ * @param voice The effect voice.
+ */
+void GRRMOD_MP3_SFX_Stop(s8 voice) {
+}
 
-        // Figure out if we need more data
-        if(result == MPG123_NEED_MORE) {
-            if(is_over == true) {
-                // Ensure we don't create garbage audio
-                memset(outbuf + have_read, 0, need);
-                Offset = 0;
-                // More data next time
-                return;
-                //break;
-            }
+/**
+ * Set the volume of all sound effects. Not used for MP3.
+ * @param volume The sound effect volume.
+ */
+void GRRMOD_MP3_SFX_SetVolume(u8 volume) {
+}
 
-            // Read in
-            if(Offset + MP3_READ_SIZE > Size) {
-                dataIn = Size - Offset;
-                //is_over = true;
-            }
-            else {
-                dataIn = MP3_READ_SIZE;
-            }
+/**
+ * Get the levels measured during the last buffer. Not used for MP3.
+ * @param voices Receives the levels of the voices. Can be NULL.
+ * @param count Number of voices to read.
+ * @param output Receives the levels of the output, set to zero. Can be NULL.
+ * @return Always zero.
+ */
+u8 GRRMOD_MP3_GetMeters(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output) {
+    if(output != NULL) {
+        memset(output, 0, sizeof(GRRMOD_Meter));
+    }
+    return 0;
+}
 
-            if(dataIn < MP3_READ_SIZE) {
-                // End of file :<
-                is_over = true;
-            }
+/**
+ * Set a buffer to update. This routine should be called on a regular basis to update the sound.
+ * @param outbuf The buffer to update.
+ */
+void GRRMOD_MP3_Update(u8 *outbuf) {
+    if(mh == NULL || outbuf == NULL) {
+        return;
+    }
+    // Bookkeeping
+    u32 need = (SNDBUFFERSIZE / 4) * channels * 2;//int need = renderSamples * channels * 2;
+    u32 have_read;
+
+    if(Ring != NULL) {
+        // Hand over what the decoder thread has ready, under the lock as a seek empties the ring
+        u32 fill, first;
+
+        LWP_MutexLock(RingMutex);
+        fill = __atomic_load_n(&RingFill, __ATOMIC_ACQUIRE);
+        have_read = fill < need ? fill : need;
+        first = RingSize - RingRead < have_read ? RingSize - RingRead : have_read;
+        memcpy(outbuf, Ring + RingRead, first);
+        memcpy(outbuf + first, Ring, have_read - first);
+        RingRead += have_read;
+        if(RingRead >= RingSize) {
+            RingRead -= RingSize;
         }
-
-        // Grab data
-        result = mpg123_decode(mh, (u8 *)(BufferPtr + Offset), dataIn, outbuf + have_read, need, &have_now);
-
-        Offset += dataIn;
-
-        // Ensure we keep track of newly gotten data
-        need -= have_now;
-        have_read += have_now;
-
-        // If we finished, then exit with success
-        if(need == 0) {
-            // More data next time
-            return;
+        __atomic_sub_fetch(&RingFill, have_read, __ATOMIC_RELEASE);
+        if(have_read < need) {
+            Underruns++;
         }
-    } while(result == MPG123_NEED_MORE || result == MPG123_ERR);
+        LWP_CondSignal(RingCond);
+        LWP_MutexUnlock(RingMutex);
+    }
+    else {
+        ApplySeek();
+        have_read = Decode(outbuf, need);
+    }
+
+    // Ensure no garbage bytes are played
+    if(have_read < SNDBUFFERSIZE) {
+        memset(outbuf + have_read, 0, SNDBUFFERSIZE - have_read);
+    }
 }
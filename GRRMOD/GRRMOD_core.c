@@ -31,6 +31,7 @@ THE SOFTWARE.
 static bool thr_running = false; /* Status of the thread. If set to true, the thread is running. */
 static bool sndPlaying = false;
 static bool paused = false;
+static bool isstereo = false;
 
 static vu32 curr_audio = 0;
 static u8 audioBuf[2][SNDBUFFERSIZE] ATTRIBUTE_ALIGN(32);
@@ -44,6 +45,7 @@ static AESNDPB  *modvoice = NULL;
 
 #ifdef _GRRMOD_DEBUG
 static u64 mixtime = 0;
+static u64 spectrumtime = 0;
 #endif
 
 static GRRMOD_FuntionsList RegFunc;
@@ -77,6 +79,7 @@ s8 GRRMOD_Init(bool stereo) {
     }
 
     AESND_SetVoiceFormat(modvoice, stereo ? VOICE_STEREO16 : VOICE_MONO16);
+    isstereo = stereo;
     AESND_SetVoiceFrequency(modvoice, mod_freq);
     AESND_SetVoiceVolume(modvoice, 255, 255);
     AESND_SetVoiceStream(modvoice, true);
@@ -203,6 +206,175 @@ void GRRMOD_SetFrequency(u32 freq) {
     }
 }
 
+/**
+ * Set the oversampling factor used when mixing modules.
+ * Higher factors reduce aliasing at the cost of mixing time.
+ * @param factor Oversampling factor: 1, 2 or 4 (default).
+ */
+void GRRMOD_SetOversampling(u8 factor) {
+    if(factor==1 || factor==2 || factor==4) {
+        RegFunc.SetOversampling(factor);
+    }
+}
+
+/**
+ * Set the maximum number of voices really mixed. When more voices are
+ * playing, the quietest ones are only followed until they are loud enough
+ * again, which bounds the mixing time of modules with many voices.
+ * @param count Maximum number of voices, 0 (default) for no limit.
+ */
+void GRRMOD_SetMaxVoices(u8 count) {
+    RegFunc.SetMaxVoices(count);
+}
+
+/**
+ * Keep the long samples of the next modules loaded compressed in memory.
+ * Samples of at least length frames, which do not loop or have a loop of at
+ * least 1024 frames, are stored as 4 bit ADPCM and decoded while mixing.
+ * They take about a quarter of the memory of 16 bit samples, at the cost
+ * of some noise and of the decoding time.
+ * @param length Shortest sample compressed, in frames, 0 (default) to compress none.
+ */
+void GRRMOD_SetCompression(u32 length) {
+    RegFunc.SetCompression(length);
+}
+
+/**
+ * Stream the long samples of the next modules loaded instead of loading them.
+ * Samples which play at least length frames before their loop, or in total
+ * when they do not loop, are read from the module memory while they play:
+ * only their first 4096 frames and their loop stay in memory. Samples stored
+ * compressed in the module are always loaded.
+ * The memory given to GRRMOD_SetMOD must then stay valid until the module is
+ * unloaded.
+ * @param length Shortest part streamed, in frames, 0 (default) to stream none.
+ * @see GRRMOD_GetStreamStats
+ */
+void GRRMOD_SetStreaming(u32 length) {
+    RegFunc.SetStreaming(length);
+}
+
+/**
+ * Keep the modules which were set before loaded, so that setting them again
+ * is immediate. The modules are found by their memory, which must not be
+ * freed while they are kept. The least recently set modules are freed when
+ * their samples take more than bytes, or when the mixer runs out of sample
+ * handles. A module set again starts from the beginning.
+ * @param bytes Sample memory kept by the modules not playing, 0 (default) to keep none.
+ */
+void GRRMOD_SetCacheSize(u32 bytes) {
+    RegFunc.SetCacheSize(bytes);
+}
+
+/**
+ * Get the number of voices mixed and followed during the last tick.
+ * Inaudible voices and the voices above the limit set with
+ * GRRMOD_SetMaxVoices are followed but not mixed.
+ * @param real Receives the number of voices really mixed. Can be NULL.
+ * @param virt Receives the number of voices only followed. Can be NULL.
+ */
+void GRRMOD_GetVoiceCount(u8 *real, u8 *virt) {
+    u8 r, v;
+    RegFunc.GetVoiceCount(&r, &v);
+    if(real != NULL) {
+        *real = r;
+    }
+    if(virt != NULL) {
+        *virt = v;
+    }
+}
+
+/**
+ * Get the memory taken by the samples of the loaded modules and sound effects.
+ * Samples with identical data, within a module or between modules, are
+ * stored once, the memory they would otherwise take is reported as saved.
+ * @param used Receives the number of bytes allocated for samples. Can be NULL.
+ * @param saved Receives the number of bytes saved by sharing samples. Can be NULL.
+ */
+void GRRMOD_GetSampleMemory(u32 *used, u32 *saved) {
+    u32 u, s;
+    RegFunc.GetSampleMemory(&u, &s);
+    if(used != NULL) {
+        *used = u;
+    }
+    if(saved != NULL) {
+        *saved = s;
+    }
+}
+
+/**
+ * Get the activity of the streamed samples since the start.
+ * Streamed samples are read ahead of the voices playing them, in windows of
+ * 4096 frames. A voice which needs a window before it is read plays on
+ * silently, which is counted as a miss.
+ * @param reads Receives the number of windows read. Can be NULL.
+ * @param misses Receives the number of misses. Can be NULL.
+ * @see GRRMOD_SetStreaming
+ */
+void GRRMOD_GetStreamStats(u32 *reads, u32 *misses) {
+    u32 r, m;
+    RegFunc.GetStreamStats(&r, &m);
+    if(reads != NULL) {
+        *reads = r;
+    }
+    if(misses != NULL) {
+        *misses = m;
+    }
+}
+
+/**
+ * Set how far ahead of playback MP3 files are decoded, from the next
+ * GRRMOD_Start. A thread decodes into a ring of that length, so that frames
+ * which are slow to decode do not delay the buffers handed to the DSP.
+ * @param ms Time decoded ahead in milliseconds, 250 by default, 0 to decode when each buffer is needed.
+ * @see GRRMOD_GetDecodeStats
+ */
+void GRRMOD_SetDecodeAhead(u16 ms) {
+    RegFunc.SetDecodeAhead(ms);
+}
+
+/**
+ * Get the state of the MP3 decoder thread.
+ * A buffer needed before the thread decoded it is played partly silent,
+ * which is counted as an underrun.
+ * @param fill Receives the time decoded ahead of playback in milliseconds. Can be NULL.
+ * @param underruns Receives the number of underruns since GRRMOD_Start. Can be NULL.
+ * @see GRRMOD_SetDecodeAhead
+ */
+void GRRMOD_GetDecodeStats(u32 *fill, u32 *underruns) {
+    u32 f, u;
+    RegFunc.GetDecodeStats(&f, &u);
+    if(fill != NULL) {
+        *fill = f;
+    }
+    if(underruns != NULL) {
+        *underruns = u;
+    }
+}
+
+/**
+ * Move MP3 playback to a time of the song, accurate to the sample.
+ * The frame positions are indexed in the background while the song plays,
+ * so a seek only decodes a few frames before the target.
+ * @param ms Time to play from in milliseconds.
+ * @return A number representating a code:
+ *         -     0 : The seek was scheduled, it is heard from the next buffer decoded.
+ *         -    -1 : The song is a module, none is loaded, or the time is past its end.
+ */
+s8 GRRMOD_SeekTime(u32 ms) {
+    return RegFunc.SeekTime(ms);
+}
+
+/**
+ * Set the reverb added by the software mixer. The reverb is off by default.
+ * @param time Reverb time in milliseconds, 0 to disable the reverb.
+ * @param damping High frequency damping, 0 (bright) to 255 (dull).
+ * @param wet Reverb level, 0 to 128.
+ */
+void GRRMOD_SetReverb(u16 time, u8 damping, u8 wet) {
+    RegFunc.SetReverb(time, damping, wet);
+}
+
 /**
  * Set the volume levels for the music (call it after MODPlay_SetMOD()).
  * @param volume_l The music volume (left), 0 to 255.
@@ -235,12 +407,98 @@ u32 GRRMOD_GetVoiceVolume(u8 voice) {
 /**
  * This function returns the actual playing volume of the specified voice.
  * @param voice The number of the voice to analyze (starting from zero).
- * @return The real volume of the voice when the function was called, in the range 0-65535.
+ * @return The peak level of the voice during the last buffer, with its volume and panning applied, in the range 0-65535.
  */
 u32 GRRMOD_GetRealVoiceVolume(u8 voice) {
     return RegFunc.GetRealVoiceVolume(voice);
 }
 
+/**
+ * Get the state of the first voices as of the last buffer mixed.
+ * The state is published once per buffer, reading it never waits for the mixer.
+ * Prefer it to calling the per-voice functions for every voice.
+ * @param out Receives the state of the voices.
+ * @param n Number of voices to read.
+ * @return The number of voices copied to out, zero for MP3.
+ */
+u8 GRRMOD_GetVoices(GRRMOD_VoiceInfo *out, u8 n) {
+    if(out == NULL) {
+        return 0;
+    }
+    return RegFunc.GetVoices(out, n);
+}
+
+/**
+ * Load a sound effect from a WAV file in memory.
+ * The sample is converted to the format of the mixer once, here.
+ * @param mem Memory holding the WAV file, mono, 8 or 16 bits.
+ * @param size Size of the WAV file.
+ * @return The sound effect, or NULL if it could not be loaded.
+ * @see GRRMOD_SFX_Free
+ */
+GRRMOD_SFX *GRRMOD_SFX_Load(const void *mem, u32 size) {
+    return RegFunc.SFX_Load(mem, size);
+}
+
+/**
+ * Free a sound effect, stopping it first if it is still playing.
+ * @param sfx The sound effect to free.
+ */
+void GRRMOD_SFX_Free(GRRMOD_SFX *sfx) {
+    if(sfx != NULL) {
+        RegFunc.SFX_Free(sfx);
+    }
+}
+
+/**
+ * Play a sound effect. Effects are mixed in the same pass as the music,
+ * so they only play while the music is started.
+ * When all effect voices are busy, the oldest effect of the lowest priority is
+ * stopped, as long as its priority is not higher than the one of the new effect.
+ * @param sfx The sound effect to play.
+ * @param priority Priority of the effect, 0 (lowest) to 255.
+ * @return The effect voice used, or -1 if the effect could not be played.
+ */
+s8 GRRMOD_SFX_Play(GRRMOD_SFX *sfx, u8 priority) {
+    if(sfx == NULL) {
+        return -1;
+    }
+    return RegFunc.SFX_Play(sfx, priority);
+}
+
+/**
+ * Stop a sound effect.
+ * An effect voice is reused once its effect ends or is stolen, so a voice
+ * kept from an earlier GRRMOD_SFX_Play may now play a newer effect, which
+ * is then stopped. Forget the voice once the effect is known to be over.
+ * @param voice The effect voice returned by GRRMOD_SFX_Play, -1 is ignored.
+ */
+void GRRMOD_SFX_Stop(s8 voice) {
+    if(voice >= 0) {
+        RegFunc.SFX_Stop(voice);
+    }
+}
+
+/**
+ * Set the volume of all sound effects.
+ * @param volume The sound effect volume, 0 to 128.
+ */
+void GRRMOD_SFX_SetVolume(u8 volume) {
+    RegFunc.SFX_SetVolume(volume);
+}
+
+/**
+ * Get the levels measured while mixing the last buffer.
+ * The levels are a by-product of mixing, reading them is cheap and needs no lock.
+ * @param voices Receives the levels of the first count voices. Can be NULL.
+ * @param count Number of voices to read.
+ * @param output Receives the levels of the mixed output. Can be NULL.
+ * @return The number of voices copied to voices, zero for MP3.
+ */
+u8 GRRMOD_GetMeters(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output) {
+    return RegFunc.GetMeters(voices, count, output);
+}
+
 /**
  * Set a buffer to update. This routine is called inside a thread.
  * @param arg Not used.
@@ -267,6 +525,12 @@ u64 start;
                 RegFunc.Update(((u8*)audioBuf[curr_audio]));
 #ifdef _GRRMOD_DEBUG
                 mixtime = gettime() - start;
+                start = gettime();
+#endif
+                // The buffer is still in the cache, analyze it here
+                GRRMOD_Spectrum_Process((s16*)audioBuf[curr_audio], SNDBUFFERSIZE >> 1, isstereo);
+#ifdef _GRRMOD_DEBUG
+                spectrumtime = gettime() - start;
 #endif
             }
         }
@@ -298,4 +562,8 @@ static void __aesndvoicecallback(AESNDPB *pb, u32 state) {
 u32 GRRMOD_MixingTime(void) {
     return ticks_to_microsecs(mixtime);
 }
+
+u32 GRRMOD_SpectrumTime(void) {
+    return ticks_to_microsecs(spectrumtime);
+}
 #endif
@@ -29,11 +29,13 @@ THE SOFTWARE.
 #define __GRRMOD_INTERNALS_H__
 
 #define SNDBUFFERSIZE   (5760)    /**< Audio maximum buffer size. */
+#define SFXVOICES       (8)       /**< Number of voices kept for sound effects. */
 
 //==============================================================================
 // Includes
 //==============================================================================
 #include <gccore.h>
+#include "grrmod.h"
 //==============================================================================
 
 //==============================================================================
@@ -52,9 +54,28 @@ typedef struct GRRMOD_FuntionsList {
     void (*SetMOD)(const void *mem, u64 size);
     void (*Unload)(void);
     void (*SetFrequency)(u32 freq);
+    void (*SetOversampling)(u8 factor);
+    void (*SetMaxVoices)(u8 count);
+    void (*SetCompression)(u32 length);
+    void (*SetStreaming)(u32 length);
+    void (*SetCacheSize)(u32 bytes);
+    void (*GetVoiceCount)(u8 *real, u8 *virt);
+    void (*GetSampleMemory)(u32 *used, u32 *saved);
+    void (*GetStreamStats)(u32 *reads, u32 *misses);
+    void (*SetDecodeAhead)(u16 ms);
+    void (*GetDecodeStats)(u32 *fill, u32 *underruns);
+    s8 (*SeekTime)(u32 ms);
+    void (*SetReverb)(u16 time, u8 damping, u8 wet);
     u32 (*GetVoiceFrequency)(u8 voice);
     u32 (*GetVoiceVolume)(u8 voice);
     u32 (*GetRealVoiceVolume)(u8 voice);
+    u8 (*GetVoices)(GRRMOD_VoiceInfo *out, u8 n);
+    u8 (*GetMeters)(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output);
+    GRRMOD_SFX *(*SFX_Load)(const void *mem, u32 size);
+    void (*SFX_Free)(GRRMOD_SFX *sfx);
+    s8 (*SFX_Play)(GRRMOD_SFX *sfx, u8 priority);
+    void (*SFX_Stop)(s8 voice);
+    void (*SFX_SetVolume)(u8 volume);
     void (*Start)(void);
     void (*Stop)(void);
     void (*Pause)(void);
@@ -70,9 +91,28 @@ void GRRMOD_MOD_End(void);
 void GRRMOD_MOD_SetMOD(const void *mem, u64 size);
 void GRRMOD_MOD_Unload(void);
 void GRRMOD_MOD_SetFrequency(u32 freq);
+void GRRMOD_MOD_SetOversampling(u8 factor);
+void GRRMOD_MOD_SetMaxVoices(u8 count);
+void GRRMOD_MOD_SetCompression(u32 length);
+void GRRMOD_MOD_SetStreaming(u32 length);
+void GRRMOD_MOD_SetCacheSize(u32 bytes);
+void GRRMOD_MOD_GetVoiceCount(u8 *real, u8 *virt);
+void GRRMOD_MOD_GetSampleMemory(u32 *used, u32 *saved);
+void GRRMOD_MOD_GetStreamStats(u32 *reads, u32 *misses);
+void GRRMOD_MOD_SetDecodeAhead(u16 ms);
+void GRRMOD_MOD_GetDecodeStats(u32 *fill, u32 *underruns);
+s8 GRRMOD_MOD_SeekTime(u32 ms);
+void GRRMOD_MOD_SetReverb(u16 time, u8 damping, u8 wet);
 u32 GRRMOD_MOD_GetVoiceFrequency(u8 voice);
 u32 GRRMOD_MOD_GetVoiceVolume(u8 voice);
 u32 GRRMOD_MOD_GetRealVoiceVolume(u8 voice);
+u8 GRRMOD_MOD_GetVoices(GRRMOD_VoiceInfo *out, u8 n);
+u8 GRRMOD_MOD_GetMeters(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output);
+GRRMOD_SFX *GRRMOD_MOD_SFX_Load(const void *mem, u32 size);
+void GRRMOD_MOD_SFX_Free(GRRMOD_SFX *sfx);
+s8 GRRMOD_MOD_SFX_Play(GRRMOD_SFX *sfx, u8 priority);
+void GRRMOD_MOD_SFX_Stop(s8 voice);
+void GRRMOD_MOD_SFX_SetVolume(u8 volume);
 void GRRMOD_MOD_Start(void);
 void GRRMOD_MOD_Stop(void);
 void GRRMOD_MOD_Pause(void);
@@ -87,9 +127,28 @@ void GRRMOD_MP3_End(void);
 void GRRMOD_MP3_SetMOD(const void *mem, u64 size);
 void GRRMOD_MP3_Unload(void);
 void GRRMOD_MP3_SetFrequency(u32 freq);
+void GRRMOD_MP3_SetOversampling(u8 factor);
+void GRRMOD_MP3_SetMaxVoices(u8 count);
+void GRRMOD_MP3_SetCompression(u32 length);
+void GRRMOD_MP3_SetStreaming(u32 length);
+void GRRMOD_MP3_SetCacheSize(u32 bytes);
+void GRRMOD_MP3_GetVoiceCount(u8 *real, u8 *virt);
+void GRRMOD_MP3_GetSampleMemory(u32 *used, u32 *saved);
+void GRRMOD_MP3_GetStreamStats(u32 *reads, u32 *misses);
+void GRRMOD_MP3_SetDecodeAhead(u16 ms);
+void GRRMOD_MP3_GetDecodeStats(u32 *fill, u32 *underruns);
+s8 GRRMOD_MP3_SeekTime(u32 ms);
+void GRRMOD_MP3_SetReverb(u16 time, u8 damping, u8 wet);
 u32 GRRMOD_MP3_GetVoiceFrequency(u8 voice);
 u32 GRRMOD_MP3_GetVoiceVolume(u8 voice);
 u32 GRRMOD_MP3_GetRealVoiceVolume(u8 voice);
+u8 GRRMOD_MP3_GetVoices(GRRMOD_VoiceInfo *out, u8 n);
+u8 GRRMOD_MP3_GetMeters(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output);
+GRRMOD_SFX *GRRMOD_MP3_SFX_Load(const void *mem, u32 size);
+void GRRMOD_MP3_SFX_Free(GRRMOD_SFX *sfx);
+s8 GRRMOD_MP3_SFX_Play(GRRMOD_SFX *sfx, u8 priority);
+void GRRMOD_MP3_SFX_Stop(s8 voice);
+void GRRMOD_MP3_SFX_SetVolume(u8 volume);
 void GRRMOD_MP3_Start(void);
 void GRRMOD_MP3_Stop(void);
 void GRRMOD_MP3_Pause(void);
@@ -97,6 +156,9 @@ char *GRRMOD_MP3_GetSongTitle(void);
 char *GRRMOD_MP3_GetModType(void);
 void GRRMOD_MP3_Update(u8 *buffer);
 
+// Spectrum analyzer
+void GRRMOD_Spectrum_Process(const s16 *buffer, u32 count, bool stereo);
+
 //==============================================================================
 // C++ footer
 //==============================================================================
@@ -0,0 +1,229 @@
+/*------------------------------------------------------------------------------
+Copyright (c) 2010-2024 The GRRLIB Team
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+------------------------------------------------------------------------------*/
+
+#include "GRRMOD_internals.h"
+#include <math.h>
+#include <string.h>
+
+#define SPECTRUM_MIN    (256)   /**< Smallest transform size. */
+#define SPECTRUM_MAX    (2048)  /**< Largest transform size. */
+#define SPECTRUM_FRESH  (4)     /**< Set on the shared frame index until it is read. */
+
+typedef struct _GRRMOD_SPECTRUM_FRAME {
+    u16 count;                  /**< Number of bins in the frame. */
+    f32 bins[SPECTRUM_MAX/2];   /**< Magnitude of each bin. */
+} GRRMOD_SPECTRUM_FRAME;
+
+// Set by the game thread, picked up by the mixing thread
+static volatile u16 requested = 0;
+
+// Only touched by the mixing thread
+static u16 size = 0;                        /**< Current transform size, 0 if not set up. */
+static u32 histpos = 0;                     /**< Next write position in history. */
+static f32 history[SPECTRUM_MAX];           /**< Last mixed samples, down-mixed to mono. */
+static f32 window[SPECTRUM_MAX];            /**< Hann window. */
+static f32 twiddle[SPECTRUM_MAX][2];        /**< exp(-2*pi*i*k/size). */
+static u16 bitrev[SPECTRUM_MAX/2];          /**< Bit reversal of the complex transform. */
+static f32 work[SPECTRUM_MAX/2][2];         /**< Complex transform workspace. */
+
+// Lock-free triple buffer: the mixer owns back, the reader owns front
+static GRRMOD_SPECTRUM_FRAME frames[3];
+static u32 back = 0;
+static u32 front = 1;
+static u32 middle = 2;
+
+/**
+ * Build the tables for a transform size.
+ * @param n Transform size, a power of two.
+ */
+static void SetupTables(u16 n) {
+    u32 m = n >> 1, bits = 0, i, j, r;
+
+    for(i = 0; i < n; i++) {
+        window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * i / n);
+        twiddle[i][0] = cosf(2.0f * M_PI * i / n);
+        twiddle[i][1] = -sinf(2.0f * M_PI * i / n);
+    }
+    while((1U << bits) < m) {
+        bits++;
+    }
+    for(i = 0; i < m; i++) {
+        for(j = 0, r = 0; j < bits; j++) {
+            r |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+        bitrev[i] = r;
+    }
+    memset(history, 0, sizeof(history));
+    histpos = 0;
+    size = n;
+}
+
+/**
+ * In-place complex transform of size/2 points, decimation in frequency.
+ * Pairs of radix-2 stages are fused into radix-4 butterflies, which saves
+ * a quarter of the twiddle multiplications, a last radix-2 stage is added
+ * when the number of stages is odd. The output is in bit-reversed order.
+ */
+static void Transform(void) {
+    u32 m = size >> 1, q, g, j, step;
+    f32 (*x)[2] = work;
+
+    for(q = m >> 2; q >= 1; q >>= 2) {
+        step = m / (q << 2) * 2; // Twiddle stride in the size-point table
+        for(g = 0; g < m; g += q << 2) {
+            for(j = 0; j < q; j++) {
+                f32 *x0 = x[g+j], *x1 = x[g+j+q], *x2 = x[g+j+2*q], *x3 = x[g+j+3*q];
+                f32 *w1 = twiddle[j*step], *w2 = twiddle[2*j*step], *w3 = twiddle[3*j*step];
+                f32 ar = x0[0] + x2[0], ai = x0[1] + x2[1];
+                f32 br = x0[0] - x2[0], bi = x0[1] - x2[1];
+                f32 cr = x1[0] + x3[0], ci = x1[1] + x3[1];
+                f32 dr = x1[1] - x3[1], di = x3[0] - x1[0]; // -i*(x1-x3)
+                f32 tr, ti;
+
+                x0[0] = ar + cr;
+                x0[1] = ai + ci;
+                tr = ar - cr; ti = ai - ci;
+                x1[0] = tr * w2[0] - ti * w2[1];
+                x1[1] = tr * w2[1] + ti * w2[0];
+                tr = br + dr; ti = bi + di;
+                x2[0] = tr * w1[0] - ti * w1[1];
+                x2[1] = tr * w1[1] + ti * w1[0];
+                tr = br - dr; ti = bi - di;
+                x3[0] = tr * w3[0] - ti * w3[1];
+                x3[1] = tr * w3[1] + ti * w3[0];
+            }
+        }
+    }
+    if((m & 0x55555555) == 0) { // Odd number of radix-2 stages
+        for(g = 0; g < m; g += 2) {
+            f32 tr = x[g][0] - x[g+1][0], ti = x[g][1] - x[g+1][1];
+            x[g][0] += x[g+1][0];
+            x[g][1] += x[g+1][1];
+            x[g+1][0] = tr;
+            x[g+1][1] = ti;
+        }
+    }
+}
+
+/**
+ * Transform the last size samples and publish the magnitude of each bin.
+ */
+static void Analyze(void) {
+    GRRMOD_SPECTRUM_FRAME *frame = &frames[back];
+    u32 m = size >> 1, k, p = histpos;
+    f32 scale = 4.0f / (size * 32768.0f); // A full scale sine reads 1.0
+
+    // Pack the even samples as real parts and the odd ones as imaginary parts
+    for(k = 0; k < m; k++) {
+        work[k][0] = history[p] * window[2*k];
+        p = (p + 1) & (size - 1);
+        work[k][1] = history[p] * window[2*k+1];
+        p = (p + 1) & (size - 1);
+    }
+    Transform();
+
+    // Split the complex transform into the spectrum of the real input
+    for(k = 0; k < m; k++) {
+        f32 *a = work[bitrev[k]], *b = work[bitrev[(m - k) & (m - 1)]];
+        f32 er = 0.5f * (a[0] + b[0]), ei = 0.5f * (a[1] - b[1]);
+        f32 odr = 0.5f * (a[1] + b[1]), odi = 0.5f * (b[0] - a[0]);
+        f32 re = er + odr * twiddle[k][0] - odi * twiddle[k][1];
+        f32 im = ei + odr * twiddle[k][1] + odi * twiddle[k][0];
+        frame->bins[k] = sqrtf(re * re + im * im) * scale;
+    }
+    frame->bins[0] *= 0.5f;
+    frame->count = m;
+
+    back = __atomic_exchange_n(&middle, back | SPECTRUM_FRESH, __ATOMIC_ACQ_REL) & 3;
+}
+
+/**
+ * Feed a mixed buffer to the spectrum analyzer. Called by the mixing thread.
+ * @param buffer The 16-bit samples just mixed.
+ * @param count Number of samples in buffer.
+ * @param stereo Set to true if buffer holds interleaved stereo samples.
+ */
+void GRRMOD_Spectrum_Process(const s16 *buffer, u32 count, bool stereo) {
+    u16 n = requested;
+    u32 i;
+
+    if(n == 0) {
+        size = 0;
+        return;
+    }
+    if(n != size) {
+        SetupTables(n);
+    }
+    if(stereo == true) {
+        for(i = 0; i + 1 < count; i += 2) {
+            history[histpos] = 0.5f * ((f32)buffer[i] + (f32)buffer[i+1]);
+            histpos = (histpos + 1) & (size - 1);
+        }
+    }
+    else {
+        for(i = 0; i < count; i++) {
+            history[histpos] = buffer[i];
+            histpos = (histpos + 1) & (size - 1);
+        }
+    }
+    Analyze();
+}
+
+/**
+ * Enable or disable the spectrum analyzer.
+ * Once enabled, every mixed buffer is analyzed by the mixing thread.
+ * @param points Number of points of the transform: 256, 512, 1024 or 2048. Zero disables the analyzer.
+ * @return A number representating a code:
+ *         -     0 : The operation completed successfully.
+ *         -    -1 : Invalid number of points.
+ * @see GRRMOD_GetSpectrum
+ */
+s8 GRRMOD_SetSpectrum(u16 points) {
+    if(points != 0 &&
+       (points < SPECTRUM_MIN || points > SPECTRUM_MAX || (points & (points - 1)) != 0)) {
+        return -1;
+    }
+    requested = points;
+    return 0;
+}
+
+/**
+ * Get the spectrum of the last buffer mixed, without waiting for the mixer.
+ * Bin k covers the frequency k * mixing frequency / points.
+ * Only call it from one thread.
+ * @param bins Receives the magnitude of the bins, 1.0 for a full scale sine.
+ * @param count Number of bins to read.
+ * @return The number of bins copied, zero if the analyzer is disabled or nothing was analyzed yet.
+ */
+u16 GRRMOD_GetSpectrum(f32 *bins, u16 count) {
+    if(requested == 0 || bins == NULL) {
+        return 0;
+    }
+    if(__atomic_load_n(&middle, __ATOMIC_ACQUIRE) & SPECTRUM_FRESH) {
+        front = __atomic_exchange_n(&middle, front, __ATOMIC_ACQ_REL) & 3;
+    }
+    if(count > frames[front].count) {
+        count = frames[front].count;
+    }
+    memcpy(bins, frames[front].bins, count * sizeof(f32));
+    return count;
+}
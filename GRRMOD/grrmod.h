@@ -47,15 +47,64 @@ THE SOFTWARE.
    extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * Levels measured by the software mixer during the last buffer, 0 to 32767.
+ */
+typedef struct GRRMOD_Meter {
+    u16 peak_l;     /**< Left peak level.   */
+    u16 peak_r;     /**< Right peak level.  */
+    u16 rms_l;      /**< Left RMS level.    */
+    u16 rms_r;      /**< Right RMS level.   */
+} GRRMOD_Meter;
+
+/**
+ * State of a voice as of the last buffer mixed.
+ */
+typedef struct GRRMOD_VoiceInfo {
+    s16 sample;     /**< Sample number in the module, -1 if the voice is silent. */
+    s16 instrument; /**< Instrument number, -1 if none.       */
+    u8 note;        /**< Audible note.                        */
+    u16 volume;     /**< Mixer volume, 0 to 256.              */
+    u16 panning;    /**< Mixer panning, 0 (left) to 255 (right), 512 for surround. */
+    u32 frequency;  /**< Playback frequency in Hz.            */
+    s32 position;   /**< Position in the sample, -1 if unknown. */
+} GRRMOD_VoiceInfo;
+
+/**
+ * A sound effect loaded with GRRMOD_SFX_Load.
+ */
+typedef struct _GRRMOD_SFX GRRMOD_SFX;
+
 s8 GRRMOD_Init(bool stereo);
 void GRRMOD_End(void);
 void GRRMOD_SetMOD(const void *mem, u64 size);
 void GRRMOD_Unload(void);
 void GRRMOD_SetFrequency(u32 freq);
+void GRRMOD_SetOversampling(u8 factor);
+void GRRMOD_SetMaxVoices(u8 count);
+void GRRMOD_SetCompression(u32 length);
+void GRRMOD_SetStreaming(u32 length);
+void GRRMOD_SetCacheSize(u32 bytes);
+void GRRMOD_GetVoiceCount(u8 *real, u8 *virt);
+void GRRMOD_GetSampleMemory(u32 *used, u32 *saved);
+void GRRMOD_GetStreamStats(u32 *reads, u32 *misses);
+void GRRMOD_SetDecodeAhead(u16 ms);
+void GRRMOD_GetDecodeStats(u32 *fill, u32 *underruns);
+s8 GRRMOD_SeekTime(u32 ms);
+void GRRMOD_SetReverb(u16 time, u8 damping, u8 wet);
 void GRRMOD_SetVolume(s16 volume_l, s16 volume_r);
 u32 GRRMOD_GetVoiceFrequency(u8 voice);
 u32 GRRMOD_GetVoiceVolume(u8 voice);
 u32 GRRMOD_GetRealVoiceVolume(u8 voice);
+u8 GRRMOD_GetVoices(GRRMOD_VoiceInfo *out, u8 n);
+u8 GRRMOD_GetMeters(GRRMOD_Meter *voices, u8 count, GRRMOD_Meter *output);
+GRRMOD_SFX *GRRMOD_SFX_Load(const void *mem, u32 size);
+void GRRMOD_SFX_Free(GRRMOD_SFX *sfx);
+s8 GRRMOD_SFX_Play(GRRMOD_SFX *sfx, u8 priority);
+void GRRMOD_SFX_Stop(s8 voice);
+void GRRMOD_SFX_SetVolume(u8 volume);
+s8 GRRMOD_SetSpectrum(u16 points);
+u16 GRRMOD_GetSpectrum(f32 *bins, u16 count);
 void GRRMOD_Start(void);
 void GRRMOD_Stop(void);
 void GRRMOD_Pause(void);
@@ -64,6 +113,7 @@ char *GRRMOD_GetModType(void);
 
 #ifdef _GRRMOD_DEBUG
 u32 GRRMOD_MixingTime(void);
+u32 GRRMOD_SpectrumTime(void);
 #endif
 
 //==============================================================================
@@ -101,7 +101,8 @@ MIKMODAPI MDRIVER drv_nos={
 	VC_VoiceStop,
 	VC_VoiceStopped,
 	VC_VoiceGetPosition,
-	VC_VoiceRealVolume
+	VC_VoiceRealVolume,
+	VC_VoiceSetFilter
 };
 
 /* ex:set ts=4: */
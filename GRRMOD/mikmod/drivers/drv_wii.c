@@ -112,7 +112,8 @@ MIKMODAPI MDRIVER drv_wii={
 	VC_VoiceStop,
 	VC_VoiceStopped,
 	VC_VoiceGetPosition,
-	VC_VoiceRealVolume
+	VC_VoiceRealVolume,
+	VC_VoiceSetFilter
 };
 
 /* ex:set ts=4: */
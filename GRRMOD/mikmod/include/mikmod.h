@@ -443,6 +443,7 @@ MIKMODAPI extern SAMPLE *Sample_LoadMem(const char *buf, int len);
 MIKMODAPI extern SAMPLE *Sample_LoadGeneric(MREADER*);
 MIKMODAPI extern void   Sample_Free(SAMPLE*);
 MIKMODAPI extern SBYTE  Sample_Play(SAMPLE*,ULONG,UBYTE);
+MIKMODAPI extern SBYTE  Sample_PlayPriority(SAMPLE*,ULONG,UBYTE,UBYTE);
 
 MIKMODAPI extern void   Voice_SetVolume(SBYTE,UWORD);
 MIKMODAPI extern UWORD  Voice_GetVolume(SBYTE);
@@ -496,6 +497,8 @@ typedef struct INSTRUMENT {
     UBYTE pitpancenter;     /* pitch pan center (0 to 119) */
     UBYTE rvolvar;          /* random volume varations (0 - 100%) */
     UBYTE rpanvar;          /* random panning varations (0 - 100%) */
+    UBYTE cutoff;           /* initial filter cutoff (0-127), bit 7: used */
+    UBYTE resonance;        /* initial filter resonance (0-127), bit 7: used */
 
     /* volume envelope */
     UBYTE volflg;           /* bit 0: on 1: sustain 2: loop */
@@ -628,6 +631,17 @@ typedef struct VOICEINFO {
     UBYTE       kick;         /* if true = sample has been restarted */
 } VOICEINFO;
 
+/* Voice state as of the last mixed buffer, see Player_GetVoiceStates */
+typedef struct VOICESTATE {
+    SWORD       sample;       /* sample number in the module, -1 if silent */
+    SWORD       instrument;   /* instrument number, -1 if none */
+    UBYTE       note;         /* the audible note */
+    UWORD       volume;       /* mixer volume */
+    ULONG       panning;      /* mixer panning */
+    ULONG       frequency;    /* playback frequency in Hz */
+    SLONG       position;     /* position in the sample, -1 if unknown */
+} VOICESTATE;
+
 /*
  *  ========== Module loaders
  */
@@ -693,6 +707,7 @@ MIKMODAPI extern void    Player_ToggleMute(SLONG,...);
 MIKMODAPI extern int     Player_GetChannelVoice(UBYTE);
 MIKMODAPI extern UWORD   Player_GetChannelPeriod(UBYTE);
 MIKMODAPI extern int     Player_QueryVoices(UWORD numvoices, VOICEINFO *vinfo);
+MIKMODAPI extern int     Player_GetVoiceStates(VOICESTATE*,int,int);
 MIKMODAPI extern int     Player_GetRow(void);
 MIKMODAPI extern int     Player_GetOrder(void);
 
@@ -727,6 +742,7 @@ enum {
 #define DMODE_SOFT_MUSIC 0x0008 /* Process music via software mixer */
 #define DMODE_HQMIXER    0x0010 /* Use high-quality (slower) software mixer */
 #define DMODE_FLOAT      0x0020 /* enable float output */
+#define DMODE_FLOATMIX   0x0040 /* mix in floating point (HQ mixer only) */
 /* These take effect immediately. */
 #define DMODE_SURROUND   0x0100 /* enable surround sound */
 #define DMODE_INTERP     0x0200 /* enable interpolation */
@@ -773,6 +789,7 @@ typedef struct MDRIVER {
     BOOL        (*VoiceStopped)     (UBYTE);
     SLONG       (*VoiceGetPosition) (UBYTE);
     ULONG       (*VoiceRealVolume)  (UBYTE);
+    void        (*VoiceSetFilter)   (UBYTE,UBYTE,UBYTE);
 } MDRIVER;
 
 /* These variables can be changed at ANY time and results will be immediate */
@@ -780,7 +797,20 @@ MIKMODAPI extern UBYTE md_volume;      /* global sound volume (0-128) */
 MIKMODAPI extern UBYTE md_musicvolume; /* volume of song */
 MIKMODAPI extern UBYTE md_sndfxvolume; /* volume of sound effects */
 MIKMODAPI extern UBYTE md_reverb;      /* 0 = none;  15 = chaos */
+MIKMODAPI extern UWORD md_reverbtime;  /* HQ mixer reverb time in ms, 0 = md_reverb */
+MIKMODAPI extern UBYTE md_reverbdamp;  /* HQ mixer reverb damping: 0 = bright, 255 = dull */
+MIKMODAPI extern UBYTE md_reverbwet;   /* HQ mixer reverb level (0-128) */
+MIKMODAPI extern UBYTE md_oversampling;/* HQ mixer oversampling: 0 = 1x, 1 = 2x, 2 = 4x */
+MIKMODAPI extern UBYTE md_mixvoices;   /* HQ mixer: most voices really mixed, 0 = all */
+MIKMODAPI extern UBYTE md_realvoices;  /* HQ mixer: voices mixed during the last tick */
+MIKMODAPI extern UBYTE md_virtualvoices;/* HQ mixer: voices only followed during the last tick */
 MIKMODAPI extern UBYTE md_pansep;      /* 0 = mono;  128 == 100% (full left/right) */
+MIKMODAPI extern ULONG md_compress;    /* HQ mixer: samples at least this long are loaded
+                                          ADPCM compressed, 0 = never */
+MIKMODAPI extern ULONG md_stream;      /* HQ mixer: samples playing at least this long
+                                          before their loop are read while they play,
+                                          from the reader given to Player_LoadGeneric,
+                                          which must outlive the module, 0 = never */
 
 /* The variables below can be changed at any time, but changes will not be
    implemented until MikMod_Reset is called. A call to MikMod_Reset may result
@@ -789,6 +819,7 @@ MIKMODAPI extern UBYTE md_pansep;      /* 0 = mono;  128 == 100% (full left/righ
 MIKMODAPI extern UWORD md_device;      /* device */
 MIKMODAPI extern UWORD md_mixfreq;     /* mixing frequency */
 MIKMODAPI extern UWORD md_mode;        /* mode. See DMODE_? flags above */
+MIKMODAPI extern UBYTE md_mixthreads;  /* HQ mixer threads: 0 = one per CPU, 1 = none */
 
 /* The following variable should not be changed! */
 MIKMODAPI extern MDRIVER* md_driver;   /* Current driver in use. */
@@ -870,6 +901,28 @@ MIKMODAPI extern void  VC_VoiceStop(UBYTE);
 MIKMODAPI extern BOOL  VC_VoiceStopped(UBYTE);
 MIKMODAPI extern SLONG VC_VoiceGetPosition(UBYTE);
 MIKMODAPI extern ULONG VC_VoiceRealVolume(UBYTE);
+MIKMODAPI extern void  VC_VoiceSetFilter(UBYTE,UBYTE,UBYTE);
+
+/* Levels measured by the HQ mixer during the last block, 0-32767 */
+typedef struct MMETER {
+    UWORD peakl,peakr;
+    UWORD rmsl,rmsr;
+} MMETER;
+
+MIKMODAPI extern int   VC_GetMeters(MMETER*,int,int,MMETER*);
+
+/* Sample memory of the software mixers */
+typedef struct MSAMPLESTATS {
+    ULONG handles;  /* samples loaded */
+    ULONG buffers;  /* distinct sample buffers they use */
+    ULONG bytes;    /* size of the buffers */
+    ULONG saved;    /* bytes saved by sharing identical samples */
+    ULONG streamed; /* samples streamed, their resident part is in bytes */
+    ULONG reads;    /* windows of streamed samples read */
+    ULONG misses;   /* times a voice needed a window before it was read */
+} MSAMPLESTATS;
+
+MIKMODAPI extern void  VC_GetSampleStats(MSAMPLESTATS*);
 
 #ifdef __cplusplus
 }
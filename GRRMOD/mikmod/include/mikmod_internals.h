@@ -238,6 +238,9 @@ extern int       SL_Load(void*,SAMPLOAD*,ULONG);
 extern BOOL      SL_Init(SAMPLOAD*);
 extern void      SL_Exit(SAMPLOAD*);
 
+/* reader which outlives the samples loaded from it, they may be streamed */
+extern MREADER*  sl_streamreader;
+
 /*========== Internal module representation (UniMod) interface */
 
 /* number of notes in an octave */
@@ -248,6 +251,8 @@ extern UBYTE  UniGetByte(void);
 extern UWORD  UniGetWord(void);
 extern UBYTE* UniFindRow(UBYTE*,UWORD);
 extern void   UniSkipOpcode(void);
+extern UBYTE  UniGetRowPos(void);
+extern void   UniSetRowPos(UBYTE);
 extern void   UniReset(void);
 extern void   UniWriteByte(UBYTE);
 extern void   UniWriteWord(UWORD);
@@ -492,8 +497,14 @@ typedef struct MP_CHANNEL {
     SWORD  handle;      /* which sample-handle */
     UBYTE  notedelay;   /* (used for note delay) */
     SLONG  start;       /* The starting byte index in the sample */
+    UBYTE  cutoff;      /* resonant filter cutoff (0-127, 127 = open) */
+    UBYTE  resonance;   /* resonant filter resonance (0-127) */
 } MP_CHANNEL;
 
+/* maximum number of effects in a row: the 5 bit row length includes the
+   length byte itself, and every opcode takes at least one byte */
+#define MAXROWFX 30
+
 typedef struct MP_CONTROL {
     struct MP_CHANNEL   main;
 
@@ -576,6 +587,14 @@ typedef struct MP_CONTROL {
 
     SWORD   pat_reppos; /* patternloop position */
     UWORD   pat_repcnt; /* times to loop */
+
+    /* effect program of the current row, compiled once per row */
+    UBYTE*  fxrow;      /* row the effect program was compiled from */
+    UBYTE   fxcount;    /* number of effects in the row */
+    UBYTE   fxtickn;    /* number of effects acting after the first tick */
+    UBYTE   fxop[MAXROWFX]; /* effect opcodes, in row order */
+    UBYTE   fxpc[MAXROWFX]; /* offset of their operands in the row */
+    UBYTE   fxtick[MAXROWFX];/* indexes of the effects acting after tick 0 */
 } MP_CONTROL;
 
 /* Used by NNA only player (audio control.  AUDTMP is used for full effects
@@ -736,14 +755,17 @@ extern void MikMod_Exit_internal(void);
 extern int  MikMod_SetNumVoices_internal(int,int);
 extern void Player_Exit_internal(MODULE*);
 extern void Player_Stop_internal(void);
+extern void Player_PublishVoices_internal(void);
 extern BOOL Player_Paused_internal(void);
 extern void Sample_Free_internal(SAMPLE*);
+extern void Sample_StopVoices_internal(SAMPLE*);
 extern void Voice_Play_internal(SBYTE,SAMPLE*,ULONG);
 extern void Voice_SetFrequency_internal(SBYTE,ULONG);
 extern void Voice_SetPanning_internal(SBYTE,ULONG);
 extern void Voice_SetVolume_internal(SBYTE,UWORD);
 extern void Voice_Stop_internal(SBYTE);
 extern BOOL Voice_Stopped_internal(SBYTE);
+extern void Voice_SetFilter_internal(SBYTE,UBYTE,UBYTE);
 
 extern int   VC1_PlayStart(void);
 extern int   VC2_PlayStart(void);
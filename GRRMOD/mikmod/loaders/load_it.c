@@ -140,7 +140,9 @@ typedef struct ITINSTHEADER {
 	UBYTE	rpanvar;		/* random panning varations */
 	UWORD	numsmp;			/* Number of samples in instrument [files only] */
 	CHAR	name[26];		/* Instrument name */
-	UBYTE	blank01[6];
+	UBYTE	ifc;			/* Initial filter cutoff, bit 7: used */
+	UBYTE	ifr;			/* Initial filter resonance, bit 7: used */
+	UBYTE	blank01[4];
 	UWORD	samptable[ITNOTECNT];/* sample for each note [note / samp pairs] */
 	UBYTE	volenv[200];	     /* volume envelope (IT 1.x stuff) */
 	UBYTE	oldvoltick[ITENVCNT];/* volume tick position (IT 1.x stuff) */
@@ -773,7 +775,9 @@ static BOOL IT_Load(BOOL curious)
 			ih.numsmp    = _mm_read_UBYTE(modreader);
 			_mm_skip_BYTE(modreader);
 			_mm_read_string(ih.name,26,modreader);
-			_mm_read_UBYTES(ih.blank01,6,modreader);
+			ih.ifc       = _mm_read_UBYTE(modreader);
+			ih.ifr       = _mm_read_UBYTE(modreader);
+			_mm_read_UBYTES(ih.blank01,4,modreader);
 			_mm_read_I_UWORDS(ih.samptable,ITNOTECNT,modreader);
 			if(mh->cwt<0x200) {
 				/* load IT 1xx volume envelope */
@@ -875,6 +879,10 @@ static BOOL IT_Load(BOOL curious)
 					d->rvolvar = ih.rvolvar;
 					d->rpanvar = ih.rpanvar;
 				}
+				if(filters) {
+					d->cutoff    = ih.ifc;
+					d->resonance = ih.ifr;
+				}
 
 #if defined __STDC__ || defined _MSC_VER || defined __WATCOMC__ || defined MPW_C
 #define IT_ProcessEnvelope(name) 										\
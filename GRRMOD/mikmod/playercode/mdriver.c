@@ -56,8 +56,18 @@ MIKMODAPI UWORD md_mixfreq	= 44100;
 MIKMODAPI UWORD md_mode		= DMODE_STEREO | DMODE_16BITS |
 				  DMODE_SURROUND |
 				  DMODE_SOFT_MUSIC | DMODE_SOFT_SNDFX;
+MIKMODAPI UBYTE md_mixthreads	= 0;	/* one HQ mixer thread per CPU */
 MIKMODAPI UBYTE md_pansep	= 128;	/* 128 == 100% (full left/right) */
 MIKMODAPI UBYTE md_reverb	= 0;	/* no reverb */
+MIKMODAPI UWORD md_reverbtime	= 0;	/* HQ mixer: reverb time from md_reverb */
+MIKMODAPI UBYTE md_reverbdamp	= 128;
+MIKMODAPI UBYTE md_reverbwet	= 64;
+MIKMODAPI UBYTE md_oversampling	= 2;	/* 4x oversampling in the HQ mixer */
+MIKMODAPI UBYTE md_mixvoices	= 0;	/* no limit on the voices really mixed */
+MIKMODAPI UBYTE md_realvoices	= 0;
+MIKMODAPI UBYTE md_virtualvoices	= 0;
+MIKMODAPI ULONG md_compress	= 0;	/* no ADPCM compressed samples */
+MIKMODAPI ULONG md_stream	= 0;	/* no streamed samples */
 MIKMODAPI UBYTE md_volume	= 128;	/* global sound volume (0-128) */
 MIKMODAPI UBYTE md_musicvolume	= 128;	/* volume of song */
 MIKMODAPI UBYTE md_sndfxvolume	= 128;	/* volume of sound effects */
@@ -78,8 +88,21 @@ static MDRIVER *firstdriver = NULL;
 
 static volatile BOOL isplaying = 0, initialized = 0;
 
-static UBYTE *sfxinfo;
-static int sfxpool;
+/* Sound effect voices are kept in a binary heap whose root is the voice to
+   use next: a free voice if there is one, else the oldest effect of the
+   lowest priority. Critical effects rank above all others and are only
+   reused once they have ended. */
+typedef struct SFXVOICE {
+	UBYTE flags;     /* SFX_CRITICAL */
+	UBYTE priority;
+	UBYTE busy;
+	UBYTE pos;       /* position in sfxheap */
+	ULONG stamp;     /* play order, to steal the oldest effect first */
+} SFXVOICE;
+
+static SFXVOICE *sfxinfo;
+static UBYTE *sfxheap;
+static ULONG sfxstamp;
 
 static SAMPLE **md_sample = NULL;
 
@@ -303,13 +326,66 @@ MIKMODAPI MikMod_player_t MikMod_RegisterPlayer(MikMod_player_t player)
 	return result;
 }
 
+/* Returns nonzero if effect voice a has to be reused before effect voice b */
+static int SFX_Before(int a,int b)
+{
+	SFXVOICE *x=&sfxinfo[a],*y=&sfxinfo[b];
+	int rx=x->busy?((x->flags&SFX_CRITICAL)?2:1):0;
+	int ry=y->busy?((y->flags&SFX_CRITICAL)?2:1):0;
+
+	if(rx!=ry) return rx<ry;
+	if(rx==1&&x->priority!=y->priority) return x->priority<y->priority;
+	return (SLONG)(x->stamp-y->stamp)<0;
+}
+
+static void SFX_Swap(int i,int j)
+{
+	UBYTE t=sfxheap[i];
+
+	sfxheap[i]=sfxheap[j];
+	sfxheap[j]=t;
+	sfxinfo[sfxheap[i]].pos=i;
+	sfxinfo[sfxheap[j]].pos=j;
+}
+
+/* Restores the heap order after the rank of effect voice v has changed */
+static void SFX_Update(int v)
+{
+	int i=sfxinfo[v].pos,c;
+
+	while(i>0&&SFX_Before(sfxheap[i],sfxheap[(i-1)>>1])) {
+		SFX_Swap(i,(i-1)>>1);
+		i=(i-1)>>1;
+	}
+	while((c=2*i+1)<md_sfxchn) {
+		if(c+1<md_sfxchn&&SFX_Before(sfxheap[c+1],sfxheap[c])) c++;
+		if(!SFX_Before(sfxheap[c],sfxheap[i])) break;
+		SFX_Swap(i,c);
+		i=c;
+	}
+}
+
+/* Frees the effect voices whose sample has ended */
+static void SFX_Sweep(void)
+{
+	int t;
+
+	for(t=0;t<md_sfxchn;t++)
+		if(sfxinfo[t].busy&&md_driver->VoiceStopped(t+md_sngchn)) {
+			sfxinfo[t].busy=0;
+			SFX_Update(t);
+		}
+}
+
 MIKMODAPI void MikMod_Update(void)
 {
 	MUTEX_LOCK(vars);
 	if(isplaying) {
-		if((!pf)||(!pf->forbid))
+		if((!pf)||(!pf->forbid)) {
 			md_driver->Update();
-		else {
+			Player_PublishVoices_internal();
+			if(md_sfxchn) SFX_Sweep();
+		} else {
 			if (md_driver->Pause)
 				md_driver->Pause();
 		}
@@ -442,9 +518,11 @@ MIKMODAPI void Voice_Play(SBYTE voice,SAMPLE* s,ULONG start)
 void Voice_Stop_internal(SBYTE voice)
 {
 	if((voice<0)||(voice>=md_numchn)) return;
-	if(voice>=md_sngchn)
-		/* It is a sound effects channel, so flag the voice as non-critical! */
-		sfxinfo[voice-md_sngchn]=0;
+	if(voice>=md_sngchn) {
+		/* It is a sound effects channel, so make the voice free again */
+		sfxinfo[voice-md_sngchn].busy=0;
+		SFX_Update(voice-md_sngchn);
+	}
 	md_driver->VoiceStop(voice);
 }
 
@@ -461,6 +539,14 @@ BOOL Voice_Stopped_internal(SBYTE voice)
 	return(md_driver->VoiceStopped(voice));
 }
 
+/* Sets the resonant filter of a voice, on drivers which can filter voices */
+void Voice_SetFilter_internal(SBYTE voice,UBYTE cutoff,UBYTE resonance)
+{
+	if((voice<0)||(voice>=md_numchn)) return;
+	if(md_driver->VoiceSetFilter)
+		md_driver->VoiceSetFilter(voice,cutoff,resonance);
+}
+
 MIKMODAPI BOOL Voice_Stopped(SBYTE voice)
 {
 	BOOL result;
@@ -584,9 +670,11 @@ void MikMod_Exit_internal(void)
 	md_driver = &drv_nos;
 
 	MikMod_free(sfxinfo);
+	MikMod_free(sfxheap);
 	MikMod_free(md_sample);
 	md_sample  = NULL;
 	sfxinfo    = NULL;
+	sfxheap    = NULL;
 
 	initialized = 0;
 }
@@ -664,9 +752,11 @@ int MikMod_SetNumVoices_internal(int music, int sfx)
 	}
 
 	MikMod_free(sfxinfo);
+	MikMod_free(sfxheap);
 	MikMod_free(md_sample);
 	md_sample  = NULL;
 	sfxinfo    = NULL;
+	sfxheap    = NULL;
 
 	if(music!=-1) md_sngchn = music;
 	if(sfx!=-1)   md_sfxchn = sfx;
@@ -685,13 +775,17 @@ int MikMod_SetNumVoices_internal(int music, int sfx)
 
 	if(md_sngchn+md_sfxchn)
 		md_sample=(SAMPLE**)MikMod_calloc(md_sngchn+md_sfxchn,sizeof(SAMPLE*));
-	if(md_sfxchn)
-		sfxinfo = (UBYTE *)MikMod_calloc(md_sfxchn,sizeof(UBYTE));
+	if(md_sfxchn) {
+		sfxinfo = (SFXVOICE *)MikMod_calloc(md_sfxchn,sizeof(SFXVOICE));
+		sfxheap = (UBYTE *)MikMod_calloc(md_sfxchn,sizeof(UBYTE));
+		if(sfxinfo&&sfxheap)
+			for(t=0;t<md_sfxchn;t++)
+				sfxheap[t]=sfxinfo[t].pos=t;
+	}
 
 	/* make sure the player doesn't start with garbage */
 	for(t=oldchn;t<md_numchn;t++)  Voice_Stop_internal(t);
 
-	sfxpool = 0;
 	if(resume) MikMod_EnableOutput_internal();
 	_mm_critical = 0;
 
@@ -762,48 +856,37 @@ MIKMODAPI BOOL MikMod_Active(void)
 	return result;
 }
 
-/* Plays a sound effects sample.  Picks a voice from the number of voices
-   allocated for use as sound effects (loops through voices, skipping all active
-   criticals).
+/* Plays a sound effects sample. Takes the voice at the root of the effect
+   heap: a free voice, else the oldest effect of the lowest priority, as long
+   as that priority is not above the new one and the effect is not critical.
 
-   Returns the voice that the sound is being played on. */
-static SBYTE Sample_Play_internal(SAMPLE *s,ULONG start,UBYTE flags)
+   Returns the voice that the sound is being played on, -1 if none. */
+static SBYTE Sample_Play_internal(SAMPLE *s,ULONG start,UBYTE flags,UBYTE priority)
 {
-	int orig=sfxpool;/* for cases where all channels are critical */
-	int c;
+	SFXVOICE *x;
+	int v,c;
 
 	if(!md_sfxchn) return -1;
 	if(s->volume>64) s->volume = 64;
 
-	/* check the first location after sfxpool */
-	do {
-		if(sfxinfo[sfxpool]&SFX_CRITICAL) {
-			if(md_driver->VoiceStopped(c=sfxpool+md_sngchn)) {
-				sfxinfo[sfxpool]=flags;
-				Voice_Play_internal(c,s,start);
-				md_driver->VoiceSetVolume(c,s->volume<<2);
-				Voice_SetPanning_internal(c,s->panning);
-				md_driver->VoiceSetFrequency(c,s->speed);
-				sfxpool++;
-				if(sfxpool>=md_sfxchn) sfxpool=0;
-				return c;
-			}
-		} else {
-			sfxinfo[sfxpool]=flags;
-			Voice_Play_internal(c=sfxpool+md_sngchn,s,start);
-			md_driver->VoiceSetVolume(c,s->volume<<2);
-			Voice_SetPanning_internal(c,s->panning);
-			md_driver->VoiceSetFrequency(c,s->speed);
-			sfxpool++;
-			if(sfxpool>=md_sfxchn) sfxpool=0;
-			return c;
-		}
-
-		sfxpool++;
-		if(sfxpool>=md_sfxchn) sfxpool = 0;
-	} while(sfxpool!=orig);
+	x=&sfxinfo[v=sfxheap[0]];
+	c=v+md_sngchn;
+	if(x->busy && !md_driver->VoiceStopped(c)) {
+		if(x->flags&SFX_CRITICAL) return -1;
+		if(x->priority>priority) return -1;
+	}
 
-	return -1;
+	x->flags=flags;
+	x->priority=priority;
+	x->busy=1;
+	x->stamp=++sfxstamp;
+	SFX_Update(v);
+
+	Voice_Play_internal(c,s,start);
+	Voice_SetVolume_internal(c,s->volume<<2);
+	Voice_SetPanning_internal(c,s->panning);
+	md_driver->VoiceSetFrequency(c,s->speed);
+	return c;
 }
 
 MIKMODAPI SBYTE Sample_Play(SAMPLE *s,ULONG start,UBYTE flags)
@@ -811,12 +894,35 @@ MIKMODAPI SBYTE Sample_Play(SAMPLE *s,ULONG start,UBYTE flags)
 	SBYTE result;
 
 	MUTEX_LOCK(vars);
-	result=Sample_Play_internal(s,start,flags);
+	result=Sample_Play_internal(s,start,flags,0);
 	MUTEX_UNLOCK(vars);
 
 	return result;
 }
 
+MIKMODAPI SBYTE Sample_PlayPriority(SAMPLE *s,ULONG start,UBYTE flags,UBYTE priority)
+{
+	SBYTE result;
+
+	MUTEX_LOCK(vars);
+	result=Sample_Play_internal(s,start,flags,priority);
+	MUTEX_UNLOCK(vars);
+
+	return result;
+}
+
+/* Stops the voices still playing a sample that is about to be freed */
+void Sample_StopVoices_internal(SAMPLE *s)
+{
+	int t;
+
+	for(t=0;t<md_numchn;t++)
+		if(md_sample[t]==s) {
+			Voice_Stop_internal(t);
+			md_sample[t]=NULL;
+		}
+}
+
 MIKMODAPI long MikMod_GetVersion(void)
 {
 	return LIBMIKMOD_VERSION;
@@ -494,7 +494,7 @@ MIKMODAPI CHAR* Player_LoadTitle(const CHAR* filename)
 }
 
 /* Loads a module given an reader */
-static MODULE* Player_LoadGeneric_internal(MREADER *reader,int maxchan,BOOL curious)
+static MODULE* Player_LoadGeneric_internal(MREADER *reader,int maxchan,BOOL curious,BOOL stream)
 {
 	int t;
 	MLOADER *l;
@@ -619,7 +619,11 @@ static MODULE* Player_LoadGeneric_internal(MREADER *reader,int maxchan,BOOL curi
 		ok = !MikMod_SetNumVoices_internal(maxchan,-1);
 	}
 
+	/* samples can be streamed from the reader of the caller, not from an
+	   unpacked copy */
+	sl_streamreader=(stream && modreader==reader)?reader:NULL;
 	if(ok) ok = !SL_LoadSamples();
+	sl_streamreader=NULL;
 	if(ok) ok = !Player_Init(mf);
 
 	#ifndef NO_DEPACKERS
@@ -638,19 +642,26 @@ static MODULE* Player_LoadGeneric_internal(MREADER *reader,int maxchan,BOOL curi
 	return mf;
 }
 
-MIKMODAPI MODULE* Player_LoadGeneric(MREADER *reader,int maxchan,BOOL curious)
+static MODULE* Player_LoadReader(MREADER *reader,int maxchan,BOOL curious,BOOL stream)
 {
 	MODULE* result;
 
 	MUTEX_LOCK(vars);
 	MUTEX_LOCK(lists);
-		result=Player_LoadGeneric_internal(reader,maxchan,curious);
+		result=Player_LoadGeneric_internal(reader,maxchan,curious,stream);
 	MUTEX_UNLOCK(lists);
 	MUTEX_UNLOCK(vars);
 
 	return result;
 }
 
+/* The reader has to stay valid until the module is freed when md_stream is
+   set, since samples may be read from it while they play. */
+MIKMODAPI MODULE* Player_LoadGeneric(MREADER *reader,int maxchan,BOOL curious)
+{
+	return Player_LoadReader(reader,maxchan,curious,1);
+}
+
 MIKMODAPI MODULE* Player_LoadMem(const char *buffer,int len,int maxchan,BOOL curious)
 {
 	MODULE* result=NULL;
@@ -658,7 +669,7 @@ MIKMODAPI MODULE* Player_LoadMem(const char *buffer,int len,int maxchan,BOOL cur
 
 	if (!buffer || len <= 0) return NULL;
 	if ((reader=_mm_new_mem_reader(buffer, len)) != NULL) {
-		result=Player_LoadGeneric(reader,maxchan,curious);
+		result=Player_LoadReader(reader,maxchan,curious,0);
 		_mm_delete_mem_reader(reader);
 	}
 	return result;
@@ -672,7 +683,7 @@ MIKMODAPI MODULE* Player_LoadFP(FILE* fp,int maxchan,BOOL curious)
 	struct MREADER* reader;
 
 	if (fp && (reader=_mm_new_file_reader(fp)) != NULL) {
-		result=Player_LoadGeneric(reader,maxchan,curious);
+		result=Player_LoadReader(reader,maxchan,curious,0);
 		_mm_delete_file_reader(reader);
 	}
 	return result;
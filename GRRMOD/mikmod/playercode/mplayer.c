@@ -2019,6 +2019,25 @@ static int DoITEffectY(UWORD tick, UWORD flags, MP_CONTROL *a, MODULE *mod, SWOR
 	return 0;
 }
 
+/* Impulse Tracker Zxx resonant filters, as translated by the loader from the
+   MIDI macros of the module */
+static int DoITEffectZ(UWORD tick, UWORD flags, MP_CONTROL *a, MODULE *mod, SWORD channel)
+{
+	UBYTE filter,inf;
+
+	filter=UniGetByte();
+	inf=UniGetByte();
+	if (!tick) {
+		if (inf>127) inf=127;
+		if (filter==FILT_CUT)
+			a->main.cutoff=inf;
+		else if (filter==FILT_RESONANT)
+			a->main.resonance=inf;
+	}
+
+	return 0;
+}
+
 static void DoNNAEffects(MODULE *, MP_CONTROL *, UBYTE);
 
 /* Impulse/Scream Tracker Sxx effects.
@@ -2658,7 +2677,7 @@ static effect_func effects[UNI_LAST] = {
 	DoITEffectU,	/* UNI_ITEFFECTU */
 	DoITEffectW,	/* UNI_ITEFFECTW */
 	DoITEffectY,	/* UNI_ITEFFECTY */
-	DoNothing,	/* UNI_ITEFFECTZ */
+	DoITEffectZ,	/* UNI_ITEFFECTZ */
 	DoITEffectS0,	/* UNI_ITEFFECTS0 */
 	DoULTEffect9,	/* UNI_ULTEFFECT9 */
 	DoMEDSpeed,	/* UNI_MEDSPEED */
@@ -2689,23 +2708,126 @@ static effect_func effects[UNI_LAST] = {
 	DoFAREffectF,	/* UNI_FAREFFECTF */
 };
 
+/* Returns nonzero if no other effect of the row shares the opcode of effect n,
+   i.e. if the effect is the only one to write its effect memory */
+static int pt_fxunique(MP_CONTROL *a, UBYTE n)
+{
+	UBYTE t;
+
+	for (t=0;t<a->fxcount;t++)
+		if ((t!=n)&&(a->fxop[t]==a->fxop[n]))
+			return 0;
+	return 1;
+}
+
+/* Returns nonzero if effect n of the row only acts on the first tick. The
+   programcounter must point to the operands of the effect. */
+static int pt_fxfirsttick(MP_CONTROL *a, UBYTE n)
+{
+	UBYTE c;
+
+	switch (a->fxop[n]) {
+	case UNI_PTEFFECT9:
+	case UNI_PTEFFECTB:
+	case UNI_PTEFFECTC:
+	case UNI_PTEFFECTD:
+	case UNI_PTEFFECTF:
+	case UNI_S3MEFFECTA:
+	case UNI_S3MEFFECTT:
+	case UNI_XMEFFECTE1:
+	case UNI_XMEFFECTE2:
+	case UNI_XMEFFECTEA:
+	case UNI_XMEFFECTEB:
+	case UNI_XMEFFECTL:
+	case UNI_MEDEFFECT_1E:
+	case UNI_FAREFFECT1:
+	case UNI_FAREFFECT2:
+	case UNI_FAREFFECT3:
+	case UNI_FAREFFECTD:
+	case UNI_FAREFFECTE:
+	case UNI_FAREFFECTF:
+		return 1;
+	case UNI_PTEFFECTE:
+		switch (UniGetByte()>>4) {
+		case 0x0: case 0x1: case 0x2: case 0x6:
+		case 0xa: case 0xb: case 0xe: case 0xf:
+			return 1;
+		}
+		break;
+	case UNI_ITEFFECTS0:
+		/* effect memory is written on every tick, so only skip the effect if
+		   no other one of the row could overwrite it in between */
+		c=UniGetByte();
+		if (c && pt_fxunique(a, n))
+			switch (c>>4) {
+			case SS_FRAMEDELAY:
+			case SS_HIOFFSET:
+			case SS_PATLOOP:
+			case SS_PATDELAY:
+				return 1;
+			}
+		break;
+	case UNI_VOLEFFECTS:
+		if (UniGetByte()==VOL_VOLUME)
+			return pt_fxunique(a, n);
+		break;
+	}
+	return 0;
+}
+
+/* Compiles the effects of the current row of the channel into a list of
+   effect opcodes and operand offsets, and the sublist of those which still
+   act after the first tick, so that the row is parsed only once. */
+static void pt_compileeffects(MP_CONTROL *a)
+{
+	UBYTE c, n;
+
+	a->fxrow=a->row;
+	a->fxcount=a->fxtickn=0;
+
+	UniSetRow(a->row);
+	while((c=UniGetByte()) != 0 && c < UNI_LAST) {
+		n=UniGetRowPos();
+		UniSkipOpcode();
+		if (effects[c] == DoNothing)
+			continue;
+		a->fxop[a->fxcount]=c;
+		a->fxpc[a->fxcount++]=n;
+	}
+
+	for (n=0;n<a->fxcount;n++) {
+		UniSetRowPos(a->fxpc[n]);
+		if (!pt_fxfirsttick(a, n))
+			a->fxtick[a->fxtickn++]=n;
+	}
+}
+
 static int pt_playeffects(MODULE *mod, SWORD channel, MP_CONTROL *a)
 {
 	UWORD tick = mod->vbtick;
 	UWORD flags = mod->flags;
-	UBYTE c;
+	UBYTE n, t;
 	int explicitslides = 0;
-	effect_func f;
 
-	while((c=UniGetByte()) != 0) {
-#if 0 /* this doesn't normally happen unless things go fubar elsewhere */
-		if (c >= UNI_LAST)
-		    fprintf(stderr,"fubar'ed opcode %u\n",c);
-#endif
-		f = effects[c];
-		if (f != DoNothing)
-		    a->sliding = 0;
-		explicitslides |= f(tick, flags, a, mod, channel);
+	if (a->fxrow != a->row)
+		pt_compileeffects(a);
+
+	/* handlers never look at the sliding flag, so clearing it once is the
+	   same as clearing it before each effect */
+	if (a->fxcount)
+		a->sliding = 0;
+
+	if (!tick) {
+		for (n=0;n<a->fxcount;n++) {
+			UniSetRowPos(a->fxpc[n]);
+			explicitslides |= effects[a->fxop[n]](tick, flags, a, mod, channel);
+		}
+	} else {
+		for (t=0;t<a->fxtickn;t++) {
+			n=a->fxtick[t];
+			UniSetRowPos(a->fxpc[n]);
+			explicitslides |= effects[a->fxop[n]](tick, flags, a, mod, channel);
+		}
 	}
 	return explicitslides;
 }
@@ -2874,6 +2996,8 @@ static void pt_UpdateVoices(MODULE *mod, int max_volume)
 			else
 				Voice_SetPanning_internal(channel,aout->main.panning);
 
+		Voice_SetFilter_internal(channel,aout->main.cutoff,aout->main.resonance);
+
 		if (aout->main.period && s->vibdepth) {
 			if (s->vibflags & AV_IT) {
 				/* IT auto-vibrato uses regular waveforms. */
@@ -3078,6 +3202,10 @@ static void pt_Notes(MODULE *mod)
 				a->main.nna=i->nnatype;
 				a->dca=i->dca;
 				a->dct=i->dct;
+				if (i->cutoff & 0x80)
+					a->main.cutoff=i->cutoff&0x7f;
+				if (i->resonance & 0x80)
+					a->main.resonance=i->resonance&0x7f;
 			} else {
 				a->main.pitflg=a->main.volflg=a->main.panflg=0;
 				a->main.nna=a->dca=0;
@@ -3298,21 +3426,23 @@ static void pt_EffectsPass2(MODULE *mod)
 {
 	SWORD channel;
 	MP_CONTROL *a;
-	UBYTE c;
+	UBYTE c, n;
 
 	for (channel=0;channel<mod->numchn;channel++) {
 		a=&mod->control[channel];
 
 		if (!a->row) continue;
 		UniSetRow(a->row);
+		if (a->fxrow != a->row)
+			pt_compileeffects(a);
 
-		while((c=UniGetByte()) != 0)
-			if (c==UNI_ITEFFECTS0) {
+		for (n=0;n<a->fxcount;n++)
+			if (a->fxop[n]==UNI_ITEFFECTS0) {
+				UniSetRowPos(a->fxpc[n]);
 				c=UniGetByte();
 				if ((c>>4)==SS_S7EFFECTS)
 					DoNNAEffects(mod, a, c&0xf);
-			} else
-				UniSkipOpcode();
+			}
 	}
 }
 
@@ -3423,6 +3553,7 @@ static void Player_Init_internal(MODULE* mod)
 	for (t=0;t<mod->numchn;t++) {
 		mod->control[t].main.chanvol=mod->chanvol[t];
 		mod->control[t].main.panning=mod->panning[t];
+		mod->control[t].main.cutoff=127;
 	}
 
 	mod->sngtime=0;
@@ -3555,6 +3686,7 @@ void Player_Stop_internal(void)
 	if (!md_sfxchn) MikMod_DisableOutput_internal();
 	if (pf) pf->forbid=1;
 	pf=NULL;
+	Player_PublishVoices_internal();
 }
 
 MIKMODAPI void Player_Stop(void)
@@ -3884,6 +4016,77 @@ MIKMODAPI int Player_QueryVoices(UWORD numvoices, VOICEINFO *vinfo)
 	return numvoices;
 }
 
+/*========== Voice state snapshot */
+
+/* The voice states are copied once per mixed buffer into one half of a
+   double buffer, then the sequence number is bumped. Readers copy the
+   other half and retry if the sequence moved meanwhile, so polling the
+   voices never waits for the mixer. */
+
+#define MAXSTATES 256
+
+#if defined(__GNUC__)
+#define STATE_BARRIER() __sync_synchronize()
+#else
+#define STATE_BARRIER()
+#endif
+
+static VOICESTATE vstates[2][MAXSTATES];
+static int vstatecount[2];
+static volatile ULONG vstateseq;
+
+/* Called with the vars mutex held */
+void Player_PublishVoices_internal(void)
+{
+	VOICESTATE *vs;
+	MP_CHANNEL *c;
+	int t,n;
+
+	n=(pf&&pf->voice)?NUMVOICES(pf):0;
+	if (n>MAXSTATES) n=MAXSTATES;
+
+	vs=vstates[(vstateseq+1)&1];
+	for (t=0;t<n;t++,vs++) {
+		c=&pf->voice[t].main;
+		if (!c->s || md_driver->VoiceStopped(t)) {
+			memset(vs,0,sizeof(VOICESTATE));
+			vs->sample=vs->instrument=-1;
+			continue;
+		}
+		vs->sample=c->s-pf->samples;
+		vs->instrument=((pf->flags&UF_INST)&&c->i)?c->i-pf->instruments:-1;
+		vs->note=c->note;
+		vs->volume=md_driver->VoiceGetVolume(t);
+		vs->panning=md_driver->VoiceGetPanning(t);
+		vs->frequency=md_driver->VoiceGetFrequency(t);
+		vs->position=md_driver->VoiceGetPosition?md_driver->VoiceGetPosition(t):-1;
+	}
+	vstatecount[(vstateseq+1)&1]=n;
+
+	STATE_BARRIER();
+	vstateseq++;
+}
+
+/* Copies the state of count voices starting at first, as of the last
+   mixed buffer, without taking the mutex. Returns the number copied. */
+MIKMODAPI int Player_GetVoiceStates(VOICESTATE *vstate,int first,int count)
+{
+	ULONG seq;
+	int n;
+
+	do {
+		seq=vstateseq;
+		STATE_BARRIER();
+		n=vstatecount[seq&1]-first;
+		n=(n<0)?0:(n>count)?count:n;
+		if (n)
+			memcpy(vstate,&vstates[seq&1][first],n*sizeof(VOICESTATE));
+		STATE_BARRIER();
+	} while (seq!=vstateseq);
+
+	return n;
+}
+
 /* Get current module order */
 MIKMODAPI int Player_GetOrder(void)
 {
@@ -185,6 +185,19 @@ void UniSkipOpcode(void)
 	}
 }
 
+/* Returns the position of the programcounter in the current row */
+UBYTE UniGetRowPos(void)
+{
+	return (UBYTE)(rowpc-rowstart);
+}
+
+/* Moves the programcounter to a position previously returned by
+   UniGetRowPos() */
+void UniSetRowPos(UBYTE pos)
+{
+	rowpc = rowstart+pos;
+}
+
 /* Finds the address of row number 'row' in the UniMod(tm) stream 't' returns
    NULL if the row can't be found. */
 UBYTE *UniFindRow(UBYTE* t,UWORD row)
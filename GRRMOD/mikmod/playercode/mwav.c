@@ -141,7 +141,8 @@ static SAMPLE* Sample_LoadGeneric_internal_wav(MREADER* reader)
 				_mm_errno=MMERR_UNKNOWN_WAVE_TYPE;
 				return NULL;
 			}
-			if(!(si=(SAMPLE*)MikMod_malloc(sizeof(SAMPLE)))) return NULL;
+			if(!(si=(SAMPLE*)MikMod_calloc(1,sizeof(SAMPLE)))) return NULL;
+			si->panning = PAN_CENTER;
 			si->speed  = wh.nSamplesPerSec/wh.nChannels;
 			si->volume = 64;
 			si->length = len;
@@ -172,7 +173,7 @@ static SAMPLE* Sample_LoadRawGeneric_internal(MREADER* reader, ULONG rate, ULONG
 	long len;
 	int samp_size=1;
 
-	if(!(si=(SAMPLE*)MikMod_malloc(sizeof(SAMPLE)))) return NULL;
+	if(!(si=(SAMPLE*)MikMod_calloc(1,sizeof(SAMPLE)))) return NULL;
 
 	/* length */
 	_mm_fseek(reader, 0, SEEK_END);
@@ -353,6 +354,7 @@ MIKMODAPI SAMPLE* Sample_Load(const CHAR* filename)
 MIKMODAPI void Sample_Free(SAMPLE* si)
 {
 	if(si) {
+		Sample_StopVoices_internal(si);
 		if (si->onfree) si->onfree(si->ctx);
 		MD_SampleUnload(si->handle);
 		MikMod_free(si);
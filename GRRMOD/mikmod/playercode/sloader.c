@@ -40,6 +40,8 @@ static	SWORD sl_old;
 static	SWORD *sl_buffer=NULL;
 static	SAMPLOAD *musiclist=NULL,*sndfxlist=NULL;
 
+MREADER *sl_streamreader=NULL;
+
 /* size of the loader buffer in words */
 #define SLBUFSIZE 2048
 
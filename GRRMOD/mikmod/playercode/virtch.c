@@ -1134,6 +1134,9 @@ static void AddChannel(SLONG* ptr,NATIVE todo)
 #define VC1_VoiceGetPosition VC_VoiceGetPosition
 #define VC1_VoiceGetVolume VC_VoiceGetVolume
 #define VC1_VoiceRealVolume VC_VoiceRealVolume
+#define VC1_VoiceSetFilter VC_VoiceSetFilter
+#define VC1_GetMeters VC_GetMeters
+#define VC1_GetSampleStats VC_GetSampleStats
 #define VC1_VoiceSetFrequency VC_VoiceSetFrequency
 #define VC1_VoiceSetPanning VC_VoiceSetPanning
 #define VC1_VoiceSetVolume VC_VoiceSetVolume
@@ -1344,4 +1347,16 @@ int VC1_SetNumVoices(void)
 	return 0;
 }
 
+/* The standard mixer has no resonant filters */
+void VC1_VoiceSetFilter(UBYTE voice,UBYTE cutoff,UBYTE resonance)
+{
+}
+
+/* ...and no level meters */
+int VC1_GetMeters(MMETER* voices,int first,int count,MMETER* output)
+{
+	if(output) memset(output,0,sizeof(MMETER));
+	return 0;
+}
+
 /* ex:set ts=4: */
@@ -39,9 +39,22 @@
 #include <memory.h>
 #endif
 #include <string.h>
+#include <math.h>
 
 #include "mikmod_internals.h"
 
+/* Voices can be mixed by several threads when the platform has POSIX threads,
+   see the "Mixer threads" section below. */
+#if defined(HAVE_PTHREAD) && defined(__GNUC__) && !defined(NO_MIXER_THREADS)
+#define HAVE_MIXER_THREADS
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#define MIXER_LOCAL __thread
+#else
+#define MIXER_LOCAL
+#endif
+
 /*
    Constant Definitions
    ====================
@@ -52,17 +65,14 @@
 		quieter mixing.  Smaller numbers will increase the likeliness of
 		distortion on loud modules.
 
-	REVERBERATION
-		Larger numbers result in shorter reverb duration. Longer reverb
-		durations can cause unwanted static and make the reverb sound more
-		like a crappy echo.
-
-	SAMPLING_SHIFT
-		Specified the shift multiplier which controls by how much the mixing
-		rate is multiplied while mixing.  Higher values can improve quality by
-		smoothing the sound and reducing pops and clicks. Note, this is a shift
-		value, so a value of 2 becomes a mixing-rate multiplier of 4, and a
-		value of 3 = 8, etc.
+	MAX_SAMPLING_SHIFT
+		Specified the largest shift multiplier which controls by how much the
+		mixing rate is multiplied while mixing.  Higher values can improve
+		quality by smoothing the sound and reducing pops and clicks. Note, this
+		is a shift value, so a value of 2 becomes a mixing-rate multiplier of
+		4. The shift actually used is taken from md_oversampling at the start
+		of every tick, and the mix is brought back to the output rate by one
+		half-band filter per step.
 
 	FRACBITS
 		The number of bits per integer devoted to the fractional part of the
@@ -74,9 +84,9 @@
 
 #define BITSHIFT 9
 #define MAXVOL_FACTOR (1<<BITSHIFT)
-#define	REVERBERATION 11000L
 
-#define SAMPLING_SHIFT 2
+#define MAX_SAMPLING_SHIFT 2
+#define SAMPLING_SHIFT vc_samplingshift
 #define SAMPLING_FACTOR (1UL<<SAMPLING_SHIFT)
 
 #define	FRACBITS 28
@@ -97,6 +107,7 @@
 typedef struct VINFO {
 	UBYTE     kick;              /* =1 -> sample has to be restarted */
 	UBYTE     active;            /* =1 -> sample is playing */
+	UBYTE     virt;              /* !=0 -> sample is followed but not mixed */
 	UWORD     flags;             /* 16/8 bits looping/one-shot */
 	SWORD     handle;            /* identifies the sample */
 	ULONG     start;             /* start index */
@@ -113,54 +124,112 @@ typedef struct VINFO {
 	int       lvolsel,rvolsel;   /* Volume factor in range 0-255 */
 	int       oldlvol,oldrvol;
 
+	/* the same for the float mixers, scaled to the output range */
+	float     lastfL,lastfR;
+	float     lgain,rgain;
+	float     oldlgain,oldrgain;
+
 	SLONGLONG current;           /* current index in the sample */
 	SLONGLONG increment;         /* increment value */
+
+	/* resonant filter, see SetupFilter */
+	UBYTE     cutoff,resonance;  /* 0-127, the filter is off at 127 and 0 */
+	UBYTE     filter;            /* the filter is on */
+	UBYTE     fltcutoff,fltres;  /* settings the coefficients were made for */
+	ULONG     fltrate;           /* ...and the mixing rate */
+	SLONG     fa,fb,fc;          /* coefficients, FLTBITS fixed point */
+	SLONG     fy1,fy2;           /* last two outputs, FLTSTATE fixed point */
+	float     ffa,ffb,ffc;       /* the same for the float mixers */
+	float     ffy1,ffy2;
+
+	/* level meter, see MeterVoice */
+	float     mpeakl,mpeakr;     /* peak levels in the output range */
+	float     msuml,msumr;       /* sums of the squared levels */
+	ULONG     mtaps;             /* samples measured */
+	SLONG     mphase;            /* samples to the next measured one */
+
+	/* window of a compressed sample, see MixCompressed */
+	SLONG     wstart,wend;       /* samples it holds, none if wend is 0 */
+
+	/* block mixing, see VC2_WriteSamples */
+	UBYTE     wasactive;         /* active when the events were last recorded */
+	SWORD     firstev,lastev;    /* events of the voice in the current block */
 } VINFO;
 
+/* Voice parameters handed from the player to the mixer */
+typedef struct VCTRL {
+	UWORD     flags;
+	SWORD     handle;
+	ULONG     start;
+	ULONG     size;
+	ULONG     reppos;
+	ULONG     repend;
+	ULONG     frq;
+	int       vol;
+	int       pan;
+	UBYTE     virt;
+	UBYTE     cutoff,resonance;
+} VCTRL;
+
+#define EV_KICK 1 /* the sample is restarted */
+#define EV_STOP 2 /* the voice is stopped */
+#define EV_RAMP 4 /* the volume changes are ramped */
+
+typedef struct VEVENT {
+	VCTRL     ctl;               /* parameters from this offset on */
+	ULONG     offset;            /* output sample in the block */
+	UBYTE     what;              /* EV_xxx flags */
+	SWORD     next;              /* next event of the same voice, or -1 */
+} VEVENT;
+
+#define MAXEVENTS 1024
+
 static	SWORD **Samples;
-static	VINFO *vinf=NULL,*vnf;
+static	UBYTE vc_smp8[MAXSAMPLEHANDLES]; /* the handle is kept in 8 bit */
+static	ULONG vc_adpcm[MAXSAMPLEHANDLES];/* samples of a compressed handle */
+static	VINFO *vinf=NULL,*vmix;
+static	VEVENT vc_events[MAXEVENTS];
+static	int vc_numevents;
 static	long tickleft,samplesthatfit,vc_memory=0;
 static	int vc_softchn;
-static	SLONGLONG idxsize,idxlpos,idxlend;
+
+/* the voice being mixed, which is per thread */
+static	MIXER_LOCAL VINFO *vnf;
+static	MIXER_LOCAL SLONGLONG idxsize,idxlpos,idxlend;
 static	SLONG *vc_tickbuf=NULL;
 static	UWORD vc_mode;
+static	int vc_samplingshift=MAX_SAMPLING_SHIFT;
 
 #ifdef _MSC_VER
 /* Weird bug in compiler */ /* FIXME is this still needed? */
 typedef void (*MikMod_callback_t)(unsigned char *data, size_t len);
 #endif
 
-/* Reverb control variables */
-
-static	int RVc1, RVc2, RVc3, RVc4, RVc5, RVc6, RVc7, RVc8;
-static	ULONG RVRindex;
-
-/* For Mono or Left Channel */
-static	SLONG *RVbufL1=NULL,*RVbufL2=NULL,*RVbufL3=NULL,*RVbufL4=NULL,
-		      *RVbufL5=NULL,*RVbufL6=NULL,*RVbufL7=NULL,*RVbufL8=NULL;
-
-/* For Stereo only (Right Channel) */
-static	SLONG *RVbufR1=NULL,*RVbufR2=NULL,*RVbufR3=NULL,*RVbufR4=NULL,
-		      *RVbufR5=NULL,*RVbufR6=NULL,*RVbufR7=NULL,*RVbufR8=NULL;
-
 #ifdef NATIVE_64BIT_INT
 #define NATIVE SLONGLONG
 #else
 #define NATIVE SLONG
 #endif
 
+/* Reads sample t of srce. The samples of a handle are kept in 8 bit when
+   they were loaded from 8 bit data, and are scaled to the 16 bit range as
+   they are read, exactly like SL_Sample8to16 would have converted them. The
+   mixers take bits8 as a constant, so that each width gets its own loop. */
+#define FETCH(srce,t) \
+	((bits8)?((const SBYTE*)(srce))[t]*256:((const SWORD*)(srce))[t])
+
 /*========== 32 bit sample mixers - only for 32 bit platforms */
 #ifndef NATIVE_64BIT_INT
 
-static SLONG Mix32MonoNormal(const SWORD* const srce,SLONG* dest,SLONG idx,SLONG increment,SLONG todo)
+static __inline SLONG Mix32MonoKernel(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,SLONG todo,int bits8)
 {
 	SWORD sample=0;
 	SLONG i,f;
 
 	while(todo--) {
 		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)( (((SLONG)(srce[i]*(FRACMASK+1L-f)) +
-		        ((SLONG)srce[i+1]*f)) >> FRACBITS));
+		sample=(SWORD)( (((SLONG)(FETCH(srce,i)*(FRACMASK+1L-f)) +
+		        ((SLONG)FETCH(srce,i+1)*f)) >> FRACBITS));
 		idx+=increment;
 
 		if(vnf->rampvol) {
@@ -184,15 +253,21 @@ static SLONG Mix32MonoNormal(const SWORD* const srce,SLONG* dest,SLONG idx,SLONG
 	return idx;
 }
 
-static SLONG Mix32StereoNormal(const SWORD* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo)
+static SLONG Mix32MonoNormal(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,SLONG todo,int bits8)
+{
+	return bits8?Mix32MonoKernel(srce,dest,idx,increment,todo,1):
+	             Mix32MonoKernel(srce,dest,idx,increment,todo,0);
+}
+
+static __inline SLONG Mix32StereoKernel(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8)
 {
 	SWORD sample=0;
 	SLONG i,f;
 
 	while(todo--) {
 		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)(((((SLONG)srce[i]*(FRACMASK+1L-f)) +
-		        ((SLONG)srce[i+1] * f)) >> FRACBITS));
+		sample=(SWORD)(((((SLONG)FETCH(srce,i)*(FRACMASK+1L-f)) +
+		        ((SLONG)FETCH(srce,i+1) * f)) >> FRACBITS));
 		idx += increment;
 
 		if(vnf->rampvol) {
@@ -227,7 +302,13 @@ static SLONG Mix32StereoNormal(const SWORD* const srce,SLONG* dest,SLONG idx,SLO
 	return idx;
 }
 
-static SLONG Mix32StereoSurround(const SWORD* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo)
+static SLONG Mix32StereoNormal(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8)
+{
+	return bits8?Mix32StereoKernel(srce,dest,idx,increment,todo,1):
+	             Mix32StereoKernel(srce,dest,idx,increment,todo,0);
+}
+
+static __inline SLONG Mix32SurroundKernel(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8)
 {
 	SWORD sample=0;
 	long whoop;
@@ -235,8 +316,8 @@ static SLONG Mix32StereoSurround(const SWORD* const srce,SLONG* dest,SLONG idx,S
 
 	while(todo--) {
 		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)(((((SLONG)srce[i]*(FRACMASK+1L-f)) +
-			((SLONG)srce[i+1]*f)) >> FRACBITS));
+		sample=(SWORD)(((((SLONG)FETCH(srce,i)*(FRACMASK+1L-f)) +
+			((SLONG)FETCH(srce,i+1)*f)) >> FRACBITS));
 		idx+=increment;
 
 		if(vnf->rampvol) {
@@ -266,19 +347,25 @@ static SLONG Mix32StereoSurround(const SWORD* const srce,SLONG* dest,SLONG idx,S
 
 	return idx;
 }
+
+static SLONG Mix32StereoSurround(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8)
+{
+	return bits8?Mix32SurroundKernel(srce,dest,idx,increment,todo,1):
+	             Mix32SurroundKernel(srce,dest,idx,increment,todo,0);
+}
 #endif
 
 /*========== 64 bit mixers */
 
-static SLONGLONG MixMonoNormal(const SWORD* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,SLONG todo)
+static __inline SLONGLONG MixMonoKernel(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,SLONG todo,int bits8)
 {
 	SWORD sample=0;
 	SLONGLONG i,f;
 
 	while(todo--) {
 		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)((((SLONGLONG)(srce[i]*(FRACMASK+1L-f)) +
-			((SLONGLONG)srce[i+1]*f)) >> FRACBITS));
+		sample=(SWORD)((((SLONGLONG)(FETCH(srce,i)*(FRACMASK+1L-f)) +
+			((SLONGLONG)FETCH(srce,i+1)*f)) >> FRACBITS));
 		idx+=increment;
 
 		if(vnf->rampvol) {
@@ -302,221 +389,21 @@ static SLONGLONG MixMonoNormal(const SWORD* const srce,SLONG* dest,SLONGLONG idx
 	return idx;
 }
 
-/* Slowest part... */
-
-#if defined HAVE_SSE2 || defined HAVE_ALTIVEC
-
-static __inline SWORD GetSample(const SWORD* const srce, SLONGLONG idx)
-{
-	SLONGLONG i=idx>>FRACBITS;
-	SLONGLONG f=idx&FRACMASK;
-	return (SWORD)(((((SLONGLONG)srce[i]*(FRACMASK+1L-f)) +
-				((SLONGLONG)srce[i+1] * f)) >> FRACBITS));
-}
-
-static SLONGLONG MixSIMDStereoNormal(const SWORD* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo)
-{
-	SWORD vol[8] = {vnf->lvolsel, vnf->rvolsel};
-	SWORD sample=0;
-	SLONG remain = todo;
-
-	/* Dest can be misaligned */
-	while(!IS_ALIGNED_16(dest)) {
-		sample=srce[idx >> FRACBITS];
-		idx += increment;
-		*dest++ += vol[0] * sample;
-		*dest++ += vol[1] * sample;
-		todo--;
-		if(!todo) goto end;
-	}
-
-	/* Srce is always aligned */
-
-#if defined HAVE_SSE2
-	remain = todo&3;
-	{
-		__m128i v0 = _mm_set_epi16(0, vol[1],
-					   0, vol[0],
-					   0, vol[1],
-					   0, vol[0]);
-		for(todo>>=2;todo; todo--)
-		{
-			SWORD s0 = GetSample(srce, idx);
-			SWORD s1 = GetSample(srce, idx += increment);
-			SWORD s2 = GetSample(srce, idx += increment);
-			SWORD s3 = GetSample(srce, idx += increment);
-			__m128i v1 = _mm_set_epi16(0, s1, 0, s1, 0, s0, 0, s0);
-			__m128i v2 = _mm_set_epi16(0, s3, 0, s3, 0, s2, 0, s2);
-			__m128i v3 = _mm_load_si128((__m128i*)(dest+0));
-			__m128i v4 = _mm_load_si128((__m128i*)(dest+4));
-			_mm_store_si128((__m128i*)(dest+0), _mm_add_epi32(v3, _mm_madd_epi16(v0, v1)));
-			_mm_store_si128((__m128i*)(dest+4), _mm_add_epi32(v4, _mm_madd_epi16(v0, v2)));
-			dest+=8;
-			idx += increment;
-		}
-	}
-
-#elif defined HAVE_ALTIVEC
-	remain = todo&3;
-	{
-		SWORD s[8];
-		vector signed short r0 = vec_ld(0, vol);
-		vector signed short v0 = vec_perm(r0, r0, (vector unsigned char)(0, 1, /* l */
-										 0, 1, /* l */
-										 2, 3, /* r */
-										 2, 1, /* r */
-										 0, 1, /* l */
-										 0, 1, /* l */
-										 2, 3, /* r */
-										 2, 3  /* r */
-										 ));
-
-		for(todo>>=2;todo; todo--)
-		{
-			vector short int r1;
-			vector signed short v1, v2;
-			vector signed int v3, v4, v5, v6;
-
-			/* Load constants */
-			s[0] = GetSample(srce, idx);
-			s[1] = GetSample(srce, idx += increment);
-			s[2] = GetSample(srce, idx += increment);
-			s[3] = GetSample(srce, idx += increment);
-			s[4] = 0;
-
-			r1 = vec_ld(0, s);
-			v1 = vec_perm(r1, r1, (vector unsigned char)
-								(0*2, 0*2+1, /* s0 */
-								 4*2, 4*2+1, /* 0  */
-								 0*2, 0*2+1, /* s0 */
-								 4*2, 4*2+1, /* 0  */
-								 1*2, 1*2+1, /* s1 */
-								 4*2, 4*2+1, /* 0  */
-								 1*2, 1*2+1, /* s1 */
-								 4*2, 4*2+1  /* 0  */
-								) );
-			v2 = vec_perm(r1, r1, (vector unsigned char)
-								(2*2, 2*2+1, /* s2 */
-								 4*2, 4*2+1, /* 0  */
-								 2*2, 2*2+1, /* s2 */
-								 4*2, 4*2+1, /* 0  */
-								 3*2, 3*2+1, /* s3 */
-								 4*2, 4*2+1, /* 0  */
-								 3*2, 3*2+1, /* s3 */
-								 4*2, 4*2+1  /* 0  */
-								) );
-
-			v3 = vec_ld(0, dest);
-			v4 = vec_ld(0x10, dest);
-			v5 = vec_mule(v0, v1);
-			v6 = vec_mule(v0, v2);
-
-			vec_st(vec_add(v3, v5), 0, dest);
-			vec_st(vec_add(v4, v6), 0x10, dest);
-
-			dest+=8;
-			idx += increment;
-		}
-	}
-#endif /* HAVE_ALTIVEC */
-
-	/* Remaining bits */
-	while(remain--) {
-		sample=GetSample(srce, idx);
-		idx+= increment;
-		*dest++ += vol[0] * sample;
-		*dest++ += vol[1] * sample;
-	}
-end:
-	vnf->lastvalL=vnf->lvolsel*sample;
-	vnf->lastvalR=vnf->rvolsel*sample;
-	return idx;
-}
-
-static SLONGLONG MixStereoNormal(const SWORD* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo)
+static SLONGLONG MixMonoNormal(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,SLONG todo,int bits8)
 {
-	SWORD sample=0;
-	SLONGLONG i,f;
-
-	if (vnf->rampvol)
-	while(todo) {
-		todo--;
-		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)(((((SLONGLONG)srce[i]*(FRACMASK+1L-f)) +
-			((SLONGLONG)srce[i+1] * f)) >> FRACBITS));
-		idx += increment;
-
-		*dest++ += (long)(
-			( ( ((SLONGLONG)vnf->oldlvol*vnf->rampvol) +
-			    (vnf->lvolsel*(CLICK_BUFFER-vnf->rampvol))
-			) * (SLONGLONG)sample ) >> CLICK_SHIFT );
-		*dest++ += (long)(
-			( ( ((SLONGLONG)vnf->oldrvol*vnf->rampvol) +
-			    (vnf->rvolsel*(CLICK_BUFFER-vnf->rampvol))
-			) * (SLONGLONG)sample ) >> CLICK_SHIFT );
-		vnf->rampvol--;
-
-		if (!vnf->rampvol)
-			break;
-	}
-
-	if (vnf->click)
-	while(todo) {
-		todo--;
-		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)(((((SLONGLONG)srce[i]*(FRACMASK+1L-f)) +
-			((SLONGLONG)srce[i+1] * f)) >> FRACBITS));
-		idx += increment;
-
-		*dest++ += (long)(
-			  ( ( (SLONGLONG)(vnf->lvolsel*(CLICK_BUFFER-vnf->click)) *
-			      (SLONGLONG)sample ) + (vnf->lastvalL * vnf->click) )
-			    >> CLICK_SHIFT );
-
-		*dest++ += (long)(
-			  ( ( ((SLONGLONG)vnf->rvolsel*(CLICK_BUFFER-vnf->click)) *
-			      (SLONGLONG)sample ) + (vnf->lastvalR * vnf->click) )
-			    >> CLICK_SHIFT );
-			vnf->click--;
-
-		if (!vnf->click)
-			break;
-	}
-
-	if (todo)
-	{
-		if (md_mode & DMODE_SIMDMIXER) {
-			return MixSIMDStereoNormal(srce, dest, idx, increment, todo);
-		}
-		while(todo)
-		{
-			i=idx>>FRACBITS,
-			f=idx&FRACMASK;
-			sample=(SWORD)(((((SLONGLONG)srce[i]*(FRACMASK+1L-f)) +
-							((SLONGLONG)srce[i+1] * f)) >> FRACBITS));
-			idx += increment;
-
-			*dest++ +=vnf->lvolsel*sample;
-			*dest++ +=vnf->rvolsel*sample;
-			todo--;
-		}
-	}
-	vnf->lastvalL=vnf->lvolsel*sample;
-	vnf->lastvalR=vnf->rvolsel*sample;
-
-	return idx;
+	return bits8?MixMonoKernel(srce,dest,idx,increment,todo,1):
+	             MixMonoKernel(srce,dest,idx,increment,todo,0);
 }
 
-#else /* HAVE_SSE2 || HAVE_ALTIVEC */
-static SLONGLONG MixStereoNormal(const SWORD* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo)
+static __inline SLONGLONG MixStereoKernel(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
 {
 	SWORD sample=0;
 	SLONGLONG i,f;
 
 	while(todo--) {
 		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)(((((SLONGLONG)srce[i]*(FRACMASK+1L-f)) +
-			((SLONGLONG)srce[i+1] * f)) >> FRACBITS));
+		sample=(SWORD)(((((SLONGLONG)FETCH(srce,i)*(FRACMASK+1L-f)) +
+			((SLONGLONG)FETCH(srce,i+1) * f)) >> FRACBITS));
 		idx += increment;
 
 		if(vnf->rampvol) {
@@ -550,10 +437,14 @@ static SLONGLONG MixStereoNormal(const SWORD* const srce,SLONG* dest,SLONGLONG i
 
 	return idx;
 }
-#endif /* HAVE_SSE2 || HAVE_ALTIVEC */
 
+static SLONGLONG MixStereoNormal(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
+{
+	return bits8?MixStereoKernel(srce,dest,idx,increment,todo,1):
+	             MixStereoKernel(srce,dest,idx,increment,todo,0);
+}
 
-static SLONGLONG MixStereoSurround(const SWORD* srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo)
+static __inline SLONGLONG MixSurroundKernel(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
 {
 	SWORD sample=0;
 	long whoop;
@@ -561,8 +452,8 @@ static SLONGLONG MixStereoSurround(const SWORD* srce,SLONG* dest,SLONGLONG idx,S
 
 	while(todo--) {
 		i=idx>>FRACBITS,f=idx&FRACMASK;
-		sample=(SWORD)(((((SLONGLONG)srce[i]*(FRACMASK+1L-f)) +
-			((SLONGLONG)srce[i+1]*f)) >> FRACBITS));
+		sample=(SWORD)(((((SLONGLONG)FETCH(srce,i)*(FRACMASK+1L-f)) +
+			((SLONGLONG)FETCH(srce,i+1)*f)) >> FRACBITS));
 		idx+=increment;
 
 		if(vnf->rampvol) {
@@ -593,422 +484,2060 @@ static SLONGLONG MixStereoSurround(const SWORD* srce,SLONG* dest,SLONGLONG idx,S
 	return idx;
 }
 
-static	void(*Mix32toFP)(float* dste,const SLONG *srce,NATIVE count);
-static	void(*Mix32to16)(SWORD* dste,const SLONG *srce,NATIVE count);
-static	void(*Mix32to8)(SBYTE* dste,const SLONG *srce,NATIVE count);
-static	void(*MixReverb)(SLONG *srce,NATIVE count);
-
-/* Reverb macros */
-#define COMPUTE_LOC(n) loc##n = RVRindex % RVc##n
-#define COMPUTE_LECHO(n) RVbufL##n [loc##n ]=speedup+((ReverbPct*RVbufL##n [loc##n ])>>7)
-#define COMPUTE_RECHO(n) RVbufR##n [loc##n ]=speedup+((ReverbPct*RVbufR##n [loc##n ])>>7)
-
-static void MixReverb_Normal(SLONG *srce,NATIVE count)
+static SLONGLONG MixStereoSurround(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
 {
-	NATIVE speedup;
-	int ReverbPct;
-	unsigned int loc1,loc2,loc3,loc4,loc5,loc6,loc7,loc8;
+	return bits8?MixSurroundKernel(srce,dest,idx,increment,todo,1):
+	             MixSurroundKernel(srce,dest,idx,increment,todo,0);
+}
 
-	ReverbPct=58+(md_reverb*4);
+/*========== Vector mixers */
 
-	COMPUTE_LOC(1); COMPUTE_LOC(2); COMPUTE_LOC(3); COMPUTE_LOC(4);
-	COMPUTE_LOC(5); COMPUTE_LOC(6); COMPUTE_LOC(7); COMPUTE_LOC(8);
+/* The vector mixers use the generic vector extensions of the compiler, which
+   are lowered to whatever SIMD unit the target has (SSE2, AVX2, NEON,
+   AltiVec), or to plain scalar code on targets without one. They produce
+   exactly the same output as the scalar mixers above: tools/mixcheck checks
+   this on the host, the 32 bit mixers only when it is built for 32 bit. */
+#if (defined __GNUC__ && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))) || \
+     defined __clang__
+#define HAVE_VECTOR_MIXER
+#endif
 
-	while(count--) {
-		/* Compute the left channel echo buffers */
-		speedup = *srce >> 3;
+#ifdef HAVE_VECTOR_MIXER
+
+typedef SLONG vslong __attribute__((vector_size(16)));
+typedef ULONG vulong __attribute__((vector_size(16)));
+typedef float vfloat __attribute__((vector_size(16)));
+
+#define VSPLAT(x) ((vslong){(x),(x),(x),(x)})
+
+/* the same, for buffers which are not always 16 byte aligned */
+typedef SLONG vslong_ua __attribute__((vector_size(16),aligned(4)));
+typedef float vfloat_ua __attribute__((vector_size(16),aligned(4)));
+
+/* Output layouts */
+#define VMIX_MONO     0
+#define VMIX_STEREO   1
+#define VMIX_SURROUND 2
+
+/* Interpolation flavours. The 64 bit mixers interpolate exactly, while the
+   32 bit mixers wrap around in 32 bit arithmetic, and the stereo ones shift
+   the unsigned result. */
+#define VINTERP_EXACT 0
+#define VINTERP_WRAP  1
+#define VINTERP_WRAPU 2
+
+/* Mixing phases, in the order the scalar mixers go through them */
+#define VPHASE_RAMP   0
+#define VPHASE_CLICK  1
+#define VPHASE_NORMAL 2
+
+/* The vector mixers compute the volume ramps in 32 bit lanes, which is only
+   exact when the volumes stay in the range the player uses. */
+#define VOLFITS(v) ((ULONG)(v)<=256)
+#define LASTFITS(v) (((v)>=-256L*32768L)&&((v)<=256L*32767L))
+#define VOLUMES_FIT(v) \
+	((!(v)->rampvol && !(v)->click) || \
+	 (VOLFITS((v)->lvolsel) && VOLFITS((v)->rvolsel) && \
+	  VOLFITS((v)->oldlvol) && VOLFITS((v)->oldrvol) && \
+	  LASTFITS((v)->lastvalL) && LASTFITS((v)->lastvalR)))
+
+static __inline vslong VLoad(const SLONG* p)
+{
+	vslong v;
 
-		COMPUTE_LECHO(1); COMPUTE_LECHO(2); COMPUTE_LECHO(3); COMPUTE_LECHO(4);
-		COMPUTE_LECHO(5); COMPUTE_LECHO(6); COMPUTE_LECHO(7); COMPUTE_LECHO(8);
+	memcpy(&v,p,sizeof(v));
+	return v;
+}
 
-		/* Prepare to compute actual finalized data */
-		RVRindex++;
+static __inline void VStore(SLONG* p,vslong v)
+{
+	memcpy(p,&v,sizeof(v));
+}
 
-		COMPUTE_LOC(1); COMPUTE_LOC(2); COMPUTE_LOC(3); COMPUTE_LOC(4);
-		COMPUTE_LOC(5); COMPUTE_LOC(6); COMPUTE_LOC(7); COMPUTE_LOC(8);
+static __inline SLONG GetSample(const void* const srce,SLONGLONG idx,int interp,int bits8)
+{
+	SLONGLONG i=idx>>FRACBITS;
+	SLONG f=(SLONG)(idx&FRACMASK);
+	ULONG u;
+
+	if(interp==VINTERP_EXACT)
+		return (SWORD)((((SLONGLONG)FETCH(srce,i)*((1L<<FRACBITS)-f)) +
+		               ((SLONGLONG)FETCH(srce,i+1)*f)) >> FRACBITS);
+
+	u=(ULONG)(SLONG)FETCH(srce,i)*(ULONG)((1L<<FRACBITS)-f)+
+	  (ULONG)(SLONG)FETCH(srce,i+1)*(ULONG)f;
+	if(interp==VINTERP_WRAP)
+		return (SWORD)((SLONG)u>>FRACBITS);
+	return (SWORD)(u>>FRACBITS);
+}
 
-		/* left channel */
-		*srce++ +=RVbufL1[loc1]-RVbufL2[loc2]+RVbufL3[loc3]-RVbufL4[loc4]+
-			  RVbufL5[loc5]-RVbufL6[loc6]+RVbufL7[loc7]-RVbufL8[loc8];
+/* Interpolates four consecutive samples. The exact flavour splits the 28 bit
+   fraction in two halves so that the products fit in 32 bit lanes:
+   floor(d*f/2^28) == floor((d*fh+floor(d*fl/2^14))/2^14). */
+static __inline vslong GetSamples(const void* const srce,SLONGLONG idx,SLONGLONG increment,int interp,int bits8)
+{
+	SLONGLONG i0=idx,i1=i0+increment,i2=i1+increment,i3=i2+increment;
+	vslong s0,s1,f;
+	vulong u;
+
+	s0=(vslong){FETCH(srce,i0>>FRACBITS),FETCH(srce,i1>>FRACBITS),
+	            FETCH(srce,i2>>FRACBITS),FETCH(srce,i3>>FRACBITS)};
+	s1=(vslong){FETCH(srce,(i0>>FRACBITS)+1),FETCH(srce,(i1>>FRACBITS)+1),
+	            FETCH(srce,(i2>>FRACBITS)+1),FETCH(srce,(i3>>FRACBITS)+1)};
+	f=(vslong){(SLONG)(i0&FRACMASK),(SLONG)(i1&FRACMASK),
+	           (SLONG)(i2&FRACMASK),(SLONG)(i3&FRACMASK)};
+
+	if(interp==VINTERP_EXACT) {
+		s1-=s0;
+		return s0+((s1*(f>>14)+((s1*(f&0x3fff))>>14))>>14);
 	}
+
+	u=(vulong)s0*(vulong)(VSPLAT(1L<<FRACBITS)-f)+(vulong)s1*(vulong)f;
+	if(interp==VINTERP_WRAP)
+		return (vslong)u>>FRACBITS;
+	return (vslong)(u>>FRACBITS);
 }
 
-static void MixReverb_Stereo(SLONG *srce,NATIVE count)
+/* Applies the volume of the given phase to samples of frames ofs frames
+   after the current one, 'count' being the ramp or click counter */
+static __inline vslong ApplyVolume(vslong smp,vslong ofs,int phase,SLONG count,
+                                   vslong vol,vslong old,vslong last)
 {
-	NATIVE speedup;
-	int ReverbPct;
-	unsigned int loc1,loc2,loc3,loc4,loc5,loc6,loc7,loc8;
+	vslong n=VSPLAT(count)-ofs;
 
-	ReverbPct=58+(md_reverb*4);
+	if(phase==VPHASE_RAMP)
+		return ((old*n+vol*(VSPLAT(CLICK_BUFFER)-n))*smp)>>CLICK_SHIFT;
+	if(phase==VPHASE_CLICK)
+		return ((vol*(VSPLAT(CLICK_BUFFER)-n))*smp+last*n)>>CLICK_SHIFT;
+	return vol*smp;
+}
 
-	COMPUTE_LOC(1); COMPUTE_LOC(2); COMPUTE_LOC(3); COMPUTE_LOC(4);
-	COMPUTE_LOC(5); COMPUTE_LOC(6); COMPUTE_LOC(7); COMPUTE_LOC(8);
+static __inline SLONGLONG MixVector(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int layout,int interp,int bits8)
+{
+	SLONG sample=0;
+	SLONG lvol=vnf->lvolsel,lold=vnf->oldlvol,llast=vnf->lastvalL;
+	SLONG rvol=(layout==VMIX_STEREO)?vnf->rvolsel:lvol;
+	SLONG rold=(layout==VMIX_STEREO)?vnf->oldrvol:lold;
+	SLONG rlast=(layout==VMIX_STEREO)?vnf->lastvalR:llast;
+	vslong vol,old,last,sign,ofs0,ofs1,smp,lo,hi;
+	int phase,*counter;
+	ULONG n;
+
+	if(layout==VMIX_MONO) {
+		vol=VSPLAT(lvol);old=VSPLAT(lold);last=VSPLAT(llast);
+		ofs0=(vslong){0,1,2,3};
+	} else {
+		vol=(vslong){lvol,rvol,lvol,rvol};
+		old=(vslong){lold,rold,lold,rold};
+		last=(vslong){llast,rlast,llast,rlast};
+		ofs0=(vslong){0,0,1,1};
+	}
+	ofs1=ofs0+VSPLAT(2);
+	sign=(layout==VMIX_SURROUND)?(vslong){1,-1,1,-1}:VSPLAT(1);
 
-	while(count--) {
-		/* Compute the left channel echo buffers */
-		speedup = *srce >> 3;
+	for(phase=VPHASE_RAMP;phase<=VPHASE_NORMAL;phase++) {
+		counter=(phase==VPHASE_RAMP)?&vnf->rampvol:
+		        (phase==VPHASE_CLICK)?&vnf->click:NULL;
+		n=counter?MIN(todo,(ULONG)*counter):todo;
+		todo-=n;
 
-		COMPUTE_LECHO(1); COMPUTE_LECHO(2); COMPUTE_LECHO(3); COMPUTE_LECHO(4);
-		COMPUTE_LECHO(5); COMPUTE_LECHO(6); COMPUTE_LECHO(7); COMPUTE_LECHO(8);
+		for(;n>=4;n-=4) {
+			SLONG count=counter?*counter:0;
 
-		/* Compute the right channel echo buffers */
-		speedup = srce[1] >> 3;
+			smp=GetSamples(srce,idx,increment,interp,bits8);
+			idx+=increment*4;
+			sample=smp[3];
 
-		COMPUTE_RECHO(1); COMPUTE_RECHO(2); COMPUTE_RECHO(3); COMPUTE_RECHO(4);
-		COMPUTE_RECHO(5); COMPUTE_RECHO(6); COMPUTE_RECHO(7); COMPUTE_RECHO(8);
+			if(layout==VMIX_MONO) {
+				VStore(dest,VLoad(dest)+ApplyVolume(smp,ofs0,phase,count,vol,old,last));
+				dest+=4;
+			} else {
+				lo=(vslong){smp[0],smp[0],smp[1],smp[1]};
+				hi=(vslong){smp[2],smp[2],smp[3],smp[3]};
+				VStore(dest,VLoad(dest)+
+				       sign*ApplyVolume(lo,ofs0,phase,count,vol,old,last));
+				VStore(dest+4,VLoad(dest+4)+
+				       sign*ApplyVolume(hi,ofs1,phase,count,vol,old,last));
+				dest+=8;
+			}
+			if(counter) *counter-=4;
+		}
 
-		/* Prepare to compute actual finalized data */
-		RVRindex++;
+		while(n--) {
+			SLONG count=counter?*counter:0,l,r;
 
-		COMPUTE_LOC(1); COMPUTE_LOC(2); COMPUTE_LOC(3); COMPUTE_LOC(4);
-		COMPUTE_LOC(5); COMPUTE_LOC(6); COMPUTE_LOC(7); COMPUTE_LOC(8);
+			sample=GetSample(srce,idx,interp,bits8);
+			idx+=increment;
 
-		/* left channel */
-		*srce++ +=RVbufL1[loc1]-RVbufL2[loc2]+RVbufL3[loc3]-RVbufL4[loc4]+
-			  RVbufL5[loc5]-RVbufL6[loc6]+RVbufL7[loc7]-RVbufL8[loc8];
+			if(phase==VPHASE_RAMP) {
+				l=((lold*count+lvol*(CLICK_BUFFER-count))*sample)>>CLICK_SHIFT;
+				r=((rold*count+rvol*(CLICK_BUFFER-count))*sample)>>CLICK_SHIFT;
+			} else if(phase==VPHASE_CLICK) {
+				l=((lvol*(CLICK_BUFFER-count))*sample+llast*count)>>CLICK_SHIFT;
+				r=((rvol*(CLICK_BUFFER-count))*sample+rlast*count)>>CLICK_SHIFT;
+			} else {
+				l=lvol*sample;
+				r=rvol*sample;
+			}
 
-		/* right channel */
-		*srce++ +=RVbufR1[loc1]-RVbufR2[loc2]+RVbufR3[loc3]-RVbufR4[loc4]+
-			  RVbufR5[loc5]-RVbufR6[loc6]+RVbufR7[loc7]-RVbufR8[loc8];
+			*dest++ +=l;
+			if(layout==VMIX_STEREO)
+				*dest++ +=r;
+			else if(layout==VMIX_SURROUND)
+				*dest++ -=r;
+			if(counter) (*counter)--;
+		}
 	}
-}
+	vnf->lastvalL=lvol*sample;
+	if(layout!=VMIX_MONO)
+		vnf->lastvalR=rvol*sample;
 
-static void (*MixLowPass)(SLONG* srce,NATIVE count);
+	return idx;
+}
 
-static int nLeftNR, nRightNR;
+#ifndef NATIVE_64BIT_INT
+static SLONG Mix32VectorMonoNormal(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,SLONG todo,int bits8)
+{
+	if(!VOLUMES_FIT(vnf))
+		return Mix32MonoNormal(srce,dest,idx,increment,todo,bits8);
+	return bits8?(SLONG)MixVector(srce,dest,idx,increment,todo,VMIX_MONO,VINTERP_WRAP,1):
+	             (SLONG)MixVector(srce,dest,idx,increment,todo,VMIX_MONO,VINTERP_WRAP,0);
+}
 
-static void MixLowPass_Stereo(SLONG* srce,NATIVE count)
+static SLONG Mix32VectorStereoNormal(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8)
 {
-	int n1 = nLeftNR, n2 = nRightNR;
-	SLONG *pnr = srce;
-	int nr=count;
-	for (; nr; nr--)
-	{
-		int vnr = pnr[0] >> 1;
-		pnr[0] = vnr + n1;
-		n1 = vnr;
-		vnr = pnr[1] >> 1;
-		pnr[1] = vnr + n2;
-		n2 = vnr;
-		pnr += 2;
-	}
-	nLeftNR = n1;
-	nRightNR = n2;
+	if(!VOLUMES_FIT(vnf))
+		return Mix32StereoNormal(srce,dest,idx,increment,todo,bits8);
+	return bits8?(SLONG)MixVector(srce,dest,idx,increment,todo,VMIX_STEREO,VINTERP_WRAPU,1):
+	             (SLONG)MixVector(srce,dest,idx,increment,todo,VMIX_STEREO,VINTERP_WRAPU,0);
 }
 
-static void MixLowPass_Normal(SLONG* srce,NATIVE count)
+static SLONG Mix32VectorStereoSurround(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8)
 {
-	int n1 = nLeftNR;
-	SLONG *pnr = srce;
-	int nr=count;
-	for (; nr; nr--)
-	{
-		int vnr = pnr[0] >> 1;
-		pnr[0] = vnr + n1;
-		n1 = vnr;
-		pnr ++;
-	}
-	nLeftNR = n1;
+	if(!VOLUMES_FIT(vnf))
+		return Mix32StereoSurround(srce,dest,idx,increment,todo,bits8);
+	return bits8?(SLONG)MixVector(srce,dest,idx,increment,todo,VMIX_SURROUND,VINTERP_WRAPU,1):
+	             (SLONG)MixVector(srce,dest,idx,increment,todo,VMIX_SURROUND,VINTERP_WRAPU,0);
 }
+#endif
 
-/* Mixing macros */
-#define EXTRACT_SAMPLE_FP(var,attenuation) var=*srce++*((1.0f / 32768.0f) / (MAXVOL_FACTOR*attenuation))
-#define CHECK_SAMPLE_FP(var,bound) var=(var>bound)?bound:(var<-bound)?-bound:var
+static SLONGLONG MixVectorMonoNormal(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,SLONG todo,int bits8)
+{
+	if(!VOLUMES_FIT(vnf))
+		return MixMonoNormal(srce,dest,idx,increment,todo,bits8);
+	return bits8?MixVector(srce,dest,idx,increment,todo,VMIX_MONO,VINTERP_EXACT,1):
+	             MixVector(srce,dest,idx,increment,todo,VMIX_MONO,VINTERP_EXACT,0);
+}
 
-static void Mix32ToFP_Normal(float* dste,const SLONG *srce,NATIVE count)
+static SLONGLONG MixVectorStereoNormal(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
 {
-	float x1,x2,tmpx;
-	int i;
+	if(!VOLUMES_FIT(vnf))
+		return MixStereoNormal(srce,dest,idx,increment,todo,bits8);
+	return bits8?MixVector(srce,dest,idx,increment,todo,VMIX_STEREO,VINTERP_EXACT,1):
+	             MixVector(srce,dest,idx,increment,todo,VMIX_STEREO,VINTERP_EXACT,0);
+}
 
-	for(count/=SAMPLING_FACTOR;count;count--) {
-		tmpx=0.0f;
+static SLONGLONG MixVectorStereoSurround(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
+{
+	if(!VOLUMES_FIT(vnf))
+		return MixStereoSurround(srce,dest,idx,increment,todo,bits8);
+	return bits8?MixVector(srce,dest,idx,increment,todo,VMIX_SURROUND,VINTERP_EXACT,1):
+	             MixVector(srce,dest,idx,increment,todo,VMIX_SURROUND,VINTERP_EXACT,0);
+}
 
-		for(i=SAMPLING_FACTOR/2;i;i--) {
-			EXTRACT_SAMPLE_FP(x1,1.0f); EXTRACT_SAMPLE_FP(x2,1.0f);
+#endif /* HAVE_VECTOR_MIXER */
 
-			CHECK_SAMPLE_FP(x1,1.0f); CHECK_SAMPLE_FP(x2,1.0f);
+/*========== Float mixers */
 
-			tmpx+=x1+x2;
-		}
-		*dste++ =tmpx*(1.0f/SAMPLING_FACTOR);
-	}
-}
+/* Used instead of all the mixers above when DMODE_FLOATMIX is set. They
+   accumulate into a float tick buffer in the output range (a full scale
+   16 bit sample is 32768), so that nothing is clipped until the final
+   conversion. */
+#define FMIX_MONO     0
+#define FMIX_STEREO   1
+#define FMIX_SURROUND 2
 
-static void Mix32ToFP_Stereo(float* dste,const SLONG *srce,NATIVE count)
+static __inline SLONGLONG MixFloat(const void* const srce,float* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int layout,int bits8)
 {
-	float x1,x2,x3,x4,tmpx,tmpy;
-	int i;
+	const float invclick=1.0f/CLICK_BUFFER,invfrac=1.0f/(FRACMASK+1L);
+	float lvol=vnf->lgain,lold=vnf->oldlgain,llast=vnf->lastfL;
+	float rvol=vnf->rgain,rold=vnf->oldrgain,rlast=vnf->lastfR;
+	float sample=0,l,r,t;
+	int rampvol=vnf->rampvol,click=vnf->click;
+	SLONG s0,s1;
+	SLONGLONG i;
 
-	for(count/=SAMPLING_FACTOR;count;count--) {
-		tmpx=tmpy=0.0f;
-
-		for(i=SAMPLING_FACTOR/2;i;i--) {
-			EXTRACT_SAMPLE_FP(x1,1.0f); EXTRACT_SAMPLE_FP(x2,1.0f);
-			EXTRACT_SAMPLE_FP(x3,1.0f); EXTRACT_SAMPLE_FP(x4,1.0f);
+	while(todo--) {
+		i=idx>>FRACBITS;
+		s0=FETCH(srce,i);s1=FETCH(srce,i+1);
+		sample=s0+(s1-s0)*((ULONG)(idx&FRACMASK)*invfrac);
+		idx+=increment;
 
-			CHECK_SAMPLE_FP(x1,1.0f); CHECK_SAMPLE_FP(x2,1.0f);
-			CHECK_SAMPLE_FP(x3,1.0f); CHECK_SAMPLE_FP(x4,1.0f);
+		if(rampvol) {
+			t=rampvol*invclick;
+			l=(lvol+(lold-lvol)*t)*sample;
+			r=(rvol+(rold-rvol)*t)*sample;
+			rampvol--;
+		} else
+		  if(click) {
+			t=click*invclick;
+			l=lvol*sample+(llast-lvol*sample)*t;
+			r=rvol*sample+(rlast-rvol*sample)*t;
+			click--;
+		} else {
+			l=lvol*sample;
+			r=rvol*sample;
+		}
 
-			tmpx+=x1+x3;
-			tmpy+=x2+x4;
+		if(layout==FMIX_MONO)
+			*dest++ +=l;
+		else if(layout==FMIX_SURROUND) {
+			*dest++ +=l;
+			*dest++ -=l;
+		} else {
+			*dest++ +=l;
+			*dest++ +=r;
 		}
-		*dste++ =tmpx*(1.0f/SAMPLING_FACTOR);
-		*dste++ =tmpy*(1.0f/SAMPLING_FACTOR);
 	}
-}
+	vnf->rampvol=rampvol;
+	vnf->click=click;
+	vnf->lastfL=lvol*sample;
+	vnf->lastfR=(layout==FMIX_SURROUND)?lvol*sample:rvol*sample;
 
-/* Mixing macros */
-#define EXTRACT_SAMPLE(var,attenuation) var=*srce++/(MAXVOL_FACTOR*attenuation)
-#define CHECK_SAMPLE(var,bound) var=(var>=bound)?bound-1:(var<-bound)?-bound:var
+	return idx;
+}
 
-static void Mix32To16_Normal(SWORD* dste,const SLONG *srce,NATIVE count)
+static SLONGLONG MixFloatMonoNormal(const void* const srce,float* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
 {
-	NATIVE x1,x2,tmpx;
-	int i;
-
-	for(count/=SAMPLING_FACTOR;count;count--) {
-		tmpx=0;
-
-		for(i=SAMPLING_FACTOR/2;i;i--) {
-			EXTRACT_SAMPLE(x1,1); EXTRACT_SAMPLE(x2,1);
-
-			CHECK_SAMPLE(x1,32768); CHECK_SAMPLE(x2,32768);
+	return bits8?MixFloat(srce,dest,idx,increment,todo,FMIX_MONO,1):
+	             MixFloat(srce,dest,idx,increment,todo,FMIX_MONO,0);
+}
 
-			tmpx+=x1+x2;
-		}
-		*dste++ =(SWORD)(tmpx/SAMPLING_FACTOR);
-	}
+static SLONGLONG MixFloatStereoNormal(const void* const srce,float* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
+{
+	return bits8?MixFloat(srce,dest,idx,increment,todo,FMIX_STEREO,1):
+	             MixFloat(srce,dest,idx,increment,todo,FMIX_STEREO,0);
 }
 
+static SLONGLONG MixFloatStereoSurround(const void* const srce,float* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8)
+{
+	return bits8?MixFloat(srce,dest,idx,increment,todo,FMIX_SURROUND,1):
+	             MixFloat(srce,dest,idx,increment,todo,FMIX_SURROUND,0);
+}
 
-static void Mix32To16_Stereo(SWORD* dste,const SLONG *srce,NATIVE count)
+/*========== Resonant filter mixers */
+
+/* Voices with an active Impulse Tracker resonant filter are mixed by these
+   instead of the mixers above, so that unfiltered voices do not pay anything
+   for the filter. The two pole filter runs on the interpolated samples on
+   the way to the volume stage, with the coefficients Impulse Tracker uses:
+   y[n]=a*x[n]+b*y[n-1]+c*y[n-2]. The output layouts are those of the float
+   mixers. */
+#define FLTBITS  24      /* fixed point coefficients */
+#define FLTSTATE 8       /* fraction bits of the integer history: with low
+                            cutoffs the rounding errors are amplified a lot */
+#define FLTLIMIT ((32767L*16)<<FLTSTATE) /* the resonance gain is at most
+                                             24dB */
+
+/* Computes the coefficients of the filter of v, when its settings or the
+   mixing rate changed */
+static void SetupFilter(VINFO* v)
 {
-	NATIVE x1,x2,x3,x4,tmpx,tmpy;
-	int i;
+	ULONG rate=md_mixfreq<<SAMPLING_SHIFT;
+	double fc,dmp,d,e;
 
-	for(count/=SAMPLING_FACTOR;count;count--) {
-		tmpx=tmpy=0;
+	if(!(v->filter=(v->cutoff<127)||v->resonance))
+		return;
+	if(v->fltcutoff==v->cutoff && v->fltres==v->resonance &&
+	   v->fltrate==rate)
+		return;
+	v->fltcutoff=v->cutoff;
+	v->fltres=v->resonance;
+	v->fltrate=rate;
+
+	fc=110.0*pow(2.0,0.25+v->cutoff/24.0);
+	if(fc>rate*0.5) fc=rate*0.5;
+	fc*=2.0*3.14159265358979/rate;
+	dmp=pow(10.0,-((24.0/128.0)*v->resonance)/20.0);
+	d=(1.0-2.0*dmp)*fc;
+	if(d>2.0) d=2.0;
+	d=(2.0*dmp-d)/fc;
+	e=1.0/(fc*fc);
+
+	v->ffa=(float)(1.0/(1.0+d+e));
+	v->ffb=(float)((d+e+e)/(1.0+d+e));
+	v->ffc=(float)(-e/(1.0+d+e));
+	v->fa=(SLONG)floor(v->ffa*(1L<<FLTBITS)+0.5);
+	v->fb=(SLONG)floor(v->ffb*(1L<<FLTBITS)+0.5);
+	v->fc=(SLONG)floor(v->ffc*(1L<<FLTBITS)+0.5);
+}
 
-		for(i=SAMPLING_FACTOR/2;i;i--) {
-			EXTRACT_SAMPLE(x1,1); EXTRACT_SAMPLE(x2,1);
-			EXTRACT_SAMPLE(x3,1); EXTRACT_SAMPLE(x4,1);
+static __inline SLONGLONG MixFilteredKernel(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int layout,int bits8)
+{
+	SLONG lvol=vnf->lvolsel,lold=vnf->oldlvol,llast=vnf->lastvalL;
+	SLONG rvol=(layout==FMIX_STEREO)?vnf->rvolsel:lvol;
+	SLONG rold=(layout==FMIX_STEREO)?vnf->oldrvol:lold;
+	SLONG rlast=(layout==FMIX_STEREO)?vnf->lastvalR:llast;
+	SLONG fa=vnf->fa,fb=vnf->fb,fc=vnf->fc,y1=vnf->fy1,y2=vnf->fy2;
+	SLONG sample=0,x,y,l,r;
+	int rampvol=vnf->rampvol,click=vnf->click;
+	SLONGLONG i,f;
 
-			CHECK_SAMPLE(x1,32768); CHECK_SAMPLE(x2,32768);
-			CHECK_SAMPLE(x3,32768); CHECK_SAMPLE(x4,32768);
+	while(todo--) {
+		i=idx>>FRACBITS,f=idx&FRACMASK;
+		x=(SLONG)((((SLONGLONG)FETCH(srce,i)*(FRACMASK+1L-f)) +
+		           ((SLONGLONG)FETCH(srce,i+1)*f)) >> FRACBITS);
+		idx+=increment;
 
-			tmpx+=x1+x3;
-			tmpy+=x2+x4;
+		y=(SLONG)(((SLONGLONG)fa*(x*(1L<<FLTSTATE))+(SLONGLONG)fb*y1+
+		           (SLONGLONG)fc*y2+(1L<<(FLTBITS-1)))>>FLTBITS);
+		y=(y>FLTLIMIT)?FLTLIMIT:(y<-FLTLIMIT)?-FLTLIMIT:y;
+		y2=y1;y1=y;
+		sample=y>>FLTSTATE;
+
+		if(rampvol) {
+			l=(SLONG)((((SLONGLONG)lold*rampvol+lvol*(CLICK_BUFFER-rampvol))*
+			           sample)>>CLICK_SHIFT);
+			r=(SLONG)((((SLONGLONG)rold*rampvol+rvol*(CLICK_BUFFER-rampvol))*
+			           sample)>>CLICK_SHIFT);
+			rampvol--;
+		} else
+		  if(click) {
+			l=(SLONG)((((SLONGLONG)lvol*(CLICK_BUFFER-click))*sample+
+			           (SLONGLONG)llast*click)>>CLICK_SHIFT);
+			r=(SLONG)((((SLONGLONG)rvol*(CLICK_BUFFER-click))*sample+
+			           (SLONGLONG)rlast*click)>>CLICK_SHIFT);
+			click--;
+		} else {
+			l=lvol*sample;
+			r=rvol*sample;
 		}
-		*dste++ =(SWORD)(tmpx/SAMPLING_FACTOR);
-		*dste++ =(SWORD)(tmpy/SAMPLING_FACTOR);
+
+		*dest++ +=l;
+		if(layout==FMIX_STEREO)
+			*dest++ +=r;
+		else if(layout==FMIX_SURROUND)
+			*dest++ -=r;
 	}
+	vnf->rampvol=rampvol;
+	vnf->click=click;
+	vnf->fy1=y1;vnf->fy2=y2;
+	vnf->lastvalL=lvol*sample;
+	if(layout!=FMIX_MONO)
+		vnf->lastvalR=rvol*sample;
+
+	return idx;
 }
 
-static void Mix32To8_Normal(SBYTE* dste,const SLONG *srce,NATIVE count)
+static SLONGLONG MixFiltered(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int layout,int bits8)
 {
-	NATIVE x1,x2,tmpx;
-	int i;
+	return bits8?MixFilteredKernel(srce,dest,idx,increment,todo,layout,1):
+	             MixFilteredKernel(srce,dest,idx,increment,todo,layout,0);
+}
 
-	for(count/=SAMPLING_FACTOR;count;count--) {
-		tmpx = 0;
+/* The float filter runs four samples at a time with the vector mixers. The
+   four outputs are then a linear function of the four inputs and of the two
+   previous outputs, which takes six vector multiply-adds instead of a chain
+   of twelve dependent scalar ones. */
+static __inline SLONGLONG MixFloatFilteredKernel(const void* const srce,float* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int layout,int bits8)
+{
+	const float invclick=1.0f/CLICK_BUFFER,invfrac=1.0f/(FRACMASK+1L);
+	float lvol=vnf->lgain,lold=vnf->oldlgain,llast=vnf->lastfL;
+	float rvol=vnf->rgain,rold=vnf->oldrgain,rlast=vnf->lastfR;
+	float fa=vnf->ffa,fb=vnf->ffb,fc=vnf->ffc,y1=vnf->ffy1,y2=vnf->ffy2;
+	float x[4],y[4],sample=0,l,r,t;
+	int rampvol=vnf->rampvol,click=vnf->click,k,n;
+	SLONG s0,s1;
+	SLONGLONG i;
+#ifdef HAVE_VECTOR_MIXER
+	int block=(vc_mode&DMODE_SIMDMIXER)!=0;
+	/* impulse response, and responses to y[n-1] and y[n-2] */
+	float i1=fb,i2=fb*i1+fc,i3=fb*i2+fc*i1;
+	float p1=fb*fb+fc,p2=fb*p1+fc*fb,p3=fb*p2+fc*p1;
+	float q1=fb*fc,q2=fb*q1+fc*fc,q3=fb*q2+fc*q1;
+	vfloat h0=(vfloat){fa,fa*i1,fa*i2,fa*i3};
+	vfloat h1=(vfloat){0,fa,fa*i1,fa*i2};
+	vfloat h2=(vfloat){0,0,fa,fa*i1};
+	vfloat h3=(vfloat){0,0,0,fa};
+	vfloat p=(vfloat){fb,p1,p2,p3};
+	vfloat q=(vfloat){fc,q1,q2,q3};
+	vfloat out;
+#endif
 
-		for(i=SAMPLING_FACTOR/2;i;i--) {
-			EXTRACT_SAMPLE(x1,256); EXTRACT_SAMPLE(x2,256);
+	while(todo) {
+		n=(todo<4)?todo:4;
+		todo-=n;
+
+		for(k=0;k<n;k++) {
+			i=idx>>FRACBITS;
+			s0=FETCH(srce,i);s1=FETCH(srce,i+1);
+			x[k]=s0+(s1-s0)*((ULONG)(idx&FRACMASK)*invfrac);
+			idx+=increment;
+		}
+#ifdef HAVE_VECTOR_MIXER
+		if(block && n==4) {
+			out=x[0]*h0+x[1]*h1+x[2]*h2+x[3]*h3+y1*p+y2*q;
+			memcpy(y,&out,sizeof(y));
+			y2=y[2];y1=y[3];
+		} else
+#endif
+		for(k=0;k<n;k++) {
+			y[k]=fa*x[k]+fb*y1+fc*y2;
+			y2=y1;y1=y[k];
+		}
 
-			CHECK_SAMPLE(x1,128); CHECK_SAMPLE(x2,128);
+		for(k=0;k<n;k++) {
+			sample=y[k];
+			if(rampvol) {
+				t=rampvol*invclick;
+				l=(lvol+(lold-lvol)*t)*sample;
+				r=(rvol+(rold-rvol)*t)*sample;
+				rampvol--;
+			} else
+			  if(click) {
+				t=click*invclick;
+				l=lvol*sample+(llast-lvol*sample)*t;
+				r=rvol*sample+(rlast-rvol*sample)*t;
+				click--;
+			} else {
+				l=lvol*sample;
+				r=rvol*sample;
+			}
 
-			tmpx+=x1+x2;
+			if(layout==FMIX_MONO)
+				*dest++ +=l;
+			else if(layout==FMIX_SURROUND) {
+				*dest++ +=l;
+				*dest++ -=l;
+			} else {
+				*dest++ +=l;
+				*dest++ +=r;
+			}
 		}
-		*dste++ = (SBYTE)((tmpx/SAMPLING_FACTOR)+128);
 	}
+	vnf->rampvol=rampvol;
+	vnf->click=click;
+	vnf->ffy1=y1;vnf->ffy2=y2;
+	vnf->lastfL=lvol*sample;
+	vnf->lastfR=(layout==FMIX_SURROUND)?lvol*sample:rvol*sample;
+
+	return idx;
 }
 
-static void Mix32To8_Stereo(SBYTE* dste,const SLONG *srce,NATIVE count)
+static SLONGLONG MixFloatFiltered(const void* const srce,float* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int layout,int bits8)
 {
-	NATIVE x1,x2,x3,x4,tmpx,tmpy;
-	int i;
+	return bits8?MixFloatFilteredKernel(srce,dest,idx,increment,todo,layout,1):
+	             MixFloatFilteredKernel(srce,dest,idx,increment,todo,layout,0);
+}
+
+/* Sample mixers, chosen in VC2_Init */
+#ifndef NATIVE_64BIT_INT
+static	SLONG(*Mix32Mono)(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,SLONG todo,int bits8);
+static	SLONG(*Mix32Stereo)(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8);
+static	SLONG(*Mix32Surround)(const void* const srce,SLONG* dest,SLONG idx,SLONG increment,ULONG todo,int bits8);
+#endif
+static	SLONGLONG(*MixMono)(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,SLONG todo,int bits8);
+static	SLONGLONG(*MixStereo)(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8);
+static	SLONGLONG(*MixSurround)(const void* const srce,SLONG* dest,SLONGLONG idx,SLONGLONG increment,ULONG todo,int bits8);
 
-	for(count/=SAMPLING_FACTOR;count;count--) {
-		tmpx=tmpy=0;
+static	void(*Mix32toFP)(float* dste,const SLONG *srce,NATIVE count);
+static	void(*Mix32to16)(SWORD* dste,const SLONG *srce,NATIVE count);
+static	void(*Mix32to8)(SBYTE* dste,const SLONG *srce,NATIVE count);
+/*========== Reverb */
+
+/* The reverb is a bank of eight feedback comb filters per channel, whose
+   outputs are added up with alternating signs. A two tap filter in the
+   feedback path damps the high frequencies. All delay lines are in a single
+   buffer, and a comb filter is run over a whole block at once: its write
+   position only wraps around between the runs of the inner loop, which reads
+   samples older than the block and can therefore be vectorized. The reverb
+   works at the output rate, after the decimation. */
+
+#define RVCOMBS 8
+#define RVBLOCK 256     /* samples per comb filter run */
+#define RVSHIFT 10      /* fixed point feedback gains */
+#define RVSTATE 6       /* low bits the integer delay lines do not keep */
+#define RVMAXTIME 10000 /* longest reverb time, which keeps the integer
+                           feedback within 32 bits */
+#define RVLIMIT ((32768L*MAXVOL_FACTOR)>>3)
+
+/* comb filter delays at 44100Hz, and the offset of the right channel */
+static const UWORD rv_tuning[RVCOMBS]={1116,1188,1277,1356,1422,1491,1557,1617};
+#define RVSPREAD 23
+
+typedef struct RVCOMB {
+	SLONG    *buf;           /* delay line, SLONG or float */
+	ULONG     len;           /* delay + 1 */
+	ULONG     pos;           /* oldest sample, next to be written */
+	int       fa,fb;         /* feedback of the last two delayed samples */
+	float     ffa,ffb;
+} RVCOMB;
+
+static	RVCOMB vc_combs[2][RVCOMBS];
+static	SLONG *vc_rvlines=NULL;
+static	UWORD vc_rvtime;
+static	UBYTE vc_rvdamp;
+static	int vc_rvwet;
+static	float vc_rvfwet;
+static	union {
+	SLONG i[2][RVBLOCK];
+	float f[2][RVBLOCK];
+} vc_rvtmp;                      /* comb input, and sum of the comb outputs */
+
+static int ReverbAlloc(void)
+{
+	ULONG total=0;
+	int c,k;
+
+	for(c=0;c<2;c++)
+		for(k=0;k<RVCOMBS;k++) {
+			vc_combs[c][k].len=((rv_tuning[k]+(c?RVSPREAD:0))*(ULONG)md_mixfreq)/44100+1;
+			vc_combs[c][k].pos=0;
+			total+=vc_combs[c][k].len;
+		}
+	if(!(vc_rvlines=(SLONG*)MikMod_calloc(total,sizeof(SLONG))))
+		return 1;
+	for(total=0,c=0;c<2;c++)
+		for(k=0;k<RVCOMBS;k++) {
+			vc_combs[c][k].buf=vc_rvlines+total;
+			total+=vc_combs[c][k].len;
+		}
+	vc_rvtime=0;
+	return 0;
+}
 
-		for(i=SAMPLING_FACTOR/2;i;i--) {
-			EXTRACT_SAMPLE(x1,256); EXTRACT_SAMPLE(x2,256);
-			EXTRACT_SAMPLE(x3,256); EXTRACT_SAMPLE(x4,256);
+/* Returns the reverb time in ms, and sets up the comb filters when the
+   parameters changed. md_reverb, which the regular mixer uses, stands in for
+   the reverb time when it is not set. */
+static UWORD ReverbSetup(void)
+{
+	UWORD time=md_reverbtime;
+	float g,d;
+	int c,k;
+
+	if(!time && md_reverb)
+		time=((md_reverb>15)?15:md_reverb)*150;
+	if(time>RVMAXTIME) time=RVMAXTIME;
+	if(!time || !md_reverbwet || !vc_rvlines)
+		return 0;
+
+	vc_rvwet=md_reverbwet;
+	vc_rvfwet=md_reverbwet*(1.0f/128.0f);
+	if((time==vc_rvtime)&&(md_reverbdamp==vc_rvdamp))
+		return time;
+	vc_rvtime=time;
+	vc_rvdamp=md_reverbdamp;
+
+	/* the comb filters decay by 60dB in the reverb time */
+	d=md_reverbdamp*(1.0f/512.0f);
+	for(c=0;c<2;c++)
+		for(k=0;k<RVCOMBS;k++) {
+			RVCOMB *cf=&vc_combs[c][k];
+
+			g=(float)exp(-6.9077553*(cf->len-1)/(md_mixfreq*(time*0.001)));
+			cf->ffa=g*(1.0f-d);
+			cf->ffb=g*d;
+			cf->fa=(int)(cf->ffa*(1<<RVSHIFT));
+			cf->fb=(int)(cf->ffb*(1<<RVSHIFT));
+		}
+	return time;
+}
 
-			CHECK_SAMPLE(x1,128); CHECK_SAMPLE(x2,128);
-			CHECK_SAMPLE(x3,128); CHECK_SAMPLE(x4,128);
+/* Runs a comb filter over count samples of srce, and adds its output to, or
+   subtracts it from, dest */
+static void CombFilter(RVCOMB* cf,const SLONG* srce,SLONG* dest,NATIVE count,int negate)
+{
+	const int fa=cf->fa,fb=cf->fb;
+	NATIVE n,i;
+	SLONG *w,y;
+
+	while(count) {
+		w=cf->buf+cf->pos;
+		if(cf->pos==cf->len-1) {
+			/* the previous delayed sample is at the start of the line */
+			y=*srce++ +((fa*cf->buf[0]+fb*w[0])>>(RVSHIFT-RVSTATE));
+			w[0]=y>>RVSTATE;
+			*dest++ +=negate?-y:y;
+			cf->pos=0;
+			count--;
+			continue;
+		}
 
-			tmpx+=x1+x3;
-			tmpy+=x2+x4;
+		n=MIN(count,(NATIVE)(cf->len-1-cf->pos));
+		i=0;
+#ifdef HAVE_VECTOR_MIXER
+		{
+			const vslong va=VSPLAT(fa),vb=VSPLAT(fb);
+			vslong vy;
+
+			for(;i+4<=n;i+=4) {
+				vy=*(const vslong_ua*)(srce+i)+
+				   ((va**(const vslong_ua*)(w+i+1)+vb**(const vslong_ua*)(w+i))>>(RVSHIFT-RVSTATE));
+				*(vslong_ua*)(w+i)=vy>>RVSTATE;
+				if(negate)
+					*(vslong_ua*)(dest+i)-=vy;
+				else
+					*(vslong_ua*)(dest+i)+=vy;
+			}
+		}
+#endif
+		for(;i<n;i++) {
+			y=srce[i]+((fa*w[i+1]+fb*w[i])>>(RVSHIFT-RVSTATE));
+			w[i]=y>>RVSTATE;
+			dest[i]+=negate?-y:y;
 		}
-		*dste++ =(SBYTE)((tmpx/SAMPLING_FACTOR)+128);
-		*dste++ =(SBYTE)((tmpy/SAMPLING_FACTOR)+128);
+		srce+=n;
+		dest+=n;
+		count-=n;
+		cf->pos+=n;
 	}
 }
 
-#if defined HAVE_SSE2
-#define SHIFT_MIX_TO_16 (BITSHIFT + 16 - 16)
-/* TEST: Ok */
-static void Mix32To16_Stereo_SIMD_4Tap(SWORD* dste, const SLONG* srce, NATIVE count)
+static void CombFilterFloat(RVCOMB* cf,const float* srce,float* dest,NATIVE count,int negate)
 {
-	int remain = count;
+	const float fa=cf->ffa,fb=cf->ffb;
+	NATIVE n,i;
+	float *w,y;
+
+	while(count) {
+		w=(float*)cf->buf+cf->pos;
+		if(cf->pos==cf->len-1) {
+			y=*srce++ +fa*((float*)cf->buf)[0]+fb*w[0];
+			w[0]=y;
+			*dest++ +=negate?-y:y;
+			cf->pos=0;
+			count--;
+			continue;
+		}
 
-	/* Check unaligned dste buffer. srce is always aligned. */
-	while(!IS_ALIGNED_16(dste))
-	{
-		Mix32To16_Stereo(dste, srce, SAMPLING_FACTOR);
-		dste+=2;
-		srce+=8;
-		count--;
-		if(!count) return;
+		n=MIN(count,(NATIVE)(cf->len-1-cf->pos));
+		i=0;
+#ifdef HAVE_VECTOR_MIXER
+		{
+			const vfloat_ua va={fa,fa,fa,fa},vb={fb,fb,fb,fb};
+			vfloat_ua vy;
+
+			for(;i+4<=n;i+=4) {
+				vy=*(const vfloat_ua*)(srce+i)+
+				   va**(const vfloat_ua*)(w+i+1)+vb**(const vfloat_ua*)(w+i);
+				*(vfloat_ua*)(w+i)=vy;
+				if(negate)
+					*(vfloat_ua*)(dest+i)-=vy;
+				else
+					*(vfloat_ua*)(dest+i)+=vy;
+			}
+		}
+#endif
+		for(;i<n;i++) {
+			y=srce[i]+fa*w[i+1]+fb*w[i];
+			w[i]=y;
+			dest[i]+=negate?-y:y;
+		}
+		srce+=n;
+		dest+=n;
+		count-=n;
+		cf->pos+=n;
 	}
+}
 
-	/* dste and srce aligned. srce is always aligned. */
-	remain = count & 15;
-	/* count / 2 for 1 sample */
+/* Adds the reverb to count frames of srce */
+static void MixReverb(SLONG* srce,NATIVE count)
+{
+	int chans=(vc_mode&DMODE_STEREO)?2:1,c,k;
+	SLONG *in=vc_rvtmp.i[0],*out=vc_rvtmp.i[1];
+	NATIVE n,i;
+
+	for(;count;count-=n,srce+=n*chans) {
+		n=MIN(count,RVBLOCK);
+		for(c=0;c<chans;c++) {
+			for(i=0;i<n;i++) {
+				SLONG x=srce[i*chans+c]>>3;
+				in[i]=(x>RVLIMIT)?RVLIMIT:(x<-RVLIMIT)?-RVLIMIT:x;
+				out[i]=0;
+			}
+			for(k=0;k<RVCOMBS;k++)
+				CombFilter(&vc_combs[c][k],in,out,n,k&1);
+			for(i=0;i<n;i++)
+				srce[i*chans+c]+=(out[i]>>7)*vc_rvwet;
+		}
+	}
+}
 
-	for(count>>=4;count;count--)
+static void MixReverbFloat(float* srce,NATIVE count)
+{
+	int chans=(vc_mode&DMODE_STEREO)?2:1,c,k;
+	float *in=vc_rvtmp.f[0],*out=vc_rvtmp.f[1];
+	NATIVE n,i;
+
+	for(;count;count-=n,srce+=n*chans) {
+		n=MIN(count,RVBLOCK);
+		for(c=0;c<chans;c++) {
+			for(i=0;i<n;i++) {
+				in[i]=srce[i*chans+c]*0.125f;
+				out[i]=0;
+			}
+			for(k=0;k<RVCOMBS;k++)
+				CombFilterFloat(&vc_combs[c][k],in,out,n,k&1);
+			for(i=0;i<n;i++)
+				srce[i*chans+c]+=out[i]*vc_rvfwet;
+		}
+	}
+}
+
+static void (*MixLowPass)(SLONG* srce,NATIVE count);
+
+static int nLeftNR, nRightNR;
+
+static void MixLowPass_Stereo(SLONG* srce,NATIVE count)
+{
+	int n1 = nLeftNR, n2 = nRightNR;
+	SLONG *pnr = srce;
+	int nr=count;
+	for (; nr; nr--)
+	{
+		int vnr = pnr[0] >> 1;
+		pnr[0] = vnr + n1;
+		n1 = vnr;
+		vnr = pnr[1] >> 1;
+		pnr[1] = vnr + n2;
+		n2 = vnr;
+		pnr += 2;
+	}
+	nLeftNR = n1;
+	nRightNR = n2;
+}
+
+static void MixLowPass_Normal(SLONG* srce,NATIVE count)
+{
+	int n1 = nLeftNR;
+	SLONG *pnr = srce;
+	int nr=count;
+	for (; nr; nr--)
 	{
-		/* Load 32bit sample. 1st average */
-		__m128i v0 = _mm_add_epi32(
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+0)), SHIFT_MIX_TO_16),
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+4)), SHIFT_MIX_TO_16)
-		);  /* v0: s0.l+s2.l | s0.r+s2.r | s1.l+s3.l | s1.r+s3.r */
+		int vnr = pnr[0] >> 1;
+		pnr[0] = vnr + n1;
+		n1 = vnr;
+		pnr ++;
+	}
+	nLeftNR = n1;
+}
+
+static void (*MixLowPassFloat)(float* srce,NATIVE count);
+
+static float fLeftNR, fRightNR;
+
+static void MixLowPassFloat_Stereo(float* srce,NATIVE count)
+{
+	float n1 = fLeftNR, n2 = fRightNR, vnr;
+	NATIVE nr;
+
+	for (nr=count; nr; nr--) {
+		vnr = srce[0] * 0.5f;
+		srce[0] = vnr + n1;
+		n1 = vnr;
+		vnr = srce[1] * 0.5f;
+		srce[1] = vnr + n2;
+		n2 = vnr;
+		srce += 2;
+	}
+	fLeftNR = n1;
+	fRightNR = n2;
+}
+
+static void MixLowPassFloat_Normal(float* srce,NATIVE count)
+{
+	float n1 = fLeftNR, vnr;
+	NATIVE nr;
+
+	for (nr=count; nr; nr--) {
+		vnr = srce[0] * 0.5f;
+		srce[0] = vnr + n1;
+		n1 = vnr;
+		srce++;
+	}
+	fLeftNR = n1;
+}
+
+/* Mixing macros */
+#define EXTRACT_SAMPLE_FP(var,attenuation) var=*srce++*((1.0f / 32768.0f) / (MAXVOL_FACTOR*attenuation))
+#define CHECK_SAMPLE_FP(var,bound) var=(var>bound)?bound:(var<-bound)?-bound:var
+
+static void Mix32ToFP_Normal(float* dste,const SLONG *srce,NATIVE count)
+{
+	float x1;
 
-		/* 2nd average (s0.l+s2.l+s1.l+s3.l / 4, s0.r+s2.r+s1.r+s3.r / 4). Upper 64bit is unused  (1 stereo sample) */
-		__m128i v1 = _mm_srai_epi32(_mm_add_epi32(v0, mm_hiqq(v0)), 2);
-		/* v1: s0.l+s2.l / 4 | s0.r+s2.r / 4 | s1.l+s3.l+s0.l+s2.l / 4 | s1.r+s3.r+s0.r+s2.r / 4 */
+	for(;count;count--) {
+		EXTRACT_SAMPLE_FP(x1,1.0f);
+		CHECK_SAMPLE_FP(x1,1.0f);
+		*dste++ =x1;
+	}
+}
 
-		__m128i v2 = _mm_add_epi32(
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+8)), SHIFT_MIX_TO_16),
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+12)), SHIFT_MIX_TO_16)
-		);  /* v2: s4.l+s6.l | s4.r+s6.r | s5.l+s7.l | s5.r+s7.r */
+static void Mix32ToFP_Stereo(float* dste,const SLONG *srce,NATIVE count)
+{
+	Mix32ToFP_Normal(dste,srce,count<<1);
+}
 
-		__m128i v3 = _mm_srai_epi32(_mm_add_epi32(v2, mm_hiqq(v2)), 2);  /* Upper 64bit is unused */
-		/* v3: s4.l+s6.l /4 | s4.r+s6.r / 4| s5.l+s7.l+s4.l+s6.l / 4 | s5.r+s7.r+s4.r+s6.l / 4 */
+/* Mixing macros */
+#define EXTRACT_SAMPLE(var,attenuation) var=*srce++/(MAXVOL_FACTOR*attenuation)
+#define CHECK_SAMPLE(var,bound) var=(var>=bound)?bound-1:(var<-bound)?-bound:var
 
-		/* pack two stereo samples in one */
-		__m128i v4 = _mm_unpacklo_epi64(v1, v3);  /* v4 = avg(s0,s1,s2,s3) | avg(s4,s5,s6,s7) */
+static void Mix32To16_Normal(SWORD* dste,const SLONG *srce,NATIVE count)
+{
+	NATIVE x1;
 
-		__m128i v6;
+	for(;count;count--) {
+		EXTRACT_SAMPLE(x1,1);
+		CHECK_SAMPLE(x1,32768);
+		*dste++ =(SWORD)x1;
+	}
+}
 
-		/* Load 32bit sample. 1st average (s0.l+s2.l, s0.r+s2.r, s1.l+s3.l, s1.r+s3.r) */
-		v0 = _mm_add_epi32(
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+16)), SHIFT_MIX_TO_16),
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+20)), SHIFT_MIX_TO_16)
-		);  /* 128bit = 2 stereo samples */
+static void Mix32To16_Stereo(SWORD* dste,const SLONG *srce,NATIVE count)
+{
+	Mix32To16_Normal(dste,srce,count<<1);
+}
 
-		/* 2nd average (s0.l+s2.l+s1.l+s3.l / 4, s0.r+s2.r+s1.r+s3.r / 4). Upper 64bit is unused  (1 stereo sample) */
-		v1 = _mm_srai_epi32(_mm_add_epi32(v0, mm_hiqq(v0)), 2);
+static void Mix32To8_Normal(SBYTE* dste,const SLONG *srce,NATIVE count)
+{
+	NATIVE x1;
 
-		v2 = _mm_add_epi32(
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+24)), SHIFT_MIX_TO_16),
-			_mm_srai_epi32(_mm_loadu_si128((__m128i const *)(srce+28)), SHIFT_MIX_TO_16)
-		);
+	for(;count;count--) {
+		EXTRACT_SAMPLE(x1,256);
+		CHECK_SAMPLE(x1,128);
+		*dste++ =(SBYTE)(x1+128);
+	}
+}
 
-		v3 = _mm_srai_epi32(_mm_add_epi32(v2, mm_hiqq(v2)), 2);  /* Upper 64bit is unused */
+static void Mix32To8_Stereo(SBYTE* dste,const SLONG *srce,NATIVE count)
+{
+	Mix32To8_Normal(dste,srce,count<<1);
+}
 
-		/* pack two stereo samples in one */
-		v6 = _mm_unpacklo_epi64(v1, v3);  /* v6 = avg(s8,s9,s10,s11) | avg(s12,s13,s14,s15) */
+/* Conversions from the float tick buffer. Count is in samples, not frames,
+   and the output is only clipped here. */
+#define ROUND_SAMPLE_FLOAT(var) var+=(var<0)?-0.5f:0.5f
 
-		_mm_store_si128((__m128i*)dste, _mm_packs_epi32(v4, v6));  /* 4 interpolated stereo sample 32bit to 4 */
+static void MixFloatToFP(float* dste,const float *srce,NATIVE count)
+{
+	float x1;
 
-		dste+=8;
-		srce+=32; /* 32 = 4 * 8  */
+	for(;count;count--) {
+		x1=*srce++*(1.0f/32768.0f);
+		CHECK_SAMPLE_FP(x1,1.0f);
+		*dste++ =x1;
 	}
+}
 
-	/* FIXME: THIS PART WRITES PAST DST !! */
-	if (remain)
-	{
-		Mix32To16_Stereo(dste, srce, remain);
+static void MixFloatTo16_Normal(SWORD* dste,const float *srce,NATIVE count)
+{
+	float x1;
+
+	for(;count;count--) {
+		x1=*srce++;
+		ROUND_SAMPLE_FLOAT(x1);
+		x1=(x1>32767.0f)?32767.0f:(x1<-32768.0f)?-32768.0f:x1;
+		*dste++ =(SWORD)x1;
 	}
 }
 
-#elif defined HAVE_ALTIVEC
-#define SHIFT_MIX_TO_16 vec_splat_u32(BITSHIFT + 16 - 16)
-/* TEST: Ok */
-static void Mix32To16_Stereo_SIMD_4Tap(SWORD* dste, const SLONG* srce, NATIVE count)
+static void MixFloatTo8(SBYTE* dste,const float *srce,NATIVE count)
 {
-	int remain = count;
+	float x1;
 
-	/* Check unaligned dste buffer. srce is always aligned. */
-	while(!IS_ALIGNED_16(dste))
-	{
-		Mix32To16_Stereo(dste, srce, SAMPLING_FACTOR);
-		dste+=2;
-		srce+=8;
-		count--;
-		if(!count) return;
+	for(;count;count--) {
+		x1=*srce++*(1.0f/256.0f);
+		ROUND_SAMPLE_FLOAT(x1);
+		x1=(x1>127.0f)?127.0f:(x1<-128.0f)?-128.0f:x1;
+		*dste++ =(SBYTE)((SWORD)x1+128);
 	}
+}
 
-	/* dste and srce aligned. srce is always aligned. */
-	remain = count & 15;
-	for(count>>=4;count;count--)
-	{
-		/* Load 32bit sample. 1st average (s0.l+s2.l, s0.r+s2.r, s1.l+s3.l, s1.r+s3.r) */
-		vector signed int v0 = vec_add(
-			vec_sra(vec_ld(0, srce), SHIFT_MIX_TO_16),  /* 128bit = 2 stereo samples */
-			vec_sra(vec_ld(0x10, srce), SHIFT_MIX_TO_16)
-		);  /* 128bit = 2 stereo samples */
+#if defined HAVE_VECTOR_MIXER && \
+    (defined __clang__ || (defined __GNUC__ && __GNUC__ >= 9))
+#define HAVE_VECTOR_CONVERT
+
+typedef SWORD vsword __attribute__((vector_size(8)));
+
+/* Same as MixFloatTo16_Normal, four samples at a time */
+static void MixFloatTo16_Vector(SWORD* dste,const float *srce,NATIVE count)
+{
+	const vfloat hi={32767.0f,32767.0f,32767.0f,32767.0f};
+	const vfloat lo={-32768.0f,-32768.0f,-32768.0f,-32768.0f};
+	const vfloat half={0.5f,0.5f,0.5f,0.5f};
+	const vulong sign={0x80000000UL,0x80000000UL,0x80000000UL,0x80000000UL};
+	vfloat x;
+	vslong m;
+	vsword w;
+
+	for(;count>=4;count-=4) {
+		memcpy(&x,srce,sizeof(x));
+		x+=(vfloat)(((vulong)x&sign)|(vulong)half);
+		m=x>hi;
+		x=(vfloat)(((vslong)x&~m)|((vslong)hi&m));
+		m=x<lo;
+		x=(vfloat)(((vslong)x&~m)|((vslong)lo&m));
+		w=__builtin_convertvector(__builtin_convertvector(x,vslong),vsword);
+		memcpy(dste,&w,sizeof(w));
+		srce+=4;
+		dste+=4;
+	}
+	MixFloatTo16_Normal(dste,srce,count);
+}
+#endif
 
-		/* 2nd average (s0.l+s2.l+s1.l+s3.l / 4, s0.r+s2.r+s1.r+s3.r / 4). Upper 64bit is unused  (1 stereo sample) */
-		vector signed int v1 = vec_sra(vec_add(v0, vec_hiqq(v0)), vec_splat_u32(2));
+static void(*MixFloatTo16)(SWORD* dste,const float *srce,NATIVE count);
 
-		vector signed int v2 = vec_add(
-			vec_sra(vec_ld(0x20, srce), SHIFT_MIX_TO_16),
-			vec_sra(vec_ld(0x30, srce), SHIFT_MIX_TO_16)
-		);
+/*========== Decimation */
 
-		vector signed int v3 = vec_sra(vec_add(v2, vec_hiqq(v2)), vec_splat_u32(2));  /* Upper 64bit is unused */
+/* Half-band filters bringing the oversampled mix back to the output rate, one
+   2:1 stage per oversampling step. Every other tap of a half-band filter is
+   zero and the middle one is 1/2, so only the odd taps are stored, as Q15
+   values of the symmetric pairs going outwards from the middle. */
+#define DECIM_MAXTAPS 23
+#define DECIM_LIMIT (32768L*MAXVOL_FACTOR)
 
-		/* pack two stereo samples in one */
-		vector signed int v6, v4 = vec_unpacklo(v1, v3); /* v4 = lo64(v1) | lo64(v3) */
+static const SLONG decim_fir4x[]={9780,-1773,185};               /* 11 taps, 4x -> 2x */
+static const SLONG decim_fir2x[]={10153,-2720,1031,-345,79,-6};  /* 23 taps, 2x -> 1x */
 
-		/* Load 32bit sample. 1st average (s0.l+s2.l, s0.r+s2.r, s1.l+s3.l, s1.r+s3.r) */
-		v0 = vec_add(
-			vec_sra(vec_ld(0x40, srce), SHIFT_MIX_TO_16),	/* 128bit = 2 stereo samples */
-			vec_sra(vec_ld(0x50, srce), SHIFT_MIX_TO_16)
-		);  /* 128bit = 2 stereo samples */
+typedef struct DECIMATOR {
+	union {
+		SLONG i[2][(DECIM_MAXTAPS+1)*2];
+		float f[2][(DECIM_MAXTAPS+1)*2];
+	} z;                           /* delay lines, stored twice so that the
+	                                  last samples are contiguous */
+	int   pos;
+} DECIMATOR;
 
-		/* 2nd average (s0.l+s2.l+s1.l+s3.l / 4, s0.r+s2.r+s1.r+s3.r / 4). Upper 64bit is unused  (1 stereo sample) */
-		v1 = vec_sra(vec_add(v0, vec_hiqq(v0)), vec_splat_u32(2));
+static DECIMATOR vc_decim[MAX_SAMPLING_SHIFT];
 
-		v2 = vec_add(
-			vec_sra(vec_ld(0x60, srce), SHIFT_MIX_TO_16),
-			vec_sra(vec_ld(0x70, srce), SHIFT_MIX_TO_16)
-		);
+/* Halves the rate of count frames of srce, in place. The input is clipped to
+   the output range first, as the box filter used to do. */
+static void Decimate(DECIMATOR* d,const SLONG* fir,int pairs,SLONG* srce,NATIVE count,int chans)
+{
+	int len=pairs*4,mid=pairs*2-1,pos=d->pos,c,j;
+	SLONG *dste=srce,out[2],x,*h;
+	SLONGLONG acc;
+
+	for(count>>=1;count;count--) {
+		for(c=0;c<chans;c++) {
+			h=d->z.i[c];
+
+			x=srce[c];
+			x=(x>=DECIM_LIMIT)?DECIM_LIMIT-1:(x<-DECIM_LIMIT)?-DECIM_LIMIT:x;
+			h[pos]=h[pos+len]=x;
+			x=srce[chans+c];
+			x=(x>=DECIM_LIMIT)?DECIM_LIMIT-1:(x<-DECIM_LIMIT)?-DECIM_LIMIT:x;
+			h[pos+1]=h[pos+1+len]=x;
+
+			/* the last len-1 samples, oldest first */
+			h+=(pos+2)%len+1;
+			acc=(SLONGLONG)h[mid]*16384;
+			for(j=0;j<pairs;j++)
+				acc+=(SLONGLONG)(h[mid-1-2*j]+h[mid+1+2*j])*fir[j];
+			out[c]=(SLONG)((acc+(1<<14))>>15);
+		}
+		for(c=0;c<chans;c++)
+			*dste++ =out[c];
+		srce+=chans<<1;
+		pos=(pos+2)%len;
+	}
+	d->pos=pos;
+}
 
-		v3 = vec_sra(vec_add(v2, vec_hiqq(v2)), vec_splat_u32(2));  /* Upper 64bit is unused */
+/* Same as Decimate, for the float tick buffer, which is not clipped */
+static void DecimateFloat(DECIMATOR* d,const SLONG* fir,int pairs,float* srce,NATIVE count,int chans)
+{
+	int len=pairs*4,mid=pairs*2-1,pos=d->pos,c,j;
+	float *dste=srce,out[2],*h,acc;
 
-		/* pack two stereo samples in one */
-		v6 = vec_unpacklo(v1, v3);
+	for(count>>=1;count;count--) {
+		for(c=0;c<chans;c++) {
+			h=d->z.f[c];
 
-		vec_st(vec_packs(v4, v6), 0, dste);  /* 4 interpolated stereo sample 32bit to 4 interpolated stereo sample 16bit + saturation */
+			h[pos]=h[pos+len]=srce[c];
+			h[pos+1]=h[pos+1+len]=srce[chans+c];
 
-		dste+=8;
-		srce+=32; /* 32 = 4 * 8  */
+			h+=(pos+2)%len+1;
+			acc=h[mid]*16384.0f;
+			for(j=0;j<pairs;j++)
+				acc+=(h[mid-1-2*j]+h[mid+1+2*j])*fir[j];
+			out[c]=acc*(1.0f/32768.0f);
+		}
+		for(c=0;c<chans;c++)
+			*dste++ =out[c];
+		srce+=chans<<1;
+		pos=(pos+2)%len;
 	}
+	d->pos=pos;
+}
 
-	if (remain)
-	{
-		Mix32To16_Stereo(dste, srce, remain);
+static void MixDecimate(SLONG* srce,NATIVE count)
+{
+	int chans=(vc_mode&DMODE_STEREO)?2:1;
+
+	if(SAMPLING_SHIFT>1) {
+		if(vc_mode & DMODE_FLOATMIX)
+			DecimateFloat(&vc_decim[1],decim_fir4x,sizeof(decim_fir4x)/sizeof(SLONG),
+			              (float*)srce,count,chans);
+		else
+			Decimate(&vc_decim[1],decim_fir4x,sizeof(decim_fir4x)/sizeof(SLONG),
+			         srce,count,chans);
+		count>>=1;
+	}
+	if(SAMPLING_SHIFT>0) {
+		if(vc_mode & DMODE_FLOATMIX)
+			DecimateFloat(&vc_decim[0],decim_fir2x,sizeof(decim_fir2x)/sizeof(SLONG),
+			              (float*)srce,count,chans);
+		else
+			Decimate(&vc_decim[0],decim_fir2x,sizeof(decim_fir2x)/sizeof(SLONG),
+			         srce,count,chans);
+	}
+}
+
+/* Picks up a new oversampling factor. This is only done between blocks, so
+   that the block length stays a multiple of the factor. */
+static void SetSamplingShift(void)
+{
+	int t,shift=(md_oversampling>MAX_SAMPLING_SHIFT)?MAX_SAMPLING_SHIFT:md_oversampling;
+
+	if(shift==vc_samplingshift)
+		return;
+
+	vc_samplingshift=shift;
+	memset(vc_decim,0,sizeof(vc_decim));
+
+	/* shorter clicks and ramps at lower rates */
+	for(t=0;t<vc_softchn;t++) {
+		if(vmix[t].rampvol>CLICK_BUFFER) vmix[t].rampvol=CLICK_BUFFER;
+		if(vmix[t].click>CLICK_BUFFER) vmix[t].click=CLICK_BUFFER;
 	}
 }
 
+/*========== Level meters */
+
+/* The mixer measures the level of every voice while it mixes it, with the
+   volumes it is mixed with, and the level of the output, from one sample in
+   METERSTEP output frames. At the end of a block the levels are written to
+   the buffer readers are not told to use, which is then published. Readers
+   copy the published buffer and check it was not republished meanwhile, so
+   neither side ever waits for the other. */
+#define MAXMETERS 256  /* voices, the output meter comes after them */
+#define METERSTEP 8
+
+#ifdef __GNUC__
+#define METER_BARRIER() __sync_synchronize()
+#else
+#define METER_BARRIER()
 #endif
 
+static	MMETER vc_meters[2][MAXMETERS+1];
+static	int vc_metervoices[2];
+static	volatile ULONG vc_meterseq=0;  /* vc_meters[vc_meterseq&1] is published */
+
+/* Measures todo samples of vnf from index idx, before they are mixed */
+static void MeterVoice(const void* srce,SLONGLONG idx,NATIVE todo,int bits8)
+{
+	NATIVE step=METERSTEP<<SAMPLING_SHIFT,k;
+	float peak=0,sum=0,x,gl,gr;
+	ULONG taps=0;
+
+	for(k=vnf->mphase;k<todo;k+=step) {
+		x=FETCH(srce,(idx+k*vnf->increment)>>FRACBITS);
+		if(x<0) x=-x;
+		if(x>peak) peak=x;
+		sum+=x*x;
+		taps++;
+	}
+	vnf->mphase=k-todo;
+	if(!taps)
+		return;
+
+	gl=vnf->lvolsel*(1.0f/MAXVOL_FACTOR);
+	gr=(vc_mode&DMODE_STEREO)?vnf->rvolsel*(1.0f/MAXVOL_FACTOR):gl;
+	if(peak*gl>vnf->mpeakl) vnf->mpeakl=peak*gl;
+	if(peak*gr>vnf->mpeakr) vnf->mpeakr=peak*gr;
+	vnf->msuml+=sum*gl*gl;
+	vnf->msumr+=sum*gr*gr;
+	vnf->mtaps+=taps;
+}
+
+static UWORD MeterLevel(float x)
+{
+	return (x>=32767.0f)?32767:(UWORD)(x+0.5f);
+}
+
+/* Publishes the levels of the voices mixed in the block, and the level of
+   the count frames of output in vc_tickbuf */
+static void PublishMeters(NATIVE count)
+{
+	int back=(vc_meterseq+1)&1,chans=(vc_mode&DMODE_STEREO)?2:1,t;
+	float peak[2]={0,0},sum[2]={0,0},x;
+	MMETER *m=vc_meters[back];
+	NATIVE i,taps=0;
+	VINFO *v;
+
+	for(t=0;t<vc_softchn;t++,m++) {
+		v=&vmix[t];
+		m->peakl=MeterLevel(v->mpeakl);
+		m->peakr=MeterLevel(v->mpeakr);
+		m->rmsl=v->mtaps?MeterLevel(sqrt(v->msuml/v->mtaps)):0;
+		m->rmsr=v->mtaps?MeterLevel(sqrt(v->msumr/v->mtaps)):0;
+		v->mpeakl=v->mpeakr=v->msuml=v->msumr=0;
+		v->mtaps=0;
+	}
+	vc_metervoices[back]=vc_softchn;
+
+	for(i=0;i<count;i+=METERSTEP,taps++)
+		for(t=0;t<chans;t++) {
+			if(vc_mode & DMODE_FLOATMIX)
+				x=((float*)vc_tickbuf)[i*chans+t];
+			else
+				x=vc_tickbuf[i*chans+t]*(1.0f/MAXVOL_FACTOR);
+			if(x<0) x=-x;
+			if(x>peak[t]) peak[t]=x;
+			sum[t]+=x*x;
+		}
+	m=&vc_meters[back][MAXMETERS];
+	m->peakl=MeterLevel(peak[0]);
+	m->peakr=MeterLevel(peak[chans-1]);
+	m->rmsl=taps?MeterLevel(sqrt(sum[0]/taps)):0;
+	m->rmsr=taps?MeterLevel(sqrt(sum[chans-1]/taps)):0;
+
+	METER_BARRIER();
+	vc_meterseq++;
+}
+
+/* Publishes silence, when the mixer stops */
+static void ClearMeters(void)
+{
+	int back=(vc_meterseq+1)&1;
+
+	vc_metervoices[back]=0;
+	memset(&vc_meters[back][MAXMETERS],0,sizeof(MMETER));
+	METER_BARRIER();
+	vc_meterseq++;
+}
+
+/* Copies the levels of count voices from voice first, and of the output,
+   measured in the last block. Returns the number of voices copied. Can be
+   called from any thread. */
+int VC2_GetMeters(MMETER* voices,int first,int count,MMETER* output)
+{
+	ULONG seq;
+	int n;
+
+	do {
+		seq=vc_meterseq;
+		METER_BARRIER();
+		n=vc_metervoices[seq&1]-first;
+		n=(n<0)?0:(n>count)?count:n;
+		if(voices && n)
+			memcpy(voices,&vc_meters[seq&1][first],n*sizeof(MMETER));
+		if(output)
+			*output=vc_meters[seq&1][MAXMETERS];
+		METER_BARRIER();
+	} while(seq!=vc_meterseq);
+
+	return n;
+}
+
+/*========== ADPCM compressed samples */
+
+/* The long samples picked by Compressible are kept as 4 bit IMA ADPCM, in
+   blocks which decode on their own: a block starts with its first sample
+   and the step index, followed by the codes of the other samples, low nibble
+   first. The mixer decodes the blocks a voice plays into a window of its
+   own, see MixCompressed. */
+#define ADPCMBLOCK  128                 /* samples per block */
+#define ADPCMBYTES  (4+ADPCMBLOCK/2)    /* bytes per block */
+#define ADPCMWINDOW (4*ADPCMBLOCK)      /* samples decoded per voice */
+
+static const SWORD adpcm_steps[89]={
+	    7,    8,    9,   10,   11,   12,   13,   14,   16,   17,
+	   19,   21,   23,   25,   28,   31,   34,   37,   41,   45,
+	   50,   55,   60,   66,   73,   80,   88,   97,  107,  118,
+	  130,  143,  157,  173,  190,  209,  230,  253,  279,  307,
+	  337,  371,  408,  449,  494,  544,  598,  658,  724,  796,
+	  876,  963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	 5894, 6484, 7132, 7845, 8630, 9493,10442,11487,12635,13899,
+	15289,16818,18500,20350,22385,24623,27086,29794,32767
+};
+static const SBYTE adpcm_index[8]={-1,-1,-1,-1,2,4,6,8};
+
+static	int vc_compressed=0;      /* compressed handles loaded */
+static	SWORD *vc_windows=NULL;   /* ADPCMWINDOW samples per voice */
+static	int vc_numwindows=0;
+
+static __inline SLONG AdpcmStep(SLONG pred,int* index,int code)
+{
+	SLONG step=adpcm_steps[*index],diff=step>>3;
+
+	if(code&4) diff+=step;
+	if(code&2) diff+=step>>1;
+	if(code&1) diff+=step>>2;
+	pred+=(code&8)?-diff:diff;
+	pred=(pred>32767)?32767:(pred<-32768)?-32768:pred;
+	*index+=adpcm_index[code&7];
+	*index=(*index<0)?0:(*index>88)?88:*index;
+	return pred;
+}
+
+/* Replaces the first count samples of a 16 bit handle by their ADPCM blocks */
+static int CompressSample(int handle,ULONG count)
+{
+	ULONG blocks=(count+ADPCMBLOCK-1)/ADPCMBLOCK,b,k,n;
+	const SWORD *src=Samples[handle];
+	UBYTE *data,*blk;
+	SLONG pred,diff,step;
+	int index=0,code;
+
+	if(!(data=(UBYTE*)MikMod_amalloc(blocks*ADPCMBYTES)))
+		return 1;
+
+	for(b=0;b<blocks;b++,src+=ADPCMBLOCK) {
+		n=MIN(count-b*ADPCMBLOCK,ADPCMBLOCK);
+		blk=data+b*ADPCMBYTES;
+		pred=src[0];
+		blk[0]=pred&0xff;
+		blk[1]=(pred>>8)&0xff;
+		blk[2]=index;
+		blk[3]=0;
+		memset(blk+4,0,ADPCMBLOCK/2);
+
+		for(k=1;k<n;k++) {
+			diff=src[k]-pred;
+			code=0;
+			if(diff<0) {
+				code=8;
+				diff=-diff;
+			}
+			step=adpcm_steps[index];
+			if(diff>=step) { code|=4; diff-=step; }
+			step>>=1;
+			if(diff>=step) { code|=2; diff-=step; }
+			step>>=1;
+			if(diff>=step) code|=1;
+
+			pred=AdpcmStep(pred,&index,code);
+			blk[4+((k-1)>>1)]|=code<<(((k-1)&1)<<2);
+		}
+	}
+
+	MikMod_afree(Samples[handle]);
+	Samples[handle]=(SWORD*)data;
+	vc_adpcm[handle]=count;
+	vc_compressed++;
+	return 0;
+}
+
+static void DecodeBlock(const UBYTE* blk,SWORD* out,ULONG n)
+{
+	SLONG pred=(SWORD)(blk[0]|(blk[1]<<8));
+	int index=blk[2];
+	ULONG k;
+
+	out[0]=(SWORD)pred;
+	for(k=1;k<n;k++) {
+		pred=AdpcmStep(pred,&index,(blk[4+((k-1)>>1)]>>(((k-1)&1)<<2))&15);
+		out[k]=(SWORD)pred;
+	}
+}
+
+/* Decodes count samples of a compressed handle from first on, the samples
+   past its end read as silence */
+static void DecodeSamples(int handle,ULONG first,ULONG count,SWORD* out)
+{
+	const UBYTE *data=(const UBYTE*)Samples[handle];
+	ULONG size=vc_adpcm[handle],b,ofs,n,len;
+	SWORD block[ADPCMBLOCK];
+
+	while(count) {
+		if(first>=size) {
+			memset(out,0,count*sizeof(SWORD));
+			return;
+		}
+		b=first/ADPCMBLOCK;
+		ofs=first%ADPCMBLOCK;
+		len=MIN(size-b*ADPCMBLOCK,ADPCMBLOCK);
+		n=MIN(len-ofs,count);
+
+		if(!ofs && n==ADPCMBLOCK)
+			DecodeBlock(data+b*ADPCMBYTES,out,n);
+		else {
+			DecodeBlock(data+b*ADPCMBYTES,block,ofs+n);
+			memcpy(out,block+ofs,n*sizeof(SWORD));
+		}
+		first+=n;
+		out+=n;
+		count-=n;
+	}
+}
+
+/* Gives every voice a window once compressed samples are loaded */
+static int AllocWindows(void)
+{
+	int t;
+
+	if(!vc_compressed || vc_numwindows>=vc_softchn)
+		return 0;
+
+	MikMod_free(vc_windows);
+	vc_numwindows=0;
+	if(!(vc_windows=(SWORD*)MikMod_malloc(vc_softchn*ADPCMWINDOW*sizeof(SWORD))))
+		return 1;
+	vc_numwindows=vc_softchn;
+	for(t=0;t<vc_softchn;t++)
+		vmix[t].wend=0;
+	return 0;
+}
+
+/*========== Streamed samples */
+
+/* The long samples picked by Streamable are not loaded. They are read again
+   from the reader of their module while they play, and only their first
+   window and their loop stay resident. Every mixer voice has STREAMSLOTS
+   windows, holding the part of the sample it plays and the next one, which
+   MixStreamed asks for ahead of the voice. The windows are read by a reader
+   thread, or before the next part of the buffer is mixed when there are no
+   threads. A voice reaching a window which is not read yet plays on silently,
+   and the miss is counted. */
+#define STREAMWINDOW 4096   /* samples per window, window 0 stays resident */
+#define STREAMSLOTS  2      /* windows per voice */
+
+typedef struct VSTREAM {
+	MREADER* reader;        /* source of the sample, owned by the caller */
+	long     pos;           /* offset of the sample data, without iobase */
+	UWORD    infmt;         /* format of the sample data */
+	ULONG    length;
+	ULONG    loopstart;     /* the sample is streamed up to there */
+	ULONG    loopend;
+	SWORD*   loop;          /* resident loop and unclick samples, or NULL */
+	UWORD*   delta;         /* value before each window of delta samples */
+	ULONG    bytes;         /* resident memory */
+} VSTREAM;
+
+#define WINDOW_EMPTY  0
+#define WINDOW_WANTED 1     /* to be read, only the reader touches it */
+#define WINDOW_READY  2
+
+typedef struct VWINDOW {
+	int      state;
+	SWORD    handle;
+	ULONG    start;         /* first sample, a multiple of STREAMWINDOW */
+	SWORD    data[STREAMWINDOW+1];
+} VWINDOW;
+
+static	VSTREAM *vc_streams[MAXSAMPLEHANDLES];
+static	int vc_streamed=0;        /* streamed handles loaded */
+static	VWINDOW *vc_slots=NULL;   /* STREAMSLOTS windows per voice */
+static	int vc_numslots=0;
+static	ULONG vc_streamreads=0;   /* windows read */
+static	ULONG vc_streammisses=0;  /* windows needed before they were read */
+
+#ifdef HAVE_MIXER_THREADS
+static	pthread_t vc_reader;
+static	int vc_readerup=0,vc_readerwork=0,vc_readerquit=0;
+static	pthread_mutex_t vc_readmutex=PTHREAD_MUTEX_INITIALIZER; /* held while reading */
+static	pthread_mutex_t vc_wakemutex=PTHREAD_MUTEX_INITIALIZER;
+static	pthread_cond_t vc_wake=PTHREAD_COND_INITIALIZER;
+
+#define WINDOW_GET(x)   __atomic_load_n(&(x),__ATOMIC_ACQUIRE)
+#define WINDOW_SET(x,v) __atomic_store_n(&(x),(v),__ATOMIC_RELEASE)
+#define STREAM_COUNT(x) __atomic_fetch_add(&(x),1,__ATOMIC_RELAXED)
+#define STREAM_LOCK()   pthread_mutex_lock(&vc_readmutex)
+#define STREAM_UNLOCK() pthread_mutex_unlock(&vc_readmutex)
+#else
+#define WINDOW_GET(x)   (x)
+#define WINDOW_SET(x,v) ((x)=(v))
+#define STREAM_COUNT(x) ((x)++)
+#define STREAM_LOCK()
+#define STREAM_UNLOCK()
+#endif
+
+/* Reads the samples of a window from the source of its handle, converting
+   them the way SL_Load does. The raw data is read at the end of the window,
+   so that it can be converted in place. */
+static void ReadWindow(VWINDOW* w)
+{
+	const VSTREAM *st=vc_streams[w->handle];
+	ULONG n=0,k,bps=1;
+	UWORD v,acc=0,flip;
+	UBYTE *raw;
+
+	if(st && (w->start<st->length)) {
+		n=MIN(st->length-w->start,STREAMWINDOW+1);
+		bps=(st->infmt&SF_16BITS)?2:1;
+		raw=(UBYTE*)w->data+sizeof(w->data)-n*bps;
+
+		if(_mm_fseek(st->reader,st->pos+w->start*bps-st->reader->iobase,SEEK_SET) ||
+		   !st->reader->Read(st->reader,raw,n*bps))
+			n=0;
+
+		if(st->delta) acc=st->delta[w->start/STREAMWINDOW];
+		flip=(st->infmt&SF_SIGNED)?0:0x8000;
+		for(k=0;k<n;k++) {
+			if(bps==1)
+				v=raw[k]<<8;
+			else if(st->infmt&SF_BIG_ENDIAN)
+				v=(raw[2*k]<<8)|raw[2*k+1];
+			else
+				v=raw[2*k]|(raw[2*k+1]<<8);
+			if(st->delta) v=acc+=v;
+			w->data[k]=(SWORD)(v^flip);
+		}
+	}
+	memset(w->data+n,0,(STREAMWINDOW+1-n)*sizeof(SWORD));
+}
+
+/* Reads the windows which are wanted */
+static void ReadWindows(void)
+{
+	int t;
+
+	STREAM_LOCK();
+	for(t=0;t<vc_numslots;t++)
+		if(WINDOW_GET(vc_slots[t].state)==WINDOW_WANTED) {
+			ReadWindow(&vc_slots[t]);
+			STREAM_COUNT(vc_streamreads);
+			WINDOW_SET(vc_slots[t].state,WINDOW_READY);
+		}
+	STREAM_UNLOCK();
+}
+
+#ifdef HAVE_MIXER_THREADS
+static void* ReaderThread(void* arg)
+{
+	pthread_mutex_lock(&vc_wakemutex);
+	for(;;) {
+		while(!vc_readerquit && !vc_readerwork)
+			pthread_cond_wait(&vc_wake,&vc_wakemutex);
+		if(vc_readerquit)
+			break;
+		vc_readerwork=0;
+		pthread_mutex_unlock(&vc_wakemutex);
+
+		ReadWindows();
+
+		pthread_mutex_lock(&vc_wakemutex);
+	}
+	pthread_mutex_unlock(&vc_wakemutex);
+	return NULL;
+}
+
+static void StopReader(void)
+{
+	if(!vc_readerup)
+		return;
+	pthread_mutex_lock(&vc_wakemutex);
+	vc_readerquit=1;
+	pthread_cond_signal(&vc_wake);
+	pthread_mutex_unlock(&vc_wakemutex);
+	pthread_join(vc_reader,NULL);
+	vc_readerup=vc_readerquit=0;
+}
+#endif
+
+/* Gets the windows read, now or soon */
+static void WakeReader(void)
+{
+#ifdef HAVE_MIXER_THREADS
+	if(vc_readerup) {
+		pthread_mutex_lock(&vc_wakemutex);
+		vc_readerwork=1;
+		pthread_cond_signal(&vc_wake);
+		pthread_mutex_unlock(&vc_wakemutex);
+	}
+#endif
+}
+
+/* Returns the window of slots holding or about to hold start of handle */
+static VWINDOW* FindWindow(VWINDOW* slots,int handle,ULONG start)
+{
+	int t;
+
+	if(slots)
+		for(t=0;t<STREAMSLOTS;t++)
+			if((WINDOW_GET(slots[t].state)!=WINDOW_EMPTY)&&
+			   (slots[t].handle==handle)&&(slots[t].start==start))
+				return &slots[t];
+	return NULL;
+}
+
+/* Asks for a window in one of slots other than keep, unless it is there
+   already or all the other windows are still to be read */
+static void RequestWindow(VWINDOW* slots,int handle,ULONG start,const VWINDOW* keep)
+{
+	int t;
+
+	if(!slots || FindWindow(slots,handle,start))
+		return;
+	for(t=0;t<STREAMSLOTS;t++)
+		if((&slots[t]!=keep)&&(WINDOW_GET(slots[t].state)!=WINDOW_WANTED)) {
+			slots[t].handle=handle;
+			slots[t].start=start;
+			WINDOW_SET(slots[t].state,WINDOW_WANTED);
+			WakeReader();
+			return;
+		}
+}
+
+/* Loads what stays resident of a streamed sample: the sample is decoded once,
+   window by window, to keep the first window, the loop, and the values the
+   windows of delta samples start from. Returns 0 on success. */
+static int LoadStream(int handle,SAMPLOAD* sload,ULONG loopstart,ULONG loopend,UWORD flags)
+{
+	ULONG length=sload->length,looplen=loopend-loopstart,t,n,k;
+	UWORD flip=(sload->infmt&SF_SIGNED)?0:0x8000;
+	VSTREAM *st;
+	SWORD *chunk;
+
+	if(!(Samples[handle]=(SWORD*)MikMod_amalloc((STREAMWINDOW+1)*sizeof(SWORD))))
+		return 1;
+	memset(Samples[handle],0,(STREAMWINDOW+1)*sizeof(SWORD));
+	if(!(st=(VSTREAM*)MikMod_calloc(1,sizeof(VSTREAM))))
+		return 1;
+	vc_streams[handle]=st;
+	vc_streamed++;
+
+	st->reader=sload->reader;
+	st->pos=_mm_ftell(sload->reader)+sload->reader->iobase;
+	st->infmt=sload->infmt;
+	st->length=length;
+	st->loopstart=(flags&SF_LOOP)?loopstart:length;
+	st->loopend=loopend;
+	st->bytes=(STREAMWINDOW+1)*sizeof(SWORD);
+	if(flags&SF_LOOP) {
+		if(!(st->loop=(SWORD*)MikMod_amalloc((looplen+16)*sizeof(SWORD))))
+			return 1;
+		memset(st->loop,0,(looplen+16)*sizeof(SWORD));
+		st->bytes+=(looplen+16)*sizeof(SWORD);
+	}
+	if(sload->infmt&SF_DELTA) {
+		n=(length+STREAMWINDOW-1)/STREAMWINDOW;
+		if(!(st->delta=(UWORD*)MikMod_malloc(n*sizeof(UWORD))))
+			return 1;
+		st->bytes+=n*sizeof(UWORD);
+	}
+	if(!(chunk=(SWORD*)MikMod_malloc(STREAMWINDOW*sizeof(SWORD))))
+		return 1;
+
+	for(t=0;t<length;t+=n) {
+		n=MIN(length-t,STREAMWINDOW);
+		if(st->delta)
+			st->delta[t/STREAMWINDOW]=t?(UWORD)chunk[STREAMWINDOW-1]^flip:0;
+		if(SL_Load(chunk,sload,n)) {
+			MikMod_free(chunk);
+			return 1;
+		}
+		for(k=t;(k<t+n)&&(k<=STREAMWINDOW);k++)
+			Samples[handle][k]=chunk[k-t];
+		if(st->loop)
+			for(k=(t>loopstart)?t:loopstart;k<MIN(t+n,loopend);k++)
+				st->loop[k-loopstart]=chunk[k-t];
+	}
+	MikMod_free(chunk);
+
+	/* unclick the loop, as for the samples which are loaded */
+	if(st->loop) {
+		if(flags&SF_BIDI)
+			for(t=0;t<16 && t<looplen;t++)
+				st->loop[looplen+t]=st->loop[looplen-t-1];
+		else
+			for(t=0;t<16 && t<looplen;t++)
+				st->loop[looplen+t]=st->loop[t];
+	}
+	return 0;
+}
+
+/* Frees what a streamed handle keeps, once its windows are not read anymore */
+static void FreeStream(int handle)
+{
+	VSTREAM *st=vc_streams[handle];
+	int t;
+
+	STREAM_LOCK();
+	for(t=0;t<vc_numslots;t++)
+		if(vc_slots[t].handle==handle)
+			WINDOW_SET(vc_slots[t].state,WINDOW_EMPTY);
+	vc_streams[handle]=NULL;
+	STREAM_UNLOCK();
+
+	MikMod_afree(st->loop);
+	MikMod_free(st->delta);
+	MikMod_free(st);
+	vc_streamed--;
+}
+
+/* Reads the resident samples of a streamed handle, the others read as
+   silence */
+static void StreamSamples(int handle,ULONG first,ULONG count,SWORD* out)
+{
+	const VSTREAM *st=vc_streams[handle];
+	ULONG k,t;
+
+	for(k=0;k<count;k++) {
+		t=first+k;
+		if(st->loop && (t>=st->loopstart) && (t<st->loopend+16))
+			out[k]=st->loop[t-st->loopstart];
+		else if(t<=STREAMWINDOW)
+			out[k]=Samples[handle][t];
+		else
+			out[k]=0;
+	}
+}
+
+/* Gives every voice its windows once streamed samples are loaded, and starts
+   the reader */
+static int AllocStreamWindows(void)
+{
+	int ok=1;
+
+	if(!vc_streamed)
+		return 0;
+
+	if(vc_numslots<vc_softchn*STREAMSLOTS) {
+		STREAM_LOCK();
+		MikMod_free(vc_slots);
+		vc_numslots=0;
+		if((vc_slots=(VWINDOW*)MikMod_calloc(vc_softchn*STREAMSLOTS,sizeof(VWINDOW))))
+			vc_numslots=vc_softchn*STREAMSLOTS;
+		else
+			ok=0;
+		STREAM_UNLOCK();
+	}
+
+#ifdef HAVE_MIXER_THREADS
+	if(ok && !vc_readerup)
+		vc_readerup=!pthread_create(&vc_reader,NULL,ReaderThread,NULL);
+#endif
+	return !ok;
+}
+
+static void FreeStreamWindows(void)
+{
+	int t;
+
+#ifdef HAVE_MIXER_THREADS
+	StopReader();
+#endif
+	for(t=0;t<MAXSAMPLEHANDLES;t++)
+		if(vc_streams[t])
+			FreeStream(t);
+	MikMod_free(vc_slots);
+	vc_slots=NULL;
+	vc_numslots=0;
+}
+
+/* Reads count samples of a handle from first on as 16 bit, whichever way the
+   handle is kept */
+static void ReadSamples(int handle,ULONG first,ULONG count,SWORD* out)
+{
+	ULONG k;
+
+	if(vc_streams[handle])
+		StreamSamples(handle,first,count,out);
+	else if(vc_adpcm[handle])
+		DecodeSamples(handle,first,count,out);
+	else if(vc_smp8[handle])
+		for(k=0;k<count;k++)
+			out[k]=((const SBYTE*)Samples[handle])[first+k]*256;
+	else
+		memcpy(out,Samples[handle]+first,count*sizeof(SWORD));
+}
+
+/*========== Virtual voices */
+
+#define VIRT_SILENT 1 /* the voice would be mixed at zero volume */
+#define VIRT_CAPPED 2 /* the voice is not among the md_mixvoices loudest ones */
+
+/* Moves a virtual voice forward by todo samples in one step, when it is
+   playing forward. Returns 0 if the voice has to be stepped through. */
+static int AdvanceChannel(NATIVE todo)
+{
+	SLONGLONG len=idxlend-idxlpos;
+
+	if((vnf->flags&(SF_REVERSE|SF_BIDI))||(vnf->increment<=0))
+		return 0;
+
+	if(vnf->flags&SF_LOOP) {
+		if(len<=0)
+			return 0;
+		if(vnf->current>=idxlend)
+			vnf->current=idxlpos+(vnf->current-idxlend)%len;
+		vnf->current+=todo*vnf->increment;
+		if(vnf->current>=idxlend)
+			vnf->current=idxlpos+(vnf->current-idxlend)%len;
+	} else {
+		if((vnf->current>=idxsize)||
+		   ((idxsize-vnf->current)/vnf->increment+1<todo))
+			vnf->current=vnf->active=0;
+		else
+			vnf->current+=todo*vnf->increment;
+	}
+	return 1;
+}
+
+#define MAXPRIORITY 256
+
+/* The priority of a voice is its volume, which includes the envelopes, or
+   zero when it is inaudible with the volumes VC2_WriteSamples will use. */
+static int VoicePriority(const VINFO* v)
+{
+	int vol=(v->vol>MAXPRIORITY)?MAXPRIORITY:v->vol;
+
+	if(!(v->active||v->kick) || !v->frq || !vol)
+		return 0;
+	if(!(vc_mode&DMODE_STEREO))
+		return vol;
+	if(v->pan==PAN_SURROUND)
+		return ((vol*256L)/480)?vol:0;
+	return (((vol*(PAN_RIGHT-v->pan))>>8)||((vol*v->pan)>>8))?vol:0;
+}
+
+/* Decides which voices are really mixed during the next tick. Inaudible
+   voices become virtual, and so do the quietest ones when more than
+   md_mixvoices are left. Virtual voices only have their position updated, so
+   they can come back at any time. Voices are faded in and out when they
+   cross the limit, so that culling them does not click. */
+static void SelectVoices(void)
+{
+	UWORD count[MAXPRIORITY+1];
+	int t,prio,virt,cutoff=0,keep=0,audible=0,real=0,virtual=0,sum=0;
+	VINFO *v;
+
+	memset(count,0,sizeof(count));
+	for(t=0;t<vc_softchn;t++)
+		if((prio=VoicePriority(&vinf[t]))) {
+			count[prio]++;
+			audible++;
+		}
+
+	/* find the lowest priority which is still mixed, and how many of the
+	   voices at this priority fit */
+	if(md_mixvoices && audible>md_mixvoices) {
+		for(cutoff=MAXPRIORITY;sum+count[cutoff]<md_mixvoices;cutoff--)
+			sum+=count[cutoff];
+		keep=md_mixvoices-sum;
+	}
+
+	for(t=0;t<vc_softchn;t++) {
+		v=&vinf[t];
+		if(!(v->active||v->kick)) {
+			v->virt=0;
+			continue;
+		}
+
+		prio=VoicePriority(v);
+		if(!prio)
+			virt=VIRT_SILENT;
+		else if(prio>cutoff || (prio==cutoff && keep-- >0))
+			virt=0;
+		else
+			virt=VIRT_CAPPED;
+
+		if(((virt==VIRT_CAPPED)&&!v->virt)||((v->virt==VIRT_CAPPED)&&!virt))
+			v->rampvol=CLICK_BUFFER;
+		v->virt=virt;
+
+		if(virt) virtual++; else real++;
+	}
+	md_realvoices=real;
+	md_virtualvoices=virtual;
+}
+
+/* Mixes done samples of srce from the current index of vnf */
+static void MixSamples(const void* s,SLONG* ptr,NATIVE done,int bits8)
+{
+	MeterVoice(s,vnf->current,done,bits8);
+	if(vnf->filter) {
+		int layout=!(vc_mode&DMODE_STEREO)?FMIX_MONO:
+		           ((vnf->pan==PAN_SURROUND)&&(vc_mode&DMODE_SURROUND))?
+		           FMIX_SURROUND:FMIX_STEREO;
+
+		if(vc_mode & DMODE_FLOATMIX)
+			vnf->current=MixFloatFiltered
+					(s,(float*)ptr,vnf->current,vnf->increment,done,layout,bits8);
+		else
+			vnf->current=MixFiltered
+					(s,ptr,vnf->current,vnf->increment,done,layout,bits8);
+	} else
+	if(vc_mode & DMODE_FLOATMIX) {
+		if(vc_mode & DMODE_STEREO) {
+			if((vnf->pan==PAN_SURROUND)&&(vc_mode&DMODE_SURROUND))
+				vnf->current=MixFloatStereoSurround
+						(s,(float*)ptr,vnf->current,vnf->increment,done,bits8);
+			else
+				vnf->current=MixFloatStereoNormal
+						(s,(float*)ptr,vnf->current,vnf->increment,done,bits8);
+		} else
+			vnf->current=MixFloatMonoNormal
+						(s,(float*)ptr,vnf->current,vnf->increment,done,bits8);
+	} else
+#ifndef NATIVE_64BIT_INT
+	/* use the 32 bit mixers as often as we can (they're much faster) */
+	if((vnf->current<0x7fffffff)&&
+	   (vnf->current+done*vnf->increment<0x7fffffff)) {
+		if(vc_mode & DMODE_STEREO) {
+			if((vnf->pan==PAN_SURROUND)&&(vc_mode&DMODE_SURROUND))
+				vnf->current=(SLONGLONG)Mix32Surround
+						(s,ptr,vnf->current,vnf->increment,done,bits8);
+			else
+				vnf->current=Mix32Stereo
+						(s,ptr,vnf->current,vnf->increment,done,bits8);
+		} else
+			vnf->current=Mix32Mono
+						(s,ptr,vnf->current,vnf->increment,done,bits8);
+	}
+	else
+#endif
+	{
+		if(vc_mode & DMODE_STEREO) {
+			if((vnf->pan==PAN_SURROUND)&&(vc_mode&DMODE_SURROUND))
+				vnf->current=MixSurround
+						(s,ptr,vnf->current,vnf->increment,done,bits8);
+			else
+				vnf->current=MixStereo
+						(s,ptr,vnf->current,vnf->increment,done,bits8);
+		} else
+			vnf->current=MixMono
+						(s,ptr,vnf->current,vnf->increment,done,bits8);
+	}
+}
+
+/* Mixes done samples of a compressed handle through the window of vnf, which
+   is refilled whenever the voice leaves it */
+static void MixCompressed(SLONG* ptr,NATIVE done)
+{
+	int t=(int)(vnf-vmix);
+	SWORD *window;
+	SLONGLONG first,base,n;
+
+	if(t>=vc_numwindows) {
+		vnf->current+=done*vnf->increment;
+		return;
+	}
+	window=vc_windows+t*ADPCMWINDOW;
+
+	while(done>0) {
+		/* the window must hold the current sample and the next one */
+		first=vnf->current>>FRACBITS;
+		if((first<vnf->wstart)||(first+1>=vnf->wend)) {
+			/* forward voices get the blocks from the current one on, reverse
+			   voices the blocks up to it */
+			if(vnf->increment>0)
+				vnf->wstart=(SLONG)(first-first%ADPCMBLOCK);
+			else {
+				vnf->wstart=(SLONG)((first+ADPCMBLOCK+1)/ADPCMBLOCK*ADPCMBLOCK)
+				            -ADPCMWINDOW;
+				if(vnf->wstart<0) vnf->wstart=0;
+			}
+			vnf->wend=vnf->wstart+ADPCMWINDOW;
+			DecodeSamples(vnf->handle,vnf->wstart,ADPCMWINDOW,window);
+		}
+
+		base=(SLONGLONG)vnf->wstart<<FRACBITS;
+		if(vnf->increment>0)
+			n=(((SLONGLONG)(vnf->wend-1)<<FRACBITS)-vnf->current+
+			   vnf->increment-1)/vnf->increment;
+		else
+			n=(vnf->current-base)/-vnf->increment+1;
+		if(n>done) n=done;
+
+		vnf->current-=base;
+		MixSamples(window,ptr,n,0);
+		vnf->current+=base;
+
+		done-=n;
+		ptr+=(vc_mode&DMODE_STEREO)?(n<<1):n;
+	}
+}
+
+/* Mixes done samples of a streamed handle from its resident parts and the
+   windows of vnf, asking for the next window ahead of the voice */
+static void MixStreamed(SLONG* ptr,NATIVE done)
+{
+	int t=(int)(vnf-vmix),handle=vnf->handle;
+	const VSTREAM *st=vc_streams[handle];
+	VWINDOW *slots=((t+1)*STREAMSLOTS<=vc_numslots)?vc_slots+t*STREAMSLOTS:NULL;
+	VWINDOW *w;
+	const SWORD *data;
+	SLONGLONG first,start,end,next,base,n;
+
+	while(done>0) {
+		first=vnf->current>>FRACBITS;
+		if(st->loop && (first>=st->loopstart)) {
+			data=st->loop;
+			start=st->loopstart;
+			end=st->loopend+16;
+		} else {
+			/* window k holds the samples from k*STREAMWINDOW to the first
+			   sample of the next window */
+			start=first-first%STREAMWINDOW;
+			end=start+STREAMWINDOW+1;
+			w=NULL;
+			if(!start)
+				data=Samples[handle];
+			else if((w=FindWindow(slots,handle,(ULONG)start)) &&
+			        (WINDOW_GET(w->state)==WINDOW_READY))
+				data=w->data;
+			else {
+				data=NULL;
+				RequestWindow(slots,handle,(ULONG)start,NULL);
+				STREAM_COUNT(vc_streammisses);
+			}
+
+			next=(vnf->increment>0)?start+STREAMWINDOW:start-STREAMWINDOW;
+			if((next>0)&&(next<st->loopstart))
+				RequestWindow(slots,handle,(ULONG)next,w);
+		}
+
+		base=start<<FRACBITS;
+		if(vnf->increment>0)
+			n=(((end-1)<<FRACBITS)-vnf->current+vnf->increment-1)/vnf->increment;
+		else
+			n=(vnf->current-base)/-vnf->increment+1;
+		if(n>done) n=done;
+
+		if(data) {
+			vnf->current-=base;
+			MixSamples(data,ptr,n,0);
+			vnf->current+=base;
+		} else
+			vnf->current+=n*vnf->increment;
+
+		done-=n;
+		ptr+=(vc_mode&DMODE_STEREO)?(n<<1):n;
+	}
+}
 
 static void AddChannel(SLONG* ptr,NATIVE todo)
 {
 	SLONGLONG end,done;
 	SWORD *s;
+	int mixed,bits8;
 
 	if(!(s=Samples[vnf->handle])) {
 		vnf->current = vnf->active  = 0;
 		vnf->lastvalL = vnf->lastvalR = 0;
+		vnf->lastfL = vnf->lastfR = 0;
 		return;
 	}
 
+	bits8=vc_smp8[vnf->handle];
+
+	/* virtual voices are still mixed while they fade out */
+	mixed=!vnf->virt || vnf->rampvol ||
+	      (vnf->click && (vnf->lastvalL || vnf->lastvalR ||
+	                      vnf->lastfL || vnf->lastfR));
+	if(!mixed) {
+		vnf->lastvalL = vnf->lastvalR = 0;
+		vnf->lastfL = vnf->lastfR = 0;
+		if(AdvanceChannel(todo))
+			return;
+	}
+
 	/* update the 'current' index so the sample loops, or stops playing if it
 	   reached the end of the sample */
 	while(todo>0) {
@@ -1081,37 +2610,16 @@ static void AddChannel(SLONG* ptr,NATIVE todo)
 
 		endpos=vnf->current+done*vnf->increment;
 
-		if(vnf->vol || vnf->rampvol) {
-#ifndef NATIVE_64BIT_INT
-			/* use the 32 bit mixers as often as we can (they're much faster) */
-			if((vnf->current<0x7fffffff)&&(endpos<0x7fffffff)) {
-				if(vc_mode & DMODE_STEREO) {
-					if((vnf->pan==PAN_SURROUND)&&(vc_mode&DMODE_SURROUND))
-						vnf->current=(SLONGLONG)Mix32StereoSurround
-								(s,ptr,vnf->current,vnf->increment,done);
-					else
-						vnf->current=Mix32StereoNormal
-								(s,ptr,vnf->current,vnf->increment,done);
-				} else
-					vnf->current=Mix32MonoNormal
-								(s,ptr,vnf->current,vnf->increment,done);
-			}
+		if(mixed && (vnf->vol || vnf->rampvol)) {
+			if(vc_streams[vnf->handle])
+				MixStreamed(ptr,done);
+			else if(vc_adpcm[vnf->handle])
+				MixCompressed(ptr,done);
 			else
-#endif
-			{
-				if(vc_mode & DMODE_STEREO) {
-					if((vnf->pan==PAN_SURROUND)&&(vc_mode&DMODE_SURROUND))
-						vnf->current=MixStereoSurround
-								(s,ptr,vnf->current,vnf->increment,done);
-					else
-						vnf->current=MixStereoNormal
-								(s,ptr,vnf->current,vnf->increment,done);
-				} else
-					vnf->current=MixMonoNormal
-								(s,ptr,vnf->current,vnf->increment,done);
-			}
+				MixSamples(s,ptr,done,bits8);
 		} else  {
 			vnf->lastvalL = vnf->lastvalR = 0;
+			vnf->lastfL = vnf->lastfR = 0;
 			/* update sample position */
 			vnf->current=endpos;
 		}
@@ -1122,6 +2630,7 @@ static void AddChannel(SLONG* ptr,NATIVE todo)
 }
 
 #define _IN_VIRTCH_
+#define _IN_VIRTCH2_
 
 #define VC1_SilenceBytes      VC2_SilenceBytes
 #define VC1_WriteSamples      VC2_WriteSamples
@@ -1142,93 +2651,518 @@ static void AddChannel(SLONG* ptr,NATIVE todo)
 #define VC1_SampleSpace       VC2_SampleSpace
 #define VC1_SampleLength      VC2_SampleLength
 #define VC1_VoiceRealVolume   VC2_VoiceRealVolume
+#define VC1_GetSampleStats    VC2_GetSampleStats
 
 #include "virtch_common.c"
+#undef _IN_VIRTCH2_
 #undef _IN_VIRTCH_
 
-void VC2_WriteSamples(SBYTE* buf,ULONG todo)
+/* Sets the resonant filter of a voice, which is off at cutoff 127 and
+   resonance 0 */
+void VC2_VoiceSetFilter(UBYTE voice,UBYTE cutoff,UBYTE resonance)
 {
-	int left,portion=0;
-	SBYTE *buffer;
-	int t,pan,vol;
+	vinf[voice].cutoff=(cutoff>127)?127:cutoff;
+	vinf[voice].resonance=(resonance>127)?127:resonance;
+}
 
-	todo*=SAMPLING_FACTOR;
+/*========== Block mixing */
 
-	while(todo) {
+/* The player does not touch the voices the mixer works on. It sets up the
+   voices in vinf, and the changes it makes during a tick are recorded as
+   events at the offset of the tick in the output block. The mixer then plays
+   each voice in vmix across the whole block, applying its events on the way,
+   so that a voice is only set up again when something changed. */
+
+static void GetControl(VCTRL* c,const VINFO* v)
+{
+	c->flags  = v->flags;
+	c->handle = v->handle;
+	c->start  = v->start;
+	c->size   = v->size;
+	c->reppos = v->reppos;
+	c->repend = v->repend;
+	c->frq    = v->frq;
+	c->vol    = v->vol;
+	c->pan    = v->pan;
+	c->virt   = v->virt;
+	c->cutoff = v->cutoff;
+	c->resonance = v->resonance;
+}
+
+/* Records the changes made to the voices since the last call, at offset
+   samples into the block. */
+static void RecordEvents(ULONG offset)
+{
+	int t,what;
+	VINFO *v,*m;
+	VEVENT *e;
+
+	for(t=0;t<vc_softchn;t++) {
+		v=&vinf[t];
+		what=0;
+		if(v->wasactive && !v->active) what|=EV_STOP;
+		if(v->rampvol) what|=EV_RAMP;
+		if(v->kick) {
+			/* the voice plays from now on, as far as the player can tell */
+			what|=EV_KICK;
+			v->active=(v->frq!=0);
+			v->current=((SLONGLONG)(v->start))<<FRACBITS;
+		}
+		v->kick=v->rampvol=0;
+		v->wasactive=v->active;
+
+		/* the sample parameters only change with a kick */
+		m=&vmix[t];
+		e=(m->lastev>=0)?&vc_events[m->lastev]:NULL;
+		if(!what && (e?(e->ctl.frq==v->frq && e->ctl.vol==v->vol &&
+		                e->ctl.pan==v->pan && e->ctl.virt==v->virt &&
+		                e->ctl.cutoff==v->cutoff &&
+		                e->ctl.resonance==v->resonance):
+		               (m->frq==v->frq && m->vol==v->vol &&
+		                m->pan==v->pan && m->virt==v->virt &&
+		                m->cutoff==v->cutoff && m->resonance==v->resonance)))
+			continue;
+
+		e=&vc_events[vc_numevents];
+		GetControl(&e->ctl,v);
+		e->offset=offset;
+		e->what=what;
+		e->next=-1;
+		if(m->lastev>=0)
+			vc_events[m->lastev].next=vc_numevents;
+		else
+			m->firstev=vc_numevents;
+		m->lastev=vc_numevents++;
+	}
+}
+
+/* Moves the voices of the player forward by todo samples, so that the player
+   sees the one-shot samples end when the mixer will stop them. */
+static void FollowVoices(NATIVE todo)
+{
+	SLONGLONG increment;
+	int t;
+	VINFO *v;
+
+	for(t=0;t<vc_softchn;t++) {
+		v=&vinf[t];
+		if(!v->active || (v->flags&SF_LOOP))
+			continue;
+
+		increment=((SLONGLONG)(v->frq)<<(FRACBITS-SAMPLING_SHIFT))/md_mixfreq;
+		if(v->flags&SF_REVERSE)
+			v->current-=todo*increment;
+		else
+			v->current+=todo*increment;
+
+		if(!Samples[v->handle] || (v->current<0) ||
+		   (v->current>=((SLONGLONG)(v->size)<<FRACBITS)-1)) {
+			v->current=0;
+			v->active=v->wasactive=0;
+		}
+	}
+}
+
+/* Runs the player for the ticks starting in the next todo samples and
+   returns the length of the block, which is shorter when the event list
+   fills up. */
+static ULONG CollectEvents(ULONG todo)
+{
+	ULONG pos=0,last=0,left;
+	int t;
+
+	vc_numevents=0;
+	for(t=0;t<vc_softchn;t++)
+		vmix[t].firstev=vmix[t].lastev=-1;
+
+	/* changes made outside of the player, e.g. by sound effects */
+	RecordEvents(0);
+
+	while(pos<todo) {
 		if(!tickleft) {
+			if(pos && vc_numevents+vc_softchn>MAXEVENTS)
+				break;
+			if(pos>last) {
+				FollowVoices((pos-last)<<SAMPLING_SHIFT);
+				last=pos;
+			}
 			if(vc_mode & DMODE_SOFT_MUSIC) md_player();
-			tickleft=(md_mixfreq*125L*SAMPLING_FACTOR)/(md_bpm*50L);
-			tickleft&=~(SAMPLING_FACTOR-1);
+			SelectVoices();
+			RecordEvents(pos);
+			tickleft=(md_mixfreq*125L)/(md_bpm*50L);
 		}
-		left = MIN(tickleft, todo);
-		buffer    = buf;
-		tickleft -= left;
-		todo     -= left;
-		buf += samples2bytes(left)/SAMPLING_FACTOR;
-
-		while(left) {
-			portion = MIN(left, samplesthatfit);
-			memset(vc_tickbuf,0,portion<<((vc_mode&DMODE_STEREO)?3:2));
-			for(t=0;t<vc_softchn;t++) {
-				vnf = &vinf[t];
-
-				if(vnf->kick) {
-					vnf->current=((SLONGLONG)(vnf->start))<<FRACBITS;
-					vnf->kick    = 0;
-					vnf->active  = 1;
-					vnf->click   = CLICK_BUFFER;
-					vnf->rampvol = 0;
-				}
+		left=MIN((ULONG)tickleft,todo-pos);
+		tickleft-=left;
+		pos+=left;
+	}
+	return pos;
+}
 
-				if(!vnf->frq) vnf->active = 0;
-
-				if(vnf->active) {
-					vnf->increment=((SLONGLONG)(vnf->frq)<<(FRACBITS-SAMPLING_SHIFT))
-					               /md_mixfreq;
-					if(vnf->flags&SF_REVERSE) vnf->increment=-vnf->increment;
-					vol = vnf->vol;  pan = vnf->pan;
-
-					vnf->oldlvol=vnf->lvolsel;vnf->oldrvol=vnf->rvolsel;
-					if(vc_mode & DMODE_STEREO) {
-						if(pan!=PAN_SURROUND) {
-							vnf->lvolsel=(vol*(PAN_RIGHT-pan))>>8;
-							vnf->rvolsel=(vol*pan)>>8;
-						} else {
-							vnf->lvolsel=vnf->rvolsel=(vol * 256L) / 480;
-						}
-					} else
-						vnf->lvolsel=vol;
-
-					idxsize=(vnf->size)?((SLONGLONG)(vnf->size)<<FRACBITS)-1:0;
-					idxlend=(vnf->repend)?((SLONGLONG)(vnf->repend)<<FRACBITS)-1:0;
-					idxlpos=(SLONGLONG)(vnf->reppos)<<FRACBITS;
-					AddChannel(vc_tickbuf,portion);
-				}
-			}
+static void ApplyEvent(VINFO* v,const VEVENT* e)
+{
+	if(e->what&EV_KICK) {
+		v->flags  = e->ctl.flags;
+		v->handle = e->ctl.handle;
+		v->start  = e->ctl.start;
+		v->size   = e->ctl.size;
+		v->reppos = e->ctl.reppos;
+		v->repend = e->ctl.repend;
+		v->kick   = 1;
+	}
+	if(e->what&EV_STOP) v->active=0;
+	if(e->what&EV_RAMP) v->rampvol=CLICK_BUFFER;
+	v->frq  = e->ctl.frq;
+	v->vol  = e->ctl.vol;
+	v->pan  = e->ctl.pan;
+	v->virt = e->ctl.virt;
+	v->cutoff = e->ctl.cutoff;
+	v->resonance = e->ctl.resonance;
+}
+
+/* Sets up vnf for its current parameters, and mixes count samples of it */
+static void MixSegment(SLONG* ptr,NATIVE count)
+{
+	int pan,vol;
+
+	if(vnf->kick) {
+		vnf->current=((SLONGLONG)(vnf->start))<<FRACBITS;
+		vnf->kick    = 0;
+		vnf->active  = 1;
+		vnf->click   = CLICK_BUFFER;
+		vnf->rampvol = 0;
+		vnf->fy1  = vnf->fy2  = 0;
+		vnf->ffy1 = vnf->ffy2 = 0;
+		vnf->wend = 0;
+	}
+
+	if(!vnf->frq) vnf->active = 0;
+
+	if(!vnf->active)
+		return;
 
-			if(md_mode & DMODE_NOISEREDUCTION) {
-				MixLowPass(vc_tickbuf, portion);
+	vnf->increment=((SLONGLONG)(vnf->frq)<<(FRACBITS-SAMPLING_SHIFT))
+	               /md_mixfreq;
+	if(vnf->flags&SF_REVERSE) vnf->increment=-vnf->increment;
+	vol = (vnf->virt)?0:vnf->vol;  pan = vnf->pan;
+
+	vnf->oldlvol=vnf->lvolsel;vnf->oldrvol=vnf->rvolsel;
+	if(vc_mode & DMODE_STEREO) {
+		if(pan!=PAN_SURROUND) {
+			vnf->lvolsel=(vol*(PAN_RIGHT-pan))>>8;
+			vnf->rvolsel=(vol*pan)>>8;
+		} else {
+			vnf->lvolsel=vnf->rvolsel=(vol * 256L) / 480;
+		}
+	} else
+		vnf->lvolsel=vol;
+
+	if(vc_mode & DMODE_FLOATMIX) {
+		vnf->oldlgain=vnf->lgain;vnf->oldrgain=vnf->rgain;
+		if(vc_mode & DMODE_STEREO) {
+			if(pan!=PAN_SURROUND) {
+				vnf->lgain=vol*(PAN_RIGHT-pan)*(1.0f/(256*MAXVOL_FACTOR));
+				vnf->rgain=vol*pan*(1.0f/(256*MAXVOL_FACTOR));
+			} else {
+				vnf->lgain=vnf->rgain=vol*(256.0f/(480*MAXVOL_FACTOR));
 			}
+		} else
+			vnf->lgain=vol*(1.0f/MAXVOL_FACTOR);
+	}
+
+	SetupFilter(vnf);
+
+	idxsize=(vnf->size)?((SLONGLONG)(vnf->size)<<FRACBITS)-1:0;
+	idxlend=(vnf->repend)?((SLONGLONG)(vnf->repend)<<FRACBITS)-1:0;
+	idxlpos=(SLONGLONG)(vnf->reppos)<<FRACBITS;
+	AddChannel(ptr,count);
+}
+
+/* Mixes voice t across a block of todo samples, into dest */
+static void MixVoice(int t,SLONG* dest,ULONG todo)
+{
+	int ev=vmix[t].firstev;
+	ULONG pos=0,end;
+
+	vnf=&vmix[t];
+	if(ev<0 && !vnf->active)
+		return;
+
+	while(pos<todo) {
+		for(;ev>=0 && vc_events[ev].offset<=pos;ev=vc_events[ev].next)
+			ApplyEvent(vnf,&vc_events[ev]);
+		end=(ev>=0)?vc_events[ev].offset:todo;
+		MixSegment(dest+((pos<<SAMPLING_SHIFT)<<((vc_mode&DMODE_STEREO)?1:0)),
+		           (end-pos)<<SAMPLING_SHIFT);
+		pos=end;
+	}
+}
+
+/*========== Mixer threads */
+
+/* The voices of a block are split into groups, which are mixed by a pool of
+   threads into buffers of their own, and added up in order afterwards. The
+   groups only depend on the voices which play, so that the output does not
+   depend on the number of threads. Float mixing rounds each addition, so
+   without a pool it still goes through the groups, on the calling thread. */
+
+#ifdef HAVE_MIXER_THREADS
+
+#define MAXMIXTHREADS 8   /* including the calling thread */
+#define MIXGROUPS     8
+#define GROUPVOICES   4   /* fewest voices in a group */
 
-			if(md_reverb) {
-				if(md_reverb>15) md_reverb=15;
+static	pthread_t vc_threads[MAXMIXTHREADS];
+static	int vc_numthreads=0;  /* started threads */
+static	pthread_mutex_t vc_poolmutex=PTHREAD_MUTEX_INITIALIZER;
+static	pthread_cond_t vc_poolstart=PTHREAD_COND_INITIALIZER;
+static	pthread_cond_t vc_pooldone=PTHREAD_COND_INITIALIZER;
+static	int vc_poolgen,vc_poolbusy,vc_poolquit;
+
+static	SLONG *vc_groupbuf[MIXGROUPS];
+static	int vc_groups,vc_nextgroup;
+static	int vc_groupstart[MIXGROUPS+1];
+static	UBYTE vc_mixlist[256];  /* voices playing in the block */
+static	ULONG vc_blocklen;
+
+/* Mixes groups until there are none left */
+static void MixGroups(void)
+{
+	int g,i;
+
+	while((g=__sync_fetch_and_add(&vc_nextgroup,1))<vc_groups) {
+		memset(vc_groupbuf[g],0,
+		       (vc_blocklen<<SAMPLING_SHIFT)<<((vc_mode&DMODE_STEREO)?3:2));
+		for(i=vc_groupstart[g];i<vc_groupstart[g+1];i++)
+			MixVoice(vc_mixlist[i],vc_groupbuf[g],vc_blocklen);
+	}
+}
+
+static void* MixThread(void* arg)
+{
+	int gen;
+
+	pthread_mutex_lock(&vc_poolmutex);
+	gen=vc_poolgen;
+	for(;;) {
+		while(!vc_poolquit && vc_poolgen==gen)
+			pthread_cond_wait(&vc_poolstart,&vc_poolmutex);
+		if(vc_poolquit)
+			break;
+		gen=vc_poolgen;
+		pthread_mutex_unlock(&vc_poolmutex);
+
+		MixGroups();
+
+		pthread_mutex_lock(&vc_poolmutex);
+		if(!--vc_poolbusy)
+			pthread_cond_signal(&vc_pooldone);
+	}
+	pthread_mutex_unlock(&vc_poolmutex);
+	return NULL;
+}
+
+/* Adds the group buffers up into vc_tickbuf, in order */
+static void AddGroups(NATIVE count)
+{
+	int g;
+	NATIVE i=0;
+
+	if(vc_mode & DMODE_FLOATMIX) {
+		float *dest=(float*)vc_tickbuf;
+
+		memcpy(dest,vc_groupbuf[0],count*sizeof(float));
+		for(g=1;g<vc_groups;g++) {
+			const float *srce=(const float*)vc_groupbuf[g];
+#ifdef HAVE_VECTOR_MIXER
+			for(i=0;i+4<=count;i+=4)
+				*(vfloat_ua*)(dest+i)+=*(const vfloat_ua*)(srce+i);
+#else
+			i=0;
+#endif
+			for(;i<count;i++)
+				dest[i]+=srce[i];
+		}
+	} else {
+		SLONG *dest=vc_tickbuf;
+
+		memcpy(dest,vc_groupbuf[0],count*sizeof(SLONG));
+		for(g=1;g<vc_groups;g++) {
+			const SLONG *srce=vc_groupbuf[g];
+#ifdef HAVE_VECTOR_MIXER
+			for(i=0;i+4<=count;i+=4)
+				*(vslong_ua*)(dest+i)+=*(const vslong_ua*)(srce+i);
+#else
+			i=0;
+#endif
+			for(;i<count;i++)
+				dest[i]+=srce[i];
+		}
+	}
+}
+
+/* Mixes the block in groups, on all threads. Returns 0 if there are not
+   enough voices to share, and the block has to be mixed the usual way. */
+static int MixThreaded(ULONG todo)
+{
+	int t,g,n=0;
+
+	if(!vc_groupbuf[0])
+		return 0;
+
+	for(t=0;t<vc_softchn;t++)
+		if(vmix[t].active || vmix[t].firstev>=0)
+			vc_mixlist[n++]=t;
+	if((vc_groups=MIN(n/GROUPVOICES,MIXGROUPS))<2)
+		return 0;
+
+	for(g=0;g<=vc_groups;g++)
+		vc_groupstart[g]=(g*n)/vc_groups;
+	vc_blocklen=todo;
+	vc_nextgroup=0;
+
+	if(vc_numthreads) {
+		pthread_mutex_lock(&vc_poolmutex);
+		vc_poolbusy=vc_numthreads;
+		vc_poolgen++;
+		pthread_cond_broadcast(&vc_poolstart);
+		pthread_mutex_unlock(&vc_poolmutex);
+	}
+
+	MixGroups();
+
+	if(vc_numthreads) {
+		pthread_mutex_lock(&vc_poolmutex);
+		while(vc_poolbusy)
+			pthread_cond_wait(&vc_pooldone,&vc_poolmutex);
+		pthread_mutex_unlock(&vc_poolmutex);
+	}
+
+	AddGroups((todo<<SAMPLING_SHIFT)<<((vc_mode&DMODE_STEREO)?1:0));
+	return 1;
+}
+
+static void StopMixThreads(void)
+{
+	int t;
+
+	pthread_mutex_lock(&vc_poolmutex);
+	vc_poolquit=1;
+	pthread_cond_broadcast(&vc_poolstart);
+	pthread_mutex_unlock(&vc_poolmutex);
+	for(t=0;t<vc_numthreads;t++)
+		pthread_join(vc_threads[t],NULL);
+	vc_numthreads=vc_poolquit=0;
+
+	for(t=0;t<MIXGROUPS;t++) {
+		MikMod_afree(vc_groupbuf[t]);
+		vc_groupbuf[t]=NULL;
+	}
+}
+
+/* Starts md_mixthreads-1 threads, or one less than there are processors.
+   The calling thread mixes too, so nothing is started on a single core.
+   Float mixing keeps the group buffers even then, see MixThreaded. */
+static void StartMixThreads(void)
+{
+	int t,count=md_mixthreads;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+	if(!count)
+		count=(int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(count>MAXMIXTHREADS) count=MAXMIXTHREADS;
+	if(count<2 && !(vc_mode & DMODE_FLOATMIX))
+		return;
+
+	for(t=0;t<MIXGROUPS;t++)
+		if(!(vc_groupbuf[t]=(SLONG*)MikMod_amalloc((TICKLSIZE+32)*sizeof(SLONG)))) {
+			StopMixThreads();
+			return;
+		}
+
+	for(t=0;t<count-1;t++) {
+		if(pthread_create(&vc_threads[t],NULL,MixThread,NULL))
+			break;
+		vc_numthreads++;
+	}
+	if(!vc_numthreads && !(vc_mode & DMODE_FLOATMIX))
+		StopMixThreads();
+}
+
+#endif /* HAVE_MIXER_THREADS */
+
+void VC2_WriteSamples(SBYTE* buf,ULONG todo)
+{
+	int portion,count,t;
+
+	while(todo) {
+		SetSamplingShift();
+		portion = CollectEvents(MIN(todo, samplesthatfit>>SAMPLING_SHIFT));
+		count = portion<<SAMPLING_SHIFT;
+		todo -= portion;
+
+		/* without a reader thread, the windows asked for are read here */
+#ifdef HAVE_MIXER_THREADS
+		if(!vc_readerup)
+#endif
+		if(vc_numslots)
+			ReadWindows();
+
+#ifdef HAVE_MIXER_THREADS
+		if(!MixThreaded(portion))
+#endif
+		{
+			memset(vc_tickbuf,0,count<<((vc_mode&DMODE_STEREO)?3:2));
+			for(t=0;t<vc_softchn;t++)
+				MixVoice(t,vc_tickbuf,portion);
+		}
+
+		/* let the player see where the voices are now */
+		for(t=0;t<vc_softchn;t++) {
+			vinf[t].active=vinf[t].wasactive=vmix[t].active;
+			vinf[t].current=vmix[t].current;
+		}
+
+		if(md_mode & DMODE_NOISEREDUCTION) {
+			if(vc_mode & DMODE_FLOATMIX)
+				MixLowPassFloat((float*)vc_tickbuf, count);
+			else
+				MixLowPass(vc_tickbuf, count);
+		}
+
+		/* the callback gets floats when DMODE_FLOATMIX is set */
+		if (vc_callback) {
+			vc_callback((unsigned char*)vc_tickbuf, count);
+		}
+
+		MixDecimate(vc_tickbuf,count);
+
+		if(ReverbSetup()) {
+			if(vc_mode & DMODE_FLOATMIX)
+				MixReverbFloat((float*)vc_tickbuf,portion);
+			else
 				MixReverb(vc_tickbuf,portion);
-			}
+		}
 
-			if (vc_callback) {
-				vc_callback((unsigned char*)vc_tickbuf, portion);
-			}
+		PublishMeters(portion);
+
+		if(vc_mode & DMODE_FLOATMIX) {
+			NATIVE n=(vc_mode & DMODE_STEREO)?portion<<1:portion;
 
 			if(vc_mode & DMODE_FLOAT)
-				Mix32toFP((float*)buffer,vc_tickbuf,portion);
+				MixFloatToFP((float*)buf,(float*)vc_tickbuf,n);
 			else if(vc_mode & DMODE_16BITS)
-				Mix32to16((SWORD*)buffer,vc_tickbuf,portion);
+				MixFloatTo16((SWORD*)buf,(float*)vc_tickbuf,n);
 			else
-				Mix32to8((SBYTE*)buffer,vc_tickbuf,portion);
+				MixFloatTo8((SBYTE*)buf,(float*)vc_tickbuf,n);
+		} else if(vc_mode & DMODE_FLOAT)
+			Mix32toFP((float*)buf,vc_tickbuf,portion);
+		else if(vc_mode & DMODE_16BITS)
+			Mix32to16((SWORD*)buf,vc_tickbuf,portion);
+		else
+			Mix32to8((SBYTE*)buf,vc_tickbuf,portion);
 
-			buffer += samples2bytes(portion) / SAMPLING_FACTOR;
-			left   -= portion;
-		}
+		buf += samples2bytes(portion);
 	}
 }
 
@@ -1252,21 +3186,46 @@ int VC2_Init(void)
 
 	if(md_mode & DMODE_STEREO) {
 		Mix32toFP  = Mix32ToFP_Stereo;
-#if ((defined HAVE_ALTIVEC || defined HAVE_SSE2) && (SAMPLING_FACTOR == 4))
-		if (md_mode & DMODE_SIMDMIXER)
-			Mix32to16  = Mix32To16_Stereo_SIMD_4Tap;
-		else
-#endif
-			Mix32to16  = Mix32To16_Stereo;
+		Mix32to16  = Mix32To16_Stereo;
 		Mix32to8   = Mix32To8_Stereo;
-		MixReverb  = MixReverb_Stereo;
 		MixLowPass = MixLowPass_Stereo;
+		MixLowPassFloat = MixLowPassFloat_Stereo;
 	} else {
 		Mix32toFP  = Mix32ToFP_Normal;
 		Mix32to16  = Mix32To16_Normal;
 		Mix32to8   = Mix32To8_Normal;
-		MixReverb  = MixReverb_Normal;
 		MixLowPass = MixLowPass_Normal;
+		MixLowPassFloat = MixLowPassFloat_Normal;
+	}
+
+#ifdef HAVE_VECTOR_CONVERT
+	if (md_mode & DMODE_SIMDMIXER)
+		MixFloatTo16 = MixFloatTo16_Vector;
+	else
+#endif
+		MixFloatTo16 = MixFloatTo16_Normal;
+
+#ifdef HAVE_VECTOR_MIXER
+	if (md_mode & DMODE_SIMDMIXER) {
+#ifndef NATIVE_64BIT_INT
+		Mix32Mono     = Mix32VectorMonoNormal;
+		Mix32Stereo   = Mix32VectorStereoNormal;
+		Mix32Surround = Mix32VectorStereoSurround;
+#endif
+		MixMono       = MixVectorMonoNormal;
+		MixStereo     = MixVectorStereoNormal;
+		MixSurround   = MixVectorStereoSurround;
+	} else
+#endif
+	{
+#ifndef NATIVE_64BIT_INT
+		Mix32Mono     = Mix32MonoNormal;
+		Mix32Stereo   = Mix32StereoNormal;
+		Mix32Surround = Mix32StereoSurround;
+#endif
+		MixMono       = MixMonoNormal;
+		MixStereo     = MixStereoNormal;
+		MixSurround   = MixStereoSurround;
 	}
 
 	md_mode |= DMODE_INTERP;
@@ -1282,61 +3241,27 @@ int VC2_PlayStart(void)
 	if(vc_mode & DMODE_STEREO) samplesthatfit >>= 1;
 	tickleft = 0;
 
-	RVc1 = (5000L * md_mixfreq) / (REVERBERATION * 10);
-	RVc2 = (5078L * md_mixfreq) / (REVERBERATION * 10);
-	RVc3 = (5313L * md_mixfreq) / (REVERBERATION * 10);
-	RVc4 = (5703L * md_mixfreq) / (REVERBERATION * 10);
-	RVc5 = (6250L * md_mixfreq) / (REVERBERATION * 10);
-	RVc6 = (6953L * md_mixfreq) / (REVERBERATION * 10);
-	RVc7 = (7813L * md_mixfreq) / (REVERBERATION * 10);
-	RVc8 = (8828L * md_mixfreq) / (REVERBERATION * 10);
-
-	if(!(RVbufL1=(SLONG*)MikMod_calloc((RVc1+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL2=(SLONG*)MikMod_calloc((RVc2+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL3=(SLONG*)MikMod_calloc((RVc3+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL4=(SLONG*)MikMod_calloc((RVc4+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL5=(SLONG*)MikMod_calloc((RVc5+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL6=(SLONG*)MikMod_calloc((RVc6+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL7=(SLONG*)MikMod_calloc((RVc7+1),sizeof(SLONG)))) return 1;
-	if(!(RVbufL8=(SLONG*)MikMod_calloc((RVc8+1),sizeof(SLONG)))) return 1;
-
-	/* allocate reverb buffers for the right channel if in stereo mode only. */
-	if (vc_mode & DMODE_STEREO) {
-		if(!(RVbufR1=(SLONG*)MikMod_calloc((RVc1+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR2=(SLONG*)MikMod_calloc((RVc2+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR3=(SLONG*)MikMod_calloc((RVc3+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR4=(SLONG*)MikMod_calloc((RVc4+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR5=(SLONG*)MikMod_calloc((RVc5+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR6=(SLONG*)MikMod_calloc((RVc6+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR7=(SLONG*)MikMod_calloc((RVc7+1),sizeof(SLONG)))) return 1;
-		if(!(RVbufR8=(SLONG*)MikMod_calloc((RVc8+1),sizeof(SLONG)))) return 1;
-	}
-
-	RVRindex = 0;
+	vc_samplingshift = -1;
+	SetSamplingShift();
+
+	if(ReverbAlloc()) return 1;
+
+#ifdef HAVE_MIXER_THREADS
+	StartMixThreads();
+#endif
 	return 0;
 }
 
 void VC2_PlayStop(void)
 {
-	MikMod_free(RVbufL1);
-	MikMod_free(RVbufL2);
-	MikMod_free(RVbufL3);
-	MikMod_free(RVbufL4);
-	MikMod_free(RVbufL5);
-	MikMod_free(RVbufL6);
-	MikMod_free(RVbufL7);
-	MikMod_free(RVbufL8);
-	MikMod_free(RVbufR1);
-	MikMod_free(RVbufR2);
-	MikMod_free(RVbufR3);
-	MikMod_free(RVbufR4);
-	MikMod_free(RVbufR5);
-	MikMod_free(RVbufR6);
-	MikMod_free(RVbufR7);
-	MikMod_free(RVbufR8);
-
-	RVbufL1=RVbufL2=RVbufL3=RVbufL4=RVbufL5=RVbufL6=RVbufL7=RVbufL8=NULL;
-	RVbufR1=RVbufR2=RVbufR3=RVbufR4=RVbufR5=RVbufR6=RVbufR7=RVbufR8=NULL;
+#ifdef HAVE_MIXER_THREADS
+	StopMixThreads();
+#endif
+
+	MikMod_free(vc_rvlines);
+	vc_rvlines=NULL;
+
+	ClearMeters();
 }
 
 int VC2_SetNumVoices(void)
@@ -1347,15 +3272,18 @@ int VC2_SetNumVoices(void)
 
 	if(!(vc_softchn=md_softchn)) return 0;
 
+	/* the voices of the player, followed by the voices of the mixer */
 	MikMod_free(vinf);
-	if(!(vinf=(VINFO*)MikMod_calloc(vc_softchn,sizeof(VINFO)))) return 1;
+	if(!(vinf=(VINFO*)MikMod_calloc(vc_softchn*2,sizeof(VINFO)))) return 1;
+	vmix=vinf+vc_softchn;
 
 	for(t=0;t<vc_softchn;t++) {
-		vinf[t].frq=10000;
-		vinf[t].pan=(t&1)?PAN_LEFT:PAN_RIGHT;
+		vinf[t].frq=vmix[t].frq=10000;
+		vinf[t].pan=vmix[t].pan=(t&1)?PAN_LEFT:PAN_RIGHT;
+		vinf[t].cutoff=vmix[t].cutoff=127;
 	}
 
-	return 0;
+	return AllocWindows()||AllocStreamWindows();
 }
 
 #endif /* ! NO_HQMIXER */
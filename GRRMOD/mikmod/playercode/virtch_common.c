@@ -67,6 +67,12 @@ extern ULONG VC1_SampleLength(int,SAMPLE*);
 extern ULONG VC2_SampleLength(int,SAMPLE*);
 extern ULONG VC1_VoiceRealVolume(UBYTE);
 extern ULONG VC2_VoiceRealVolume(UBYTE);
+extern void  VC1_VoiceSetFilter(UBYTE,UBYTE,UBYTE);
+extern void  VC2_VoiceSetFilter(UBYTE,UBYTE,UBYTE);
+extern int   VC1_GetMeters(MMETER*,int,int,MMETER*);
+extern int   VC2_GetMeters(MMETER*,int,int,MMETER*);
+extern void  VC1_GetSampleStats(MSAMPLESTATS*);
+extern void  VC2_GetSampleStats(MSAMPLESTATS*);
 #endif
 
 
@@ -106,6 +112,9 @@ static void (*VC_VoiceStop_ptr)(UBYTE);
 static BOOL (*VC_VoiceStopped_ptr)(UBYTE);
 static SLONG (*VC_VoiceGetPosition_ptr)(UBYTE);
 static ULONG (*VC_VoiceRealVolume_ptr)(UBYTE);
+static void (*VC_VoiceSetFilter_ptr)(UBYTE,UBYTE,UBYTE);
+static int (*VC_GetMeters_ptr)(MMETER*,int,int,MMETER*);
+static void (*VC_GetSampleStats_ptr)(MSAMPLESTATS*);
 
 #if defined __STDC__ || defined _MSC_VER || defined __WATCOMC__ || defined MPW_C
 #define VC_PROC0(suffix) \
@@ -126,6 +135,12 @@ MIKMODAPI void VC_##suffix (typ1 a,typ2 b) { VC_##suffix##_ptr(a,b); }
 #define VC_FUNC2(suffix,ret,typ1,typ2) \
 MIKMODAPI ret VC_##suffix (typ1 a,typ2 b) { return VC_##suffix##_ptr(a,b); }
 
+#define VC_PROC3(suffix,typ1,typ2,typ3) \
+MIKMODAPI void VC_##suffix (typ1 a,typ2 b,typ3 c) { VC_##suffix##_ptr(a,b,c); }
+
+#define VC_FUNC4(suffix,ret,typ1,typ2,typ3,typ4) \
+MIKMODAPI ret VC_##suffix (typ1 a,typ2 b,typ3 c,typ4 d) { return VC_##suffix##_ptr(a,b,c,d); }
+
 #else
 
 #define VC_PROC0(suffix) \
@@ -145,6 +160,12 @@ MIKMODAPI void VC_/**/suffix (typ1 a,typ2 b) { VC_/**/suffix/**/_ptr(a,b); }
 
 #define VC_FUNC2(suffix,ret,typ1,typ2) \
 MIKMODAPI ret VC_/**/suffix (typ1 a,typ2 b) { return VC_/**/suffix/**/_ptr(a,b); }
+
+#define VC_PROC3(suffix,typ1,typ2,typ3) \
+MIKMODAPI void VC_/**/suffix (typ1 a,typ2 b,typ3 c) { VC_/**/suffix/**/_ptr(a,b,c); }
+
+#define VC_FUNC4(suffix,ret,typ1,typ2,typ3,typ4) \
+MIKMODAPI ret VC_/**/suffix (typ1 a,typ2 b,typ3 c,typ4 d) { return VC_/**/suffix/**/_ptr(a,b,c,d); }
 #endif
 
 VC_FUNC0(Init,int)
@@ -173,6 +194,9 @@ VC_PROC1(VoiceStop,UBYTE)
 VC_FUNC1(VoiceStopped,BOOL,UBYTE)
 VC_FUNC1(VoiceGetPosition,SLONG,UBYTE)
 VC_FUNC1(VoiceRealVolume,ULONG,UBYTE)
+VC_PROC3(VoiceSetFilter,UBYTE,UBYTE,UBYTE)
+VC_FUNC4(GetMeters,int,MMETER*,int,int,MMETER*)
+VC_PROC1(GetSampleStats,MSAMPLESTATS*)
 
 void VC_SetupPointers(void)
 {
@@ -199,6 +223,9 @@ void VC_SetupPointers(void)
 		VC_VoiceStopped_ptr=VC2_VoiceStopped;
 		VC_VoiceGetPosition_ptr=VC2_VoiceGetPosition;
 		VC_VoiceRealVolume_ptr=VC2_VoiceRealVolume;
+		VC_VoiceSetFilter_ptr=VC2_VoiceSetFilter;
+		VC_GetMeters_ptr=VC2_GetMeters;
+		VC_GetSampleStats_ptr=VC2_GetSampleStats;
 	} else {
 		VC_Init_ptr=VC1_Init;
 		VC_Exit_ptr=VC1_Exit;
@@ -222,6 +249,9 @@ void VC_SetupPointers(void)
 		VC_VoiceStopped_ptr=VC1_VoiceStopped;
 		VC_VoiceGetPosition_ptr=VC1_VoiceGetPosition;
 		VC_VoiceRealVolume_ptr=VC1_VoiceRealVolume;
+		VC_VoiceSetFilter_ptr=VC1_VoiceSetFilter;
+		VC_GetMeters_ptr=VC1_GetMeters;
+		VC_GetSampleStats_ptr=VC1_GetSampleStats;
 	}
 }
 #endif/* !NO_HQMIXER */
@@ -231,6 +261,97 @@ void VC_SetupPointers(void)
 #ifndef _VIRTCH_COMMON_
 #define _VIRTCH_COMMON_
 
+/* Short forward loops are unrolled when the sample is loaded, to at least
+   MINLOOPLEN samples, so that the mixers don't have to stop at the loop end
+   every few samples. VC1_VoicePlay switches to the unrolled loop when the
+   player asks for the original one. */
+#define MINLOOPLEN 1024
+
+typedef struct VLOOP {
+	ULONG start;    /* loop start and end as loaded */
+	ULONG end;
+	ULONG unrolled; /* end of the unrolled loop, 0 if not unrolled */
+} VLOOP;
+
+static VLOOP vc_loops[MAXSAMPLEHANDLES];
+
+/* Handles with identical sample data share one buffer, which is common
+   within a module and between the modules of a game. A buffer is freed
+   when the last handle using it is unloaded. */
+typedef struct VSHARED {
+	SWORD *data;
+	ULONG bytes;    /* size of data, every byte of which is set */
+	ULONG format;   /* how the mixer reads data */
+	ULONG hash;
+	UWORD refs;     /* handles using data, the slot is free at 0 */
+} VSHARED;
+
+static VSHARED vc_shared[MAXSAMPLEHANDLES];
+static SWORD vc_slot[MAXSAMPLEHANDLES]; /* slot of each handle, or -1 */
+
+/* Shares the data of a freshly loaded handle with the other handles */
+static void ShareSample(int handle,ULONG bytes,ULONG format)
+{
+	const UBYTE *data=(const UBYTE*)Samples[handle];
+	ULONG hash=2166136261UL,t;
+	VSHARED *v;
+	int slot,free=-1;
+
+	for(t=0;t<bytes;t++)
+		hash=(hash^data[t])*16777619UL;
+
+	for(slot=0;slot<MAXSAMPLEHANDLES;slot++) {
+		v=&vc_shared[slot];
+		if(!v->refs) {
+			if(free<0) free=slot;
+		} else if((v->hash==hash)&&(v->bytes==bytes)&&(v->format==format)&&
+		          !memcmp(v->data,data,bytes)) {
+			MikMod_afree(Samples[handle]);
+			Samples[handle]=v->data;
+			v->refs++;
+			vc_slot[handle]=slot;
+			return;
+		}
+	}
+
+	/* there are never more buffers than handles */
+	v=&vc_shared[free];
+	v->data=Samples[handle];
+	v->bytes=bytes;
+	v->format=format;
+	v->hash=hash;
+	v->refs=1;
+	vc_slot[handle]=free;
+}
+
+static ULONG UnrolledLoopEnd(ULONG loopstart,ULONG loopend,UWORD flags)
+{
+	ULONG looplen=loopend-loopstart;
+
+	if(!(flags&SF_LOOP)||(flags&SF_BIDI)||(looplen>=MINLOOPLEN))
+		return loopend;
+	return loopstart+((MINLOOPLEN+looplen-1)/looplen)*looplen;
+}
+
+#ifdef _IN_VIRTCH2_
+/* The samples the high quality mixer keeps ADPCM compressed: long one-shot
+   samples, or long samples with a long loop */
+static BOOL Compressible(ULONG length,ULONG loopstart,ULONG loopend,UWORD flags)
+{
+	return md_compress && (length>=md_compress) &&
+	       (!(flags&SF_LOOP) || (loopend-loopstart>=MINLOOPLEN));
+}
+
+/* The samples the high quality mixer streams: samples which play long enough
+   before their loop, stored plainly, from a reader which outlives them */
+static BOOL Streamable(const SAMPLOAD* sload,ULONG length,ULONG loopstart,UWORD flags)
+{
+	return md_stream && sl_streamreader && (sload->reader==sl_streamreader) &&
+	       !(sload->infmt&(SF_STEREO|SF_ITPACKED|SF_ADPCM4)) && !sload->scalefactor &&
+	       (((flags&SF_LOOP)?loopstart:length)>=md_stream);
+}
+#endif
+
 static ULONG samples2bytes(ULONG samples)
 {
 	if(vc_mode & DMODE_FLOAT) samples <<= 2;
@@ -283,6 +404,13 @@ void VC1_Exit(void)
 	MikMod_free(vinf);
 	MikMod_afree(vc_tickbuf);
 	MikMod_afree(Samples);
+	memset(vc_shared,0,sizeof(vc_shared));
+#ifdef _IN_VIRTCH2_
+	MikMod_free(vc_windows);
+	vc_windows = NULL;
+	vc_numwindows = 0;
+	FreeStreamWindows();
+#endif
 
 	vc_tickbuf = NULL;
 	vinf = NULL;
@@ -313,6 +441,14 @@ ULONG VC1_VoiceGetFrequency(UBYTE voice)
 
 void VC1_VoicePlay(UBYTE voice,SWORD handle,ULONG start,ULONG size,ULONG reppos,ULONG repend,UWORD flags)
 {
+	/* play the unrolled loop if the sample has one */
+	if((handle>=0)&&(handle<MAXSAMPLEHANDLES)&&(flags&SF_LOOP)&&
+	   (vc_loops[handle].unrolled>repend)&&
+	   (vc_loops[handle].start==reppos)&&(vc_loops[handle].end==repend)) {
+		repend=vc_loops[handle].unrolled;
+		if(size<repend) size=repend;
+	}
+
 	vinf[voice].flags  = flags;
 	vinf[voice].handle = handle;
 	vinf[voice].start  = start;
@@ -358,16 +494,32 @@ void VC1_VoiceSetPanning(UBYTE voice,ULONG pan)
 void VC1_SampleUnload(SWORD handle)
 {
 	if (Samples && (handle < MAXSAMPLEHANDLES)) {
-		MikMod_afree(Samples[handle]);
+		if(!Samples[handle])
+			return;
+#ifdef _IN_VIRTCH2_
+		if(vc_streams[handle]) FreeStream(handle);
+#endif
+		if(vc_slot[handle]<0 || !--vc_shared[vc_slot[handle]].refs)
+			MikMod_afree(Samples[handle]);
 		Samples[handle]=NULL;
+		vc_slot[handle]=-1;
+		vc_loops[handle].unrolled=0;
+#ifdef _IN_VIRTCH2_
+		if(vc_adpcm[handle]) vc_compressed--;
+		vc_adpcm[handle]=0;
+#endif
 	}
 }
 
 SWORD VC1_SampleLoad(struct SAMPLOAD* sload,int type)
 {
 	SAMPLE *s = sload->sample;
-	int handle;
-	ULONG t, length,loopstart,loopend,looplen;
+	int handle,bits8=0;
+#ifdef _IN_VIRTCH2_
+	int compress;
+#endif
+	ULONG t, length,loopstart,loopend,looplen,unrolled,bytes,format;
+	UBYTE *smp;
 
 	if(type==MD_HARDWARE) return -1;
 
@@ -394,11 +546,42 @@ SWORD VC1_SampleLoad(struct SAMPLOAD* sload,int type)
 	length    = s->length;
 	loopstart = s->loopstart;
 	loopend   = s->loopend;
+	unrolled  = UnrolledLoopEnd(loopstart,loopend,s->flags);
 
 	SL_SampleSigned(sload);
+#ifdef _IN_VIRTCH2_
+	vc_smp8[handle]=0;
+	vc_adpcm[handle]=0;
+	vc_slot[handle]=-1;
+	vc_loops[handle].unrolled=0;
+
+	/* long samples may be read while they play, see MixStreamed */
+	if(Streamable(sload,length,loopstart,s->flags)) {
+		SL_Sample8to16(sload);
+		if(LoadStream(handle,sload,loopstart,loopend,s->flags) ||
+		   AllocStreamWindows()) {
+			VC1_SampleUnload(handle);
+			_mm_errno = MMERR_SAMPLE_TOO_BIG;
+			return -1;
+		}
+		return handle;
+	}
+
+	/* long samples are compressed from 16 bit, without unrolling their loop */
+	if((compress=Compressible(length,loopstart,loopend,s->flags)))
+		unrolled=loopend;
+
+	/* the high quality mixer reads 8 bit samples as they are, unless they
+	   have to be averaged down */
+	bits8=!(sload->outfmt&SF_16BITS)&&!sload->scalefactor&&!compress;
+	vc_smp8[handle]=bits8;
+	if(!bits8)
+#endif
 	SL_Sample8to16(sload);
 
-	if(!(Samples[handle]=(SWORD*)MikMod_amalloc((length+20)<<1))) {
+	bytes=(((unrolled>length)?unrolled:length)+20)<<!bits8;
+	vc_slot[handle]=-1;
+	if(!(Samples[handle]=(SWORD*)MikMod_amalloc(bytes))) {
 		_mm_errno = MMERR_SAMPLE_TOO_BIG;
 		return -1;
 	}
@@ -410,22 +593,79 @@ SWORD VC1_SampleLoad(struct SAMPLOAD* sload,int type)
 		return -1;
 	}
 
+	/* Unroll short loops, samples are copied as 1 or 2 bytes. The rest of
+	   the buffer is cleared first, so that identical samples are identical
+	   to the last byte. */
+	smp=(UBYTE*)Samples[handle];
+	memset(smp+(length<<!bits8),0,bytes-(length<<!bits8));
+#define COPYSAMPLE(to,from) memcpy(smp+((to)<<!bits8),smp+((from)<<!bits8),2-bits8)
+	vc_loops[handle].start=loopstart;
+	vc_loops[handle].end=loopend;
+	vc_loops[handle].unrolled=0;
+	if(unrolled>loopend) {
+		looplen = loopend - loopstart;
+		for(t=loopend;t<unrolled;t++)
+			COPYSAMPLE(t,t-looplen);
+		vc_loops[handle].unrolled=unrolled;
+		loopend=unrolled;
+	}
+
 	/* Unclick sample */
 	if(s->flags & SF_LOOP) {
 		looplen = loopend - loopstart;/* handle short samples */
 		if(s->flags & SF_BIDI)
 			for(t=0;t<16 && t<looplen;t++)
-				Samples[handle][loopend+t]=Samples[handle][(loopend-t)-1];
+				COPYSAMPLE(loopend+t,(loopend-t)-1);
 		else
 			for(t=0;t<16 && t<looplen;t++)
-				Samples[handle][loopend+t]=Samples[handle][t+loopstart];
+				COPYSAMPLE(loopend+t,t+loopstart);
 	} else
-		for(t=0;t<16;t++)
-			Samples[handle][t+length]=0;
+		memset(smp+(length<<!bits8),0,16<<!bits8);
+#undef COPYSAMPLE
+
+#ifdef _IN_VIRTCH2_
+	/* a sample stays uncompressed when there is no memory to compress it */
+	if(compress && !CompressSample(handle,length+16) && AllocWindows()) {
+		VC1_SampleUnload(handle);
+		_mm_errno = MMERR_SAMPLE_TOO_BIG;
+		return -1;
+	}
+	if(vc_adpcm[handle])
+		bytes=((vc_adpcm[handle]+ADPCMBLOCK-1)/ADPCMBLOCK)*ADPCMBYTES;
+	format=bits8|(vc_adpcm[handle]<<1);
+#else
+	format=0;
+#endif
+	ShareSample(handle,bytes,format);
 
 	return handle;
 }
 
+void VC1_GetSampleStats(MSAMPLESTATS* stats)
+{
+	int t;
+
+	memset(stats,0,sizeof(MSAMPLESTATS));
+	for(t=0;t<MAXSAMPLEHANDLES;t++) {
+		if(!vc_shared[t].refs) continue;
+		stats->handles+=vc_shared[t].refs;
+		stats->buffers++;
+		stats->bytes+=vc_shared[t].bytes;
+		stats->saved+=(vc_shared[t].refs-1)*vc_shared[t].bytes;
+	}
+#ifdef _IN_VIRTCH2_
+	for(t=0;t<MAXSAMPLEHANDLES;t++) {
+		if(!vc_streams[t]) continue;
+		stats->handles++;
+		stats->buffers++;
+		stats->bytes+=vc_streams[t]->bytes;
+		stats->streamed++;
+	}
+	stats->reads=vc_streamreads;
+	stats->misses=vc_streammisses;
+#endif
+}
+
 ULONG VC1_SampleSpace(int type)
 {
 	return vc_memory;
@@ -433,9 +673,19 @@ ULONG VC1_SampleSpace(int type)
 
 ULONG VC1_SampleLength(int type,SAMPLE* s)
 {
+	ULONG length;
+
 	if (!s) return 0;
 
-	return (s->length*((s->flags&SF_16BITS)?2:1))+16;
+	length=s->length;
+	if((s->loopstart<s->loopend)&&(s->loopend<=s->length))
+		length=UnrolledLoopEnd(s->loopstart,s->loopend,s->flags);
+	if(length<s->length) length=s->length;
+#ifdef _IN_VIRTCH2_
+	if(Compressible(s->length,s->loopstart,s->loopend,s->flags))
+		return ((s->length+16+ADPCMBLOCK-1)/ADPCMBLOCK)*ADPCMBYTES;
+#endif
+	return (length*((s->flags&SF_16BITS)?2:1))+16;
 }
 
 ULONG VC1_VoiceRealVolume(UBYTE voice)
@@ -444,6 +694,9 @@ ULONG VC1_VoiceRealVolume(UBYTE voice)
 	int k,j;
 	SWORD *smp;
 	SLONG t;
+#ifdef _IN_VIRTCH2_
+	SWORD buf[64];
+#endif
 
 	t = (SLONG)(vinf[voice].current>>FRACBITS);
 	if(!vinf[voice].active) return 0;
@@ -458,6 +711,13 @@ ULONG VC1_VoiceRealVolume(UBYTE voice)
 
 	i &= ~1;  /* make sure it's EVEN. */
 
+#ifdef _IN_VIRTCH2_
+	/* 8 bit, compressed and streamed samples are read through a 16 bit copy */
+	if(vc_smp8[s] || vc_adpcm[s] || vc_streams[s]) {
+		ReadSamples(s,t,i,buf);
+		smp = buf;
+	} else
+#endif
 	smp = &Samples[s][t];
 	for(;i;i--,smp++) {
 		if(k<*smp) k = *smp;
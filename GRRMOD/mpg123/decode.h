@@ -54,6 +54,8 @@ int synth_1to1_stereo_altivec(real*, real*, mpg123_handle*);
 int synth_1to1_x86_64     (real*, int, mpg123_handle*, int);
 int synth_1to1_stereo_x86_64(real*, real*, mpg123_handle*);
 int synth_1to1_arm        (real*, int, mpg123_handle*, int);
+int synth_1to1_vector     (real*, int, mpg123_handle*, int);
+int synth_1to1_stereo_vector(real*, real*, mpg123_handle*);
 /* This is different, special usage in layer3.c only.
    Hence, the name... and now forget about it.
    Never use it outside that special portion of code inside layer3.c! */
@@ -184,6 +186,11 @@ void dct64        (real *,real *,real *);
 void dct64_i386   (real *,real *,real *);
 void dct64_altivec(real *,real *,real *);
 void dct64_i486(int*, int* , real*); /* Yeah, of no use outside of synth_i486.c .*/
+#ifdef OPT_VECTOR
+/* A left/right pair, as used by the vector decoder. */
+typedef real vreal __attribute__((vector_size(2*sizeof(real))));
+void dct64_vector(vreal *,vreal *,real *,real *);
+#endif
 
 /* This is used by the layer 3 decoder, one generic function and 3DNow variants. */
 void dct36         (real *,real *,real *,real *,real *);
@@ -104,6 +104,8 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->rdat.r_read_handle = NULL;
 	fr->rdat.r_lseek_handle = NULL;
 	fr->rdat.cleanup_handle = NULL;
+	fr->rdat.mem = NULL;
+	fr->rdat.memlen = 0;
 	fr->wrapperdata = NULL;
 	fr->wrapperclean = NULL;
 	fr->decoder_change = 1;
@@ -25,6 +25,8 @@
 #define synth_1to1_x86_64 INT123_synth_1to1_x86_64
 #define synth_1to1_stereo_x86_64 INT123_synth_1to1_stereo_x86_64
 #define synth_1to1_arm INT123_synth_1to1_arm
+#define synth_1to1_vector INT123_synth_1to1_vector
+#define synth_1to1_stereo_vector INT123_synth_1to1_stereo_vector
 #define absynth_1to1_i486 INT123_absynth_1to1_i486
 #define synth_1to1_mono INT123_synth_1to1_mono
 #define synth_1to1_m2s INT123_synth_1to1_m2s
@@ -105,6 +107,7 @@
 #define dct64_i386 INT123_dct64_i386
 #define dct64_altivec INT123_dct64_altivec
 #define dct64_i486 INT123_dct64_i486
+#define dct64_vector INT123_dct64_vector
 #define dct36 INT123_dct36
 #define dct36_3dnow INT123_dct36_3dnow
 #define dct36_3dnowext INT123_dct36_3dnowext
@@ -202,6 +205,7 @@
 #define open_stream INT123_open_stream
 #define open_stream_handle INT123_open_stream_handle
 #define open_feed INT123_open_feed
+#define open_mem INT123_open_mem
 #define feed_more INT123_feed_more
 #define feed_forget INT123_feed_forget
 #define feed_set_pos INT123_feed_set_pos
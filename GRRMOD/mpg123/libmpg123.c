@@ -499,6 +499,15 @@ int attribute_align_arg mpg123_open_feed(mpg123_handle *mh)
 	return open_feed(mh);
 }
 
+int attribute_align_arg mpg123_open_mem(mpg123_handle *mh, const void *mem, size_t size)
+{
+	ALIGNCHECK(mh);
+	if(mh == NULL) return MPG123_ERR;
+
+	mpg123_close(mh);
+	return open_mem(mh, mem, size);
+}
+
 int attribute_align_arg mpg123_replace_reader( mpg123_handle *mh,
                            ssize_t (*r_read) (int, void *, size_t),
                            off_t   (*r_lseek)(int, off_t, int) )
@@ -450,6 +450,12 @@ EXPORT int mpg123_open_handle(mpg123_handle *mh, void *iohandle);
  */
 EXPORT int mpg123_open_feed(mpg123_handle *mh);
 
+/** Use a complete bitstream held in memory as input.
+ *  Frames are read straight from the buffer, which allows seeking; nothing is copied or freed.
+ *  The memory has to stay valid until mpg123_close().
+ */
+EXPORT int mpg123_open_mem(mpg123_handle *mh, const void *mem, size_t size);
+
 /** Closes the source, if libmpg123 opened it. */
 EXPORT int mpg123_close(mpg123_handle *mh);
 
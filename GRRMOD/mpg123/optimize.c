@@ -17,7 +17,7 @@
 	It SUCKS having to define these names that way, but compile-time intialization of string arrays is a bitch.
 	GCC doesn't see constant stuff when it's wiggling in front of it!
 	Anyhow: Have a script for that:
-names="generic generic_dither i386 i486 i586 i586_dither MMX 3DNow 3DNowExt AltiVec SSE x86-64"
+names="generic generic_dither i386 i486 i586 i586_dither MMX 3DNow 3DNowExt AltiVec SSE x86-64 ARM vector"
 for i in $names; do echo "##define dn_${i/-/_} \"$i\""; done
 echo -n "static const char* decname[] =
 {
@@ -41,10 +41,11 @@ echo "
 #define dn_SSE "SSE"
 #define dn_x86_64 "x86-64"
 #define dn_ARM "ARM"
+#define dn_vector "vector"
 static const char* decname[] =
 {
 	"auto"
-	, dn_generic, dn_generic_dither, dn_i386, dn_i486, dn_i586, dn_i586_dither, dn_MMX, dn_3DNow, dn_3DNowExt, dn_AltiVec, dn_SSE, dn_x86_64, dn_ARM
+	, dn_generic, dn_generic_dither, dn_i386, dn_i486, dn_i586, dn_i586_dither, dn_MMX, dn_3DNow, dn_3DNowExt, dn_AltiVec, dn_SSE, dn_x86_64, dn_ARM, dn_vector
 	, "nodec"
 };
 
@@ -225,6 +226,9 @@ static int find_dectype(mpg123_handle *fr)
 #ifdef OPT_ARM
 	else if(basic_synth == synth_1to1_arm) type = arm;
 #endif
+#ifdef OPT_VECTOR
+	else if(basic_synth == synth_1to1_vector) type = vectorized;
+#endif
 #ifdef OPT_GENERIC_DITHER
 	else if(basic_synth == synth_1to1_dither) type = generic_dither;
 #endif
@@ -686,6 +690,19 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 	}
 #	endif
 
+#	ifdef OPT_VECTOR
+	if(!done && (auto_choose || want_dec == vectorized))
+	{
+		chosen = "vector";
+		fr->cpu_opts.type = vectorized;
+#		ifndef NO_16BIT
+		fr->synths.plain[r_1to1][f_16] = synth_1to1_vector;
+		fr->synths.stereo[r_1to1][f_16] = synth_1to1_stereo_vector;
+#		endif
+		done = 1;
+	}
+#	endif
+
 #	ifdef OPT_GENERIC
 	if(!done && (auto_choose || want_dec == generic))
 	{
@@ -786,6 +803,9 @@ static const char *mpg123_supported_decoder_list[] =
 	#ifdef OPT_ARM
 	NULL,
 	#endif
+	#ifdef OPT_VECTOR
+	NULL,
+	#endif
 	#ifdef OPT_GENERIC_FLOAT
 	NULL,
 	#endif
@@ -834,6 +854,9 @@ static const char *mpg123_decoder_list[] =
 	#ifdef OPT_ARM
 	dn_ARM,
 	#endif
+	#ifdef OPT_VECTOR
+	dn_vector,
+	#endif
 	#ifdef OPT_GENERIC
 	dn_generic,
 	#endif
@@ -893,6 +916,9 @@ void check_decoders(void )
 #ifdef OPT_ARM
 	*(d++) = decname[arm];
 #endif
+#ifdef OPT_VECTOR
+	*(d++) = decname[vectorized];
+#endif
 #ifdef OPT_GENERIC
 	*(d++) = decname[generic];
 #endif
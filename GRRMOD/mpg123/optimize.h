@@ -19,6 +19,7 @@
 	OPT_3DNOWEXT (AMD 3DNow! extended, generally Athlon, compatibles...)
 	OPT_ALTIVEC (Motorola/IBM PPC with AltiVec under MacOSX)
 	OPT_X86_64 (x86-64 / AMD64 / Intel 64)
+	OPT_VECTOR (stereo synth in C with compiler vector extensions, left/right pairs; paired singles on Gekko)
 
 	or you define OPT_MULTI and give a combination which makes sense (do not include i486, do not mix altivec and x86).
 
@@ -37,7 +38,7 @@ enum optdec
 { /* autodec needs to be =0 and the first, nodec needs to be the last -- for loops! */
 	autodec=0, generic, generic_dither, idrei,
 	ivier, ifuenf, ifuenf_dither, mmx,
-	dreidnow, dreidnowext, altivec, sse, x86_64, arm,
+	dreidnow, dreidnowext, altivec, sse, x86_64, arm, vectorized,
 	nodec
 };
 enum optcla { nocla=0, normal, mmxsse };
@@ -67,7 +68,8 @@ enum optcla decclass(const enum optdec);
 #ifdef REAL_IS_FIXED
 #if (defined OPT_I486)  || (defined OPT_I586) || (defined OPT_I586_DITHER) \
  || (defined OPT_MMX)   || (defined OPT_SSE)  || (defined_OPT_ALTIVEC) \
- || (defined OPT_3DNOW) || (defined OPT_3DNOWEXT) || (defined OPT_X86_64) || (defined OPT_GENERIC_DITHER)
+ || (defined OPT_3DNOW) || (defined OPT_3DNOWEXT) || (defined OPT_X86_64) || (defined OPT_GENERIC_DITHER) \
+ || (defined OPT_VECTOR)
 #error "Bad decoder choice together with fixed point math!"
 #endif
 #endif
@@ -184,6 +186,12 @@ extern const int costab_mmxsse[];
 #endif
 #endif
 
+#ifdef OPT_VECTOR
+#ifndef OPT_MULTI
+#	define defopt vectorized
+#endif
+#endif
+
 /* used for multi opt mode and the single 3dnow mode to have the old 3dnow test flag still working */
 void check_decoders(void);
 
@@ -57,6 +57,9 @@ struct reader_data
 	/* Buffered readers want that abstracted, set internally. */
 	ssize_t (*fullread)(mpg123_handle *, unsigned char *, ssize_t);
 	struct bufferchain buffer; /* Not dynamically allocated, these few struct bytes aren't worth the trouble. */
+	/* The memory reader works on the client's buffer in place. */
+	const unsigned char *mem;
+	off_t memlen;
 };
 
 /* start to use off_t to properly do LFS in future ... used to be long */
@@ -88,6 +91,9 @@ int  feed_more(mpg123_handle *fr, const unsigned char *in, long count);
 void feed_forget(mpg123_handle *fr);  /* forget the data that has been read (free some buffers) */
 off_t feed_set_pos(mpg123_handle *fr, off_t pos); /* Set position (inside available data if possible), return wanted byte offset of next feed. */
 
+/* Read from a buffer in memory, seekable without copying the whole stream. */
+int open_mem(mpg123_handle *, const void *mem, size_t size);
+
 void open_bad(mpg123_handle *);
 
 #define READER_FD_OPENED 0x1
@@ -103,12 +109,13 @@ void open_bad(mpg123_handle *);
 /* These two add a little buffering to enable small seeks for peek ahead. */
 #define READER_BUF_STREAM 3
 #define READER_BUF_ICY_STREAM 4
+#define READER_MEM 5
 
 #ifdef READ_SYSTEM
-#define READER_SYSTEM 5
-#define READERS 6
+#define READER_SYSTEM 6
+#define READERS 7
 #else
-#define READERS 5
+#define READERS 6
 #endif
 
 #define READER_ERROR MPG123_ERR
@@ -777,6 +777,84 @@ off_t feed_set_pos(mpg123_handle *fr, off_t pos)
 }
 #endif /* NO_FEEDER */
 
+/* reader for a whole stream in the client's memory */
+
+static int mem_init(mpg123_handle *fr)
+{
+	fr->rdat.filelen = fr->rdat.memlen;
+	fr->rdat.filepos = 0;
+	fr->rdat.flags |= READER_SEEKABLE;
+	if(fr->rdat.memlen >= 128 && !strncmp((const char*)fr->rdat.mem+fr->rdat.memlen-128,"TAG",3))
+	{
+		memcpy(fr->id3buf, fr->rdat.mem+fr->rdat.memlen-128, 128);
+		fr->rdat.filelen -= 128;
+		fr->rdat.flags |= READER_ID3TAG;
+		fr->metaflags  |= MPG123_NEW_ID3;
+	}
+	return 0;
+}
+
+static void mem_close(mpg123_handle *fr)
+{
+	fr->rdat.mem = NULL;
+	fr->rdat.memlen = 0;
+}
+
+static ssize_t mem_fullread(mpg123_handle *fr, unsigned char *buf, ssize_t count)
+{
+	off_t left = fr->rdat.memlen - fr->rdat.filepos;
+	if(count > left) count = (ssize_t)left;
+	memcpy(buf, fr->rdat.mem+fr->rdat.filepos, count);
+	fr->rdat.filepos += count;
+	return count;
+}
+
+/* Headers are assembled in place, without going through fullread. */
+static int mem_head_read(mpg123_handle *fr, unsigned long *newhead)
+{
+	const unsigned char *p = fr->rdat.mem+fr->rdat.filepos;
+	if(fr->rdat.memlen - fr->rdat.filepos < 4) return FALSE;
+
+	*newhead = ((unsigned long) p[0] << 24) |
+	           ((unsigned long) p[1] << 16) |
+	           ((unsigned long) p[2] << 8)  |
+	            (unsigned long) p[3];
+	fr->rdat.filepos += 4;
+	return TRUE;
+}
+
+static int mem_head_shift(mpg123_handle *fr, unsigned long *head)
+{
+	if(fr->rdat.filepos >= fr->rdat.memlen) return FALSE;
+
+	*head <<= 8;
+	*head |= fr->rdat.mem[fr->rdat.filepos++];
+	*head &= 0xffffffff;
+	return TRUE;
+}
+
+/* returns reached position... negative ones are bad... */
+static off_t mem_skip_bytes(mpg123_handle *fr, off_t len)
+{
+	off_t pos = fr->rdat.filepos + len;
+	if(pos < 0 || pos > fr->rdat.memlen)
+	{
+		fr->err = MPG123_LSEEK_FAILED;
+		return READER_ERROR;
+	}
+	return fr->rdat.filepos = pos;
+}
+
+static int mem_back_bytes(mpg123_handle *fr, off_t bytes)
+{
+	return mem_skip_bytes(fr, -bytes) >= 0 ? 0 : READER_ERROR;
+}
+
+static void mem_rewind(mpg123_handle *fr)
+{
+	fr->rdat.filepos = 0;
+}
+
 /*****************************************************************
  * read frame helper
  */
@@ -800,6 +878,7 @@ static void bad_rewind(mpg123_handle *mh){}
 #define READER_FEED       2
 #define READER_BUF_STREAM 3
 #define READER_BUF_ICY_STREAM 4
+#define READER_MEM 5
 static struct reader readers[] =
 {
 	{ /* READER_STREAM */
@@ -881,6 +960,20 @@ static struct reader readers[] =
 		stream_rewind,
 		buffered_forget
 	},
+	{ /* READER_MEM */
+		mem_init,
+		mem_close,
+		mem_fullread,
+		mem_head_read,
+		mem_head_shift,
+		mem_skip_bytes,
+		generic_read_frame_body,
+		mem_back_bytes,
+		stream_seek_frame,
+		generic_tell,
+		mem_rewind,
+		NULL
+	},
 #ifdef READ_SYSTEM
 	,{
 		system_init,
@@ -1026,6 +1119,25 @@ int open_feed(mpg123_handle *fr)
 #endif /* NO_FEEDER */
 }
 
+int open_mem(mpg123_handle *fr, const void *mem, size_t size)
+{
+	debug("memory reader");
+	if(mem == NULL)
+	{
+		fr->err = MPG123_BAD_FILE;
+		return MPG123_ERR;
+	}
+#ifndef NO_ICY
+	clear_icy(&fr->icy);
+#endif
+	fr->rdat.mem = mem;
+	fr->rdat.memlen = (off_t)size;
+	fr->rdat.flags = 0;
+	fr->rd = &readers[READER_MEM];
+	if(fr->rd->init(fr) < 0) return -1;
+	return MPG123_OK;
+}
+
 /* Final code common to open_stream and open_stream_handle. */
 static int open_finish(mpg123_handle *fr)
 {
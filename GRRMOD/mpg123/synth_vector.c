@@ -0,0 +1,188 @@
+/*
+	synth_vector.c: synth_1to1 for both channels at once, using compiler vector extensions
+
+	copyright 1995-2008 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+	initially written by Michael Hipp, two channel version for GRRMOD
+
+	The stereo synth runs dct64_vector and the windowing on left/right pairs, so each window
+	coefficient is loaded once for both channels. To make the pairs plain loads, this decoder keeps
+	the synth history interleaved: real_buffs[0][0] is viewed as two blocks of 0x110 vreal pairs
+	instead of four blocks of 0x110 reals. The plain synth below works on one lane of the same
+	history, so mono streams and the 8bit wrappers keep working.
+*/
+
+#include "mpg123lib_intern.h"
+#include "sample.h"
+#include "debug.h"
+
+#ifdef OPT_VECTOR
+
+/* The 32 output pairs of one block, in the summation order of synth.h. */
+static void synth_vector_window(vreal *b0, real *window, int bo1, vreal *sums)
+{
+	register int j;
+
+	for(j=16; j; j--, b0+=0x10, window+=0x20, sums++)
+	{
+		vreal sum;
+		sum  = window[0x0] * b0[0x0];
+		sum -= window[0x1] * b0[0x1];
+		sum += window[0x2] * b0[0x2];
+		sum -= window[0x3] * b0[0x3];
+		sum += window[0x4] * b0[0x4];
+		sum -= window[0x5] * b0[0x5];
+		sum += window[0x6] * b0[0x6];
+		sum -= window[0x7] * b0[0x7];
+		sum += window[0x8] * b0[0x8];
+		sum -= window[0x9] * b0[0x9];
+		sum += window[0xA] * b0[0xA];
+		sum -= window[0xB] * b0[0xB];
+		sum += window[0xC] * b0[0xC];
+		sum -= window[0xD] * b0[0xD];
+		sum += window[0xE] * b0[0xE];
+		sum -= window[0xF] * b0[0xF];
+		*sums = sum;
+	}
+
+	{
+		vreal sum;
+		sum  = window[0x0] * b0[0x0];
+		sum += window[0x2] * b0[0x2];
+		sum += window[0x4] * b0[0x4];
+		sum += window[0x6] * b0[0x6];
+		sum += window[0x8] * b0[0x8];
+		sum += window[0xA] * b0[0xA];
+		sum += window[0xC] * b0[0xC];
+		sum += window[0xE] * b0[0xE];
+		*sums++ = sum;
+		b0-=0x10;
+		window-=0x20;
+	}
+	window += bo1<<1;
+
+	for(j=15; j; j--, b0-=0x10, window-=0x20, sums++)
+	{
+		vreal sum;
+		sum = -(window[-0x1] * b0[0x0]);
+		sum -= window[-0x2] * b0[0x1];
+		sum -= window[-0x3] * b0[0x2];
+		sum -= window[-0x4] * b0[0x3];
+		sum -= window[-0x5] * b0[0x4];
+		sum -= window[-0x6] * b0[0x5];
+		sum -= window[-0x7] * b0[0x6];
+		sum -= window[-0x8] * b0[0x7];
+		sum -= window[-0x9] * b0[0x8];
+		sum -= window[-0xA] * b0[0x9];
+		sum -= window[-0xB] * b0[0xA];
+		sum -= window[-0xC] * b0[0xB];
+		sum -= window[-0xD] * b0[0xC];
+		sum -= window[-0xE] * b0[0xD];
+		sum -= window[-0xF] * b0[0xE];
+		sum -= window[-0x10] * b0[0xF];
+		*sums = sum;
+	}
+}
+
+/* One channel into its lane of the interleaved history. */
+int synth_1to1_vector(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	short *samples = (short *) (fr->buffer.data + fr->buffer.fill);
+	vreal *buf = (vreal *) fr->real_buffs[0][0];
+	vreal *out0, *out1, *b0;
+	vreal sums[32];
+	real tmp0[0x10*16+1], tmp1[0x10*15+1];
+	int clip = 0;
+	int bo1;
+	int i;
+
+	if(fr->have_eq_settings) do_equalizer(bandPtr,channel,fr->equalizer);
+
+	if(!channel)
+	{
+		fr->bo--;
+		fr->bo &= 0xf;
+	}
+
+	if(fr->bo & 0x1)
+	{
+		b0 = buf;
+		bo1 = fr->bo;
+		out0 = buf+0x110+((fr->bo+1)&0xf);
+		out1 = buf+fr->bo;
+	}
+	else
+	{
+		b0 = buf+0x110;
+		bo1 = fr->bo+1;
+		out0 = buf+fr->bo;
+		out1 = buf+0x110+fr->bo+1;
+	}
+
+	dct64(tmp0, tmp1, bandPtr);
+	for(i=0; i<=16; i++) out0[0x10*i][channel] = tmp0[0x10*i];
+	for(i=0; i<=15; i++) out1[0x10*i][channel] = tmp1[0x10*i];
+
+	synth_vector_window(b0, fr->decwin + 16 - bo1, bo1, sums);
+
+	samples += channel;
+	for(i=0; i<32; i++, samples+=2)
+	{
+		real sum = sums[i][channel];
+		WRITE_SHORT_SAMPLE(samples,sum,clip);
+	}
+
+	if(final) fr->buffer.fill += 0x40*sizeof(short);
+
+	return clip;
+}
+
+int synth_1to1_stereo_vector(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	short *samples = (short *) (fr->buffer.data + fr->buffer.fill);
+	vreal *buf = (vreal *) fr->real_buffs[0][0];
+	vreal *b0;
+	vreal sums[32];
+	int clip = 0;
+	int bo1;
+	int i;
+
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(bandPtr_l,0,fr->equalizer);
+		do_equalizer(bandPtr_r,1,fr->equalizer);
+	}
+
+	fr->bo--;
+	fr->bo &= 0xf;
+
+	if(fr->bo & 0x1)
+	{
+		b0 = buf;
+		bo1 = fr->bo;
+		dct64_vector(buf+0x110+((fr->bo+1)&0xf), buf+fr->bo, bandPtr_l, bandPtr_r);
+	}
+	else
+	{
+		b0 = buf+0x110;
+		bo1 = fr->bo+1;
+		dct64_vector(buf+fr->bo, buf+0x110+fr->bo+1, bandPtr_l, bandPtr_r);
+	}
+
+	synth_vector_window(b0, fr->decwin + 16 - bo1, bo1, sums);
+
+	for(i=0; i<32; i++, samples+=2)
+	{
+		real sum;
+		sum = sums[i][0];
+		WRITE_SHORT_SAMPLE(samples,sum,clip);
+		sum = sums[i][1];
+		WRITE_SHORT_SAMPLE(samples+1,sum,clip);
+	}
+
+	fr->buffer.fill += 0x40*sizeof(short);
+
+	return clip;
+}
+
+#endif
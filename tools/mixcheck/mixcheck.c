@@ -0,0 +1,284 @@
+/*------------------------------------------------------------------------------
+Copyright (c) 2010-2024 The GRRLIB Team
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+------------------------------------------------------------------------------*/
+
+/*
+ * Host check that the vector mixers of the HQ mixer (DMODE_SIMDMIXER) give
+ * the same output as the scalar mixers.
+ *
+ * virtch2.c is included so that its static mixers can be called directly:
+ * each scalar mixer and its vector version mix the same random samples with
+ * the same random voice state, and the output, the returned index and the
+ * voice state must match exactly. Then every module given on the command
+ * line is played through the whole mixer with DMODE_SIMDMIXER off and on,
+ * with integer and with float mixing, and the output must be the same.
+ */
+#include "virtch2.c"
+#include <stdio.h>
+
+#define SAMPLES (4096) /**< Length of the random sample. */
+#define TODO    (300)  /**< Most frames mixed by one call. */
+#define ROUNDS  (200000) /**< Random calls per mixer. */
+#define SECONDS (20)   /**< Seconds of each module played. */
+#define CHUNK   (5760) /**< Bytes mixed at a time. */
+
+static ULONG Seed = 1; /**< State of the random generator. */
+
+/**
+ * Get a random number.
+ * @param n The number of values.
+ * @return A number from 0 to n - 1.
+ */
+static ULONG Random(ULONG n) {
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed % n;
+}
+
+/**
+ * Get a random volume, sometimes out of the range the player uses, to check
+ * that the vector mixers fall back to the scalar ones.
+ * @return The volume.
+ */
+static int RandomVolume(void) {
+    return Random(64) ? (int)Random(257) : (int)Random(1024);
+}
+
+/**
+ * Make a random voice state.
+ * @param v The voice to fill.
+ */
+static void RandomVoice(VINFO *v) {
+    memset(v, 0, sizeof(VINFO));
+    v->lvolsel = RandomVolume();
+    v->rvolsel = RandomVolume();
+    v->oldlvol = RandomVolume();
+    v->oldrvol = RandomVolume();
+    v->rampvol = Random(2) ? Random(CLICK_BUFFER + 1) : 0;
+    v->click = Random(2) ? Random(CLICK_BUFFER + 1) : 0;
+    v->lastvalL = (SLONG)Random(256 * 65536) - 256 * 32768;
+    v->lastvalR = (SLONG)Random(256 * 65536) - 256 * 32768;
+}
+
+/**
+ * Check that two voices were left in the same state.
+ * @return true if they match.
+ */
+static BOOL SameVoice(const VINFO *a, const VINFO *b) {
+    return a->rampvol == b->rampvol && a->click == b->click &&
+           a->lastvalL == b->lastvalL && a->lastvalR == b->lastvalR;
+}
+
+/**
+ * Mix random samples with a scalar mixer and with its vector version.
+ * @param name Name of the mixer, for the report.
+ * @param scalar The scalar mixer.
+ * @param vector The vector mixer.
+ * @param channels Output channels of the mixer.
+ * @param limit The index stays below this many samples.
+ * @return The number of calls that did not match.
+ */
+static int CheckMixer(const char *name,
+                      SLONGLONG (*scalar)(const void* const, SLONG*, SLONGLONG, SLONGLONG, ULONG, int),
+                      SLONGLONG (*vector)(const void* const, SLONG*, SLONGLONG, SLONGLONG, ULONG, int),
+                      int channels, SLONGLONG limit) {
+    static SWORD smp16[SAMPLES + 1];
+    static SBYTE smp8[SAMPLES + 1];
+    static SLONG desta[2 * TODO], destb[2 * TODO];
+    SLONGLONG idx, increment, ra, rb, span;
+    VINFO a, b;
+    ULONG todo;
+    int bits8, bad = 0, i, k;
+
+    for(i = 0; i <= SAMPLES; i++) {
+        smp16[i] = (SWORD)Random(65536);
+        smp8[i] = (SBYTE)Random(256);
+    }
+    smp16[0] = -32768;
+    smp16[1] = 32767;
+    smp8[0] = -128;
+    smp8[1] = 127;
+    limit <<= FRACBITS;
+    for(k = 0; k < ROUNDS; k++) {
+        vc_samplingshift = Random(MAX_SAMPLING_SHIFT + 1);
+        bits8 = Random(2);
+        todo = 1 + Random(TODO);
+        // Up to 4 samples per frame, the index must stay in the sample
+        increment = 1 + (((SLONGLONG)Random(1U << 30) << 16 | Random(1 << 16)) % (limit / todo));
+        increment = (increment > (4L << FRACBITS)) ? increment % (4L << FRACBITS) + 1 : increment;
+        span = limit - (SLONGLONG)todo * increment;
+        idx = ((SLONGLONG)Random(1U << 30) << 16 | Random(1 << 16)) % (span + 1);
+        if(Random(2)) {
+            idx += (SLONGLONG)todo * increment;
+            increment = -increment;
+        }
+        for(i = 0; i < channels * (int)todo; i++) {
+            desta[i] = destb[i] = (SLONG)Random(1U << 31) - (1L << 30);
+        }
+        RandomVoice(&a);
+        b = a;
+
+        vnf = &a;
+        ra = scalar(bits8 ? (void *)smp8 : (void *)smp16, desta, idx, increment, todo, bits8);
+        vnf = &b;
+        rb = vector(bits8 ? (void *)smp8 : (void *)smp16, destb, idx, increment, todo, bits8);
+        if(ra != rb || !SameVoice(&a, &b) ||
+           memcmp(desta, destb, channels * todo * sizeof(SLONG)) != 0) {
+            bad++;
+        }
+    }
+    printf("%-24s %d calls, %d different\n", name, ROUNDS, bad);
+    return bad;
+}
+
+// The mixers have different types for the count, these give them the same one
+static SLONGLONG MonoScalar(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return MixMonoNormal(s, d, i, n, t, b); }
+static SLONGLONG MonoVector(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return MixVectorMonoNormal(s, d, i, n, t, b); }
+#ifndef NATIVE_64BIT_INT
+static SLONGLONG Mono32Scalar(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return Mix32MonoNormal(s, d, i, n, t, b); }
+static SLONGLONG Mono32Vector(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return Mix32VectorMonoNormal(s, d, i, n, t, b); }
+static SLONGLONG Stereo32Scalar(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return Mix32StereoNormal(s, d, i, n, t, b); }
+static SLONGLONG Stereo32Vector(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return Mix32VectorStereoNormal(s, d, i, n, t, b); }
+static SLONGLONG Surround32Scalar(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return Mix32StereoSurround(s, d, i, n, t, b); }
+static SLONGLONG Surround32Vector(const void* const s, SLONG* d, SLONGLONG i, SLONGLONG n, ULONG t, int b) { return Mix32VectorStereoSurround(s, d, i, n, t, b); }
+#endif
+
+#ifdef HAVE_VECTOR_CONVERT
+/**
+ * Convert random floats to 16 bit with the scalar and the vector converter.
+ * @return The number of samples that did not match.
+ */
+static int CheckConvert(void) {
+    static float srce[4099];
+    static SWORD a[4099], b[4099];
+    int bad = 0, i, k, count;
+
+    for(k = 0; k < ROUNDS / 100; k++) {
+        count = 1 + Random(4099);
+        for(i = 0; i < count; i++) {
+            // Halves, large values and the clipping range
+            srce[i] = Random(4) ? ((float)Random(1 << 20) - (1 << 19)) / 8.0f :
+                                  ((float)Random(1 << 24) - (1 << 23)) / 64.0f;
+        }
+        MixFloatTo16_Normal(a, srce, count);
+        MixFloatTo16_Vector(b, srce, count);
+        for(i = 0; i < count; i++) {
+            bad += (a[i] != b[i]);
+        }
+    }
+    printf("%-24s %d calls, %d different\n", "MixFloatTo16", ROUNDS / 100, bad);
+    return bad;
+}
+#endif
+
+static int Host_Init(void) { return VC_Init(); }
+static BOOL Host_IsThere(void) { return 1; }
+static void Host_Update(void) { }
+
+/** A driver which only mixes, Render calls VC_WriteBytes itself. */
+static MDRIVER drv_host = {
+    NULL, "host", "host mixer", 0, 255, "host", NULL, NULL, Host_IsThere,
+    VC_SampleLoad, VC_SampleUnload, VC_SampleSpace, VC_SampleLength,
+    Host_Init, VC_Exit, NULL, VC_SetNumVoices, VC_PlayStart, VC_PlayStop,
+    Host_Update, NULL, VC_VoiceSetVolume, VC_VoiceGetVolume,
+    VC_VoiceSetFrequency, VC_VoiceGetFrequency, VC_VoiceSetPanning,
+    VC_VoiceGetPanning, VC_VoicePlay, VC_VoiceStop, VC_VoiceStopped,
+    VC_VoiceGetPosition, VC_VoiceRealVolume, VC_VoiceSetFilter
+};
+
+/**
+ * Play a module through the whole mixer.
+ * @param filename The module.
+ * @param mode Extra DMODE flags.
+ * @param out Receives the output.
+ * @param size Size of out.
+ * @return false if the module could not be played.
+ */
+static BOOL Render(const char *filename, UWORD mode, SBYTE *out, size_t size) {
+    MODULE *module;
+    size_t done;
+
+    md_mode = DMODE_16BITS | DMODE_HQMIXER | DMODE_SOFT_MUSIC | DMODE_SOFT_SNDFX |
+              DMODE_STEREO | DMODE_SURROUND | mode;
+    md_mixfreq = 48000;
+    if(MikMod_Init("")) {
+        return 0;
+    }
+    module = Player_Load(filename, 128, 0);
+    if(module == NULL) {
+        MikMod_Exit();
+        return 0;
+    }
+    Player_Start(module);
+    for(done = 0; done < size; done += CHUNK) {
+        VC_WriteBytes(out + done, CHUNK);
+    }
+    Player_Stop();
+    Player_Free(module);
+    MikMod_Exit();
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    static const UWORD modes[] = {0, DMODE_FLOATMIX};
+    size_t size = (size_t)SECONDS * 48000 * 4 / CHUNK * CHUNK;
+    SBYTE *a = malloc(size), *b = malloc(size);
+    int bad = 0, i, m;
+
+    bad += CheckMixer("MixMonoNormal", MonoScalar, MonoVector, 1, SAMPLES - 1);
+    bad += CheckMixer("MixStereoNormal", MixStereoNormal, MixVectorStereoNormal, 2, SAMPLES - 1);
+    bad += CheckMixer("MixStereoSurround", MixStereoSurround, MixVectorStereoSurround, 2, SAMPLES - 1);
+#ifndef NATIVE_64BIT_INT
+    // VC2_WriteSamples only uses these while the index fits in 31 bits
+    bad += CheckMixer("Mix32MonoNormal", Mono32Scalar, Mono32Vector, 1, 7);
+    bad += CheckMixer("Mix32StereoNormal", Stereo32Scalar, Stereo32Vector, 2, 7);
+    bad += CheckMixer("Mix32StereoSurround", Surround32Scalar, Surround32Vector, 2, 7);
+#else
+    printf("Mix32* are only built on 32 bit hosts, not checked\n");
+#endif
+#ifdef HAVE_VECTOR_CONVERT
+    bad += CheckConvert();
+#endif
+
+    MikMod_RegisterDriver(&drv_host);
+    MikMod_RegisterAllLoaders();
+    md_device = 1;
+    for(i = 1; i < argc; i++) {
+        for(m = 0; m < 2; m++) {
+            // Some player state outlives a module and changes how the next
+            // one starts, so both renders follow one of the same module
+            if(!Render(argv[i], modes[m], a, size) ||
+               !Render(argv[i], modes[m], a, size) ||
+               !Render(argv[i], modes[m] | DMODE_SIMDMIXER, b, size)) {
+                printf("%s: cannot play, %s\n", argv[i], MikMod_strerror(MikMod_errno));
+                bad++;
+                break;
+            }
+            printf("%-24s %s mixing, %s\n", argv[i], m ? "float" : "integer",
+                   memcmp(a, b, size) ? "different" : "same");
+            bad += (memcmp(a, b, size) != 0);
+        }
+    }
+    free(a);
+    free(b);
+    return bad ? 1 : 0;
+}
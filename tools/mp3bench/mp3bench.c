@@ -0,0 +1,225 @@
+/*------------------------------------------------------------------------------
+Copyright (c) 2010-2024 The GRRLIB Team
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+------------------------------------------------------------------------------*/
+
+/*
+ * Host benchmark for the MP3 decoder options of GRRMOD.
+ *
+ * The Makefile builds this file against GRRMOD/mpg123 once with the default
+ * floating point flags and once with the MP3_FIXED flags. Each build decodes
+ * an MP3 file from memory the way GRRMOD does and prints the best time of a
+ * few runs. The output of one build can be saved and compared against the
+ * output of the other.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mpg123.h"
+
+#define READ_SIZE (4608) /**< Bytes asked from mpg123_read at a time, like the GRRMOD decoder thread. */
+
+static const char *Decoder = "?"; /**< Name of the mpg123 decoder used. */
+
+/**
+ * Read a whole file.
+ * @param filename Name of the file.
+ * @param size Receives the size of the file.
+ * @return The content of the file, or NULL if it could not be read.
+ */
+static unsigned char *ReadFile(const char *filename, size_t *size) {
+    unsigned char *data;
+    FILE *f = fopen(filename, "rb");
+
+    if(f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    data = malloc(*size);
+    if(data != NULL && fread(data, 1, *size, f) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/**
+ * Get a monotonic time.
+ * @return The time in seconds.
+ */
+static double Now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * Decode an MP3 file held in memory.
+ * @param mp3 The MP3 file.
+ * @param size Size of the MP3 file.
+ * @param out Receives the decoded samples, can be NULL.
+ * @param max Size of out in bytes.
+ * @return The number of bytes decoded, or 0 on error.
+ */
+static size_t Decode(unsigned char *mp3, size_t size, unsigned char *out, size_t max) {
+    unsigned char buffer[READ_SIZE];
+    mpg123_handle *mh;
+    size_t total = 0, done;
+    long rate;
+    int err, channels, encoding;
+
+    mh = mpg123_new(NULL, &err);
+    if(mh == NULL) {
+        return 0;
+    }
+    mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0);
+    if(mpg123_open_mem(mh, mp3, size) != MPG123_OK ||
+       mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) {
+        mpg123_delete(mh);
+        return 0;
+    }
+    Decoder = mpg123_current_decoder(mh);
+    do {
+        err = mpg123_read(mh, buffer, READ_SIZE, &done);
+        if(out != NULL && total + done <= max) {
+            memcpy(out + total, buffer, done);
+        }
+        total += done;
+    } while(err == MPG123_OK || err == MPG123_NEW_FORMAT);
+    mpg123_delete(mh);
+    return total;
+}
+
+/**
+ * Print how far the decoded samples are from the reference samples.
+ * @param a The reference samples.
+ * @param b The decoded samples.
+ * @param count Number of samples.
+ */
+static void Compare(const short *a, const short *b, size_t count) {
+    size_t i, differ = 0, off[3] = {0, 0, 0};
+    double signal = 0, error = 0;
+    long diff, largest = 0;
+
+    for(i = 0; i < count; i++) {
+        diff = labs((long)a[i] - b[i]);
+        signal += (double)a[i] * a[i];
+        error += (double)diff * diff;
+        if(diff > largest) {
+            largest = diff;
+        }
+        if(diff != 0) {
+            differ++;
+            off[(diff > 2) ? 2 : diff - 1]++;
+        }
+    }
+    printf("compared %zu samples: %.1f%% identical, off by 1: %zu, by 2: %zu, by more: %zu\n",
+           count, 100.0 * (count - differ) / count, off[0], off[1], off[2]);
+    if(error == 0) {
+        printf("max error 0 LSB, bit-identical\n");
+    }
+    else {
+        printf("max error %ld LSB, rms error %.3f LSB, SNR %.1f dB\n",
+               largest, sqrt(error / count), 10 * log10(signal / error));
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned char *mp3, *pcm, *ref = NULL;
+    size_t size, bytes, refsize = 0;
+    const char *save = NULL, *against = NULL;
+    double best = 0, start, t;
+    int runs = 10, i;
+
+    for(i = 1; i < argc - 1; i++) {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc - 1) {
+            runs = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc - 1) {
+            save = argv[++i];
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc - 1) {
+            against = argv[++i];
+        }
+        else {
+            break;
+        }
+    }
+    if(i != argc - 1 || runs < 1) {
+        fprintf(stderr, "usage: %s [-n runs] [-o save.raw] [-c reference.raw] file.mp3\n", argv[0]);
+        return 1;
+    }
+    mp3 = ReadFile(argv[i], &size);
+    if(mp3 == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[i]);
+        return 1;
+    }
+    if(against != NULL && (ref = ReadFile(against, &refsize)) == NULL) {
+        fprintf(stderr, "cannot read %s\n", against);
+        return 1;
+    }
+
+    mpg123_init();
+
+    // Decode once for the length and once for the samples, then time the runs
+    bytes = Decode(mp3, size, NULL, 0);
+    pcm = malloc(bytes);
+    if(bytes == 0 || pcm == NULL || Decode(mp3, size, pcm, bytes) != bytes) {
+        fprintf(stderr, "cannot decode %s\n", argv[i]);
+        return 1;
+    }
+    for(i = 0; i < runs; i++) {
+        start = Now();
+        Decode(mp3, size, NULL, 0);
+        t = Now() - start;
+        if(i == 0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%s: %zu bytes decoded, best of %d runs %.1f ms\n",
+           Decoder, bytes, runs, best * 1e3);
+
+    if(save != NULL) {
+        FILE *f = fopen(save, "wb");
+        if(f == NULL || fwrite(pcm, 1, bytes, f) != bytes) {
+            fprintf(stderr, "cannot write %s\n", save);
+            return 1;
+        }
+        fclose(f);
+    }
+    if(ref != NULL) {
+        if(refsize != bytes) {
+            printf("length differs: %zu bytes in %s\n", refsize, against);
+        }
+        Compare((const short *)ref, (const short *)pcm, ((refsize < bytes) ? refsize : bytes) / 2);
+    }
+
+    mpg123_exit();
+    free(pcm);
+    free(ref);
+    free(mp3);
+    return 0;
+}